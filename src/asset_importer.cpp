@@ -0,0 +1,124 @@
+#include "asset_importer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "cpu_profiler.h"
+#include "mesh_import.h"
+
+AssetImporter::~AssetImporter() {
+    stop();
+}
+
+void AssetImporter::start(int workerCount) {
+    if (!workers_.empty()) {
+        return;
+    }
+    if (workerCount <= 0) {
+        workerCount = std::max(1, (int) std::thread::hardware_concurrency() - 2);
+    }
+    stopping_ = false;
+    for (int i = 0; i < workerCount; i++) {
+        workers_.emplace_back(&AssetImporter::workerMain, this);
+    }
+}
+
+void AssetImporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        pending_ -= (int) requests_.size();
+        requests_.clear();
+    }
+    wake_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void AssetImporter::request(const std::string &path, const PackOptions &options) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.push_back({path, options});
+        pending_++;
+    }
+    wake_.notify_one();
+}
+
+bool AssetImporter::takeFinished(ImportedAsset &out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_.empty()) {
+        return false;
+    }
+    out = std::move(finished_.front());
+    finished_.pop_front();
+    pending_--;
+    return true;
+}
+
+int AssetImporter::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+void AssetImporter::workerMain() {
+    PROFILE_THREAD_NAME("importer");
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !requests_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            request = std::move(requests_.front());
+            requests_.pop_front();
+        }
+
+        ImportedAsset asset;
+        import(request, asset);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back(std::move(asset));
+    }
+}
+
+void AssetImporter::import(const Request &request, ImportedAsset &out) {
+    PROFILE_ZONE("import asset");
+    auto startTime = std::chrono::steady_clock::now();
+    out.path = request.path;
+
+    const std::string &path = request.path;
+    if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".mesh") == 0) {
+        // Already packed; mapping it is all the work there is
+        out.mapped = std::make_shared<MappedMeshFile>();
+        if (!out.mapped->open(path.c_str())) {
+            out.mapped.reset();
+            return;
+        }
+        for (size_t i = 0; i < out.mapped->partCount(); i++) {
+            out.parts.push_back(out.mapped->part(i));
+        }
+    } else {
+        ImportedGeometry geometry;
+        if (!import_geometry(path, geometry)) {
+            return;
+        }
+        out.packed = pack_mesh_clusters(geometry.positions.data(), (int) (geometry.positions.size() / 3),
+                                        geometry.indices.data(), (int) geometry.indices.size(), request.options);
+        for (const PackedMesh &mesh : out.packed) {
+            out.parts.push_back(view_of(mesh));
+        }
+    }
+
+    for (const PackedMeshView &part : out.parts) {
+        out.bytes += (size_t) part.vertexCount * vertex_format_stride(part.format) +
+                     (size_t) part.indexCount * index_type_size(part.indexType);
+        out.vertexCount += part.vertexCount;
+        out.triangleCount += full_detail_index_count(part) / 3;
+    }
+    out.ok = !out.parts.empty();
+    out.importMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
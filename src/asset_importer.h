@@ -0,0 +1,70 @@
+#ifndef PROJECT_ASSET_IMPORTER_H
+#define PROJECT_ASSET_IMPORTER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh_file.h"
+#include "packed_mesh.h"
+
+// One finished import, ready for GeometryArena::addPackedMesh(). `parts` points either into `packed` or into the
+// mapping of a .mesh file, both of which live as long as the asset.
+struct ImportedAsset {
+    std::string path;
+    bool ok = false;
+    std::vector<PackedMeshView> parts;
+    std::vector<PackedMesh> packed;
+    std::shared_ptr<MappedMeshFile> mapped;
+    size_t bytes = 0;        // vertex and index data to upload
+    int vertexCount = 0;
+    int triangleCount = 0;
+    double importMs = 0.0;   // reading, parsing and packing on the worker
+};
+
+// Loads model files on worker threads so the GL thread never waits on disk or parsing. Workers read and parse the
+// file (OBJ, glTF, or an already packed .mesh, which is only mapped) and pack it into 16-bit clusters; the GL thread
+// collects finished assets with takeFinished() and uploads them when it has time.
+class AssetImporter {
+public:
+    AssetImporter() = default;
+    ~AssetImporter();
+    AssetImporter(const AssetImporter &) = delete;
+    AssetImporter &operator=(const AssetImporter &) = delete;
+
+    // Zero workers picks one per hardware thread, minus the main and render threads
+    void start(int workerCount = 0);
+    // Drops queued requests and joins the workers; imports in progress are finished first
+    void stop();
+
+    void request(const std::string &path, const PackOptions &options);
+
+    // Hands over the oldest finished asset, failed ones included. Never blocks.
+    bool takeFinished(ImportedAsset &out);
+
+    // Requests not yet collected with takeFinished()
+    int pending() const;
+
+private:
+    struct Request {
+        std::string path;
+        PackOptions options;
+    };
+
+    void workerMain();
+    static void import(const Request &request, ImportedAsset &out);
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Request> requests_;
+    std::deque<ImportedAsset> finished_;
+    int pending_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+#endif //PROJECT_ASSET_IMPORTER_H
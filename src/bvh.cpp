@@ -0,0 +1,538 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include "cpu_profiler.h"
+#include "job_system.h"
+
+// Centroid bins per axis for the SAH split search
+static const int SAH_BINS = 12;
+// Leaves at or below this size are only split when the SAH says it pays off; larger ones are always split
+static const uint32_t MAX_LEAF_SIZE = 8;
+// Cost of visiting a node, relative to testing one primitive
+static const float TRAVERSAL_COST = 1.0f;
+// The top of the tree is split into about this many subtrees, which are built in parallel
+static const size_t BUILD_SUBTREES = 64;
+// Nodes with fewer primitives than this are not worth a subtree of their own
+static const uint32_t PARALLEL_BUILD_MIN = 4096;
+
+static float half_area(const float minimum[3], const float maximum[3]) {
+    float x = maximum[0] - minimum[0];
+    float y = maximum[1] - minimum[1];
+    float z = maximum[2] - minimum[2];
+    return x * y + y * z + z * x;
+}
+
+static void empty_box(float minimum[3], float maximum[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        minimum[axis] = FLT_MAX;
+        maximum[axis] = -FLT_MAX;
+    }
+}
+
+static void grow_box(float minimum[3], float maximum[3], const float otherMinimum[3], const float otherMaximum[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        minimum[axis] = std::min(minimum[axis], otherMinimum[axis]);
+        maximum[axis] = std::max(maximum[axis], otherMaximum[axis]);
+    }
+}
+
+void Bvh::clear() {
+    nodes_.clear();
+    primitives_.clear();
+    boxes_.clear();
+}
+
+static float centroid(const float minimum[3], const float maximum[3], int axis) {
+    return (minimum[axis] + maximum[axis]) * 0.5f;
+}
+
+void Bvh::loadBoxes(const BoundsSoA &bounds) {
+    boxes_.resize(primitives_.size());
+    const float *center[3] = {bounds.centerX(), bounds.centerY(), bounds.centerZ()};
+    const float *extent[3] = {bounds.extentX(), bounds.extentY(), bounds.extentZ()};
+    for (size_t slot = 0; slot < primitives_.size(); slot++) {
+        uint32_t primitive = primitives_[slot];
+        for (int axis = 0; axis < 3; axis++) {
+            boxes_[slot].minimum[axis] = center[axis][primitive] - extent[axis][primitive];
+            boxes_[slot].maximum[axis] = center[axis][primitive] + extent[axis][primitive];
+        }
+    }
+}
+
+void Bvh::grow(BvhNode &node, const Box &box) const {
+    grow_box(node.minimum, node.maximum, box.minimum, box.maximum);
+}
+
+void Bvh::build(const BoundsSoA &bounds, JobSystem *jobs) {
+    PROFILE_ZONE("bvh build");
+    auto startTime = std::chrono::steady_clock::now();
+    clear();
+    size_t count = bounds.size();
+    if (count == 0) {
+        stats_.buildMs = 0.0;
+        return;
+    }
+    primitives_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        primitives_[i] = (uint32_t) i;
+    }
+    loadBoxes(bounds);
+
+    BvhNode root{};
+    root.first = 0;
+    root.count = (uint32_t) count;
+    empty_box(root.minimum, root.maximum);
+    for (const Box &box : boxes_) {
+        grow(root, box);
+    }
+    nodes_.push_back(root);
+
+    // Split the top of the tree here until there are enough subtrees to keep every thread busy, then build those
+    // independently. The split does not depend on the thread count, so the layout is the same with or without jobs.
+    std::vector<uint32_t> frontier = {0};
+    bool splitAny = true;
+    while (splitAny && frontier.size() < BUILD_SUBTREES) {
+        splitAny = false;
+        std::vector<uint32_t> next;
+        for (uint32_t nodeIndex : frontier) {
+            if (nodes_[nodeIndex].count > PARALLEL_BUILD_MIN) {
+                subdivide(nodes_, nodeIndex);
+            }
+            if (nodes_[nodeIndex].count == 0) {
+                next.push_back(nodes_[nodeIndex].first);
+                next.push_back(nodes_[nodeIndex].first + 1);
+                splitAny = true;
+            } else {
+                next.push_back(nodeIndex);
+            }
+        }
+        frontier.swap(next);
+    }
+
+    std::vector<std::vector<BvhNode>> subtrees(frontier.size());
+    auto buildSubtrees = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            std::vector<BvhNode> &nodes = subtrees[i];
+            nodes.push_back(nodes_[frontier[i]]);
+            std::vector<uint32_t> pending = {0};
+            while (!pending.empty()) {
+                uint32_t nodeIndex = pending.back();
+                pending.pop_back();
+                subdivide(nodes, nodeIndex);
+                if (nodes[nodeIndex].count == 0) {
+                    pending.push_back(nodes[nodeIndex].first);
+                    pending.push_back(nodes[nodeIndex].first + 1);
+                }
+            }
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(subtrees.size(), 1, buildSubtrees);
+    } else {
+        buildSubtrees(0, subtrees.size());
+    }
+
+    // Splice the subtrees in after the top nodes. Their local root replaces the frontier node, so local index i > 0
+    // lands at base + i - 1; children still come after their parents, which refit() relies on.
+    for (size_t i = 0; i < subtrees.size(); i++) {
+        const std::vector<BvhNode> &nodes = subtrees[i];
+        uint32_t base = (uint32_t) nodes_.size();
+        for (size_t local = 0; local < nodes.size(); local++) {
+            BvhNode node = nodes[local];
+            if (node.count == 0) {
+                node.first = base + node.first - 1;
+            }
+            if (local == 0) {
+                nodes_[frontier[i]] = node;
+            } else {
+                nodes_.push_back(node);
+            }
+        }
+    }
+    stats_.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Bvh::subdivide(std::vector<BvhNode> &nodes, uint32_t nodeIndex) {
+    BvhNode node = nodes[nodeIndex];
+    if (node.count <= 1) {
+        return;
+    }
+
+    // Bin the centroids rather than the boxes: a primitive goes to exactly one side
+    float centroidMin[3], centroidMax[3];
+    empty_box(centroidMin, centroidMax);
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        float center[3];
+        for (int axis = 0; axis < 3; axis++) {
+            center[axis] = centroid(boxes_[i].minimum, boxes_[i].maximum, axis);
+        }
+        grow_box(centroidMin, centroidMax, center, center);
+    }
+
+    // One pass over the primitives fills the bins of all three axes
+    struct Bin {
+        float minimum[3];
+        float maximum[3];
+        uint32_t count;
+    } bins[3][SAH_BINS];
+    float binScale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        binScale[axis] = extent > 0.0f ? (float) SAH_BINS / extent : 0.0f;
+        for (Bin &bin : bins[axis]) {
+            empty_box(bin.minimum, bin.maximum);
+            bin.count = 0;
+        }
+    }
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        const Box &box = boxes_[i];
+        for (int axis = 0; axis < 3; axis++) {
+            float center = centroid(box.minimum, box.maximum, axis);
+            int index = std::min(SAH_BINS - 1, (int) ((center - centroidMin[axis]) * binScale[axis]));
+            Bin &bin = bins[axis][index];
+            bin.count++;
+            grow_box(bin.minimum, bin.maximum, box.minimum, box.maximum);
+        }
+    }
+
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+        if (binScale[axis] == 0.0f) {
+            continue;
+        }
+        // Sweep from both ends so every split plane costs O(1)
+        float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+        uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+        float leftMin[3], leftMax[3], rightMin[3], rightMax[3];
+        empty_box(leftMin, leftMax);
+        empty_box(rightMin, rightMax);
+        uint32_t leftSum = 0, rightSum = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            const Bin &leftBin = bins[axis][i];
+            leftSum += leftBin.count;
+            if (leftBin.count > 0) {
+                grow_box(leftMin, leftMax, leftBin.minimum, leftBin.maximum);
+            }
+            leftCount[i] = leftSum;
+            leftArea[i] = leftSum > 0 ? half_area(leftMin, leftMax) : 0.0f;
+
+            const Bin &rightBin = bins[axis][SAH_BINS - 1 - i];
+            rightSum += rightBin.count;
+            if (rightBin.count > 0) {
+                grow_box(rightMin, rightMax, rightBin.minimum, rightBin.maximum);
+            }
+            rightCount[SAH_BINS - 2 - i] = rightSum;
+            rightArea[SAH_BINS - 2 - i] = rightSum > 0 ? half_area(rightMin, rightMax) : 0.0f;
+        }
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) {
+                continue;
+            }
+            float cost = (float) leftCount[i] * leftArea[i] + (float) rightCount[i] * rightArea[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0) {
+        float leafCost = (float) node.count * half_area(node.minimum, node.maximum);
+        float splitCost = TRAVERSAL_COST * half_area(node.minimum, node.maximum) + bestCost;
+        if (node.count <= MAX_LEAF_SIZE && splitCost >= leafCost) {
+            return;
+        }
+        // Boxes are kept in slot order, so they move together with the primitive indices
+        auto goesLeft = [&](const Box &box) {
+            float center = centroid(box.minimum, box.maximum, bestAxis);
+            return std::min(SAH_BINS - 1, (int) ((center - centroidMin[bestAxis]) * binScale[bestAxis])) <= bestSplit;
+        };
+        uint32_t low = node.first;
+        uint32_t high = node.first + node.count;
+        while (low < high) {
+            if (goesLeft(boxes_[low])) {
+                low++;
+            } else {
+                high--;
+                std::swap(boxes_[low], boxes_[high]);
+                std::swap(primitives_[low], primitives_[high]);
+            }
+        }
+        middle = low;
+    } else {
+        // Every centroid is in the same place, so no plane separates them; split the slots in half
+        if (node.count <= MAX_LEAF_SIZE) {
+            return;
+        }
+        middle = node.first + node.count / 2;
+    }
+
+    BvhNode left{}, right{};
+    left.first = node.first;
+    left.count = middle - node.first;
+    right.first = middle;
+    right.count = node.first + node.count - middle;
+    for (BvhNode *child : {&left, &right}) {
+        empty_box(child->minimum, child->maximum);
+        for (uint32_t i = child->first; i < child->first + child->count; i++) {
+            grow(*child, boxes_[i]);
+        }
+    }
+
+    nodes[nodeIndex].first = (uint32_t) nodes.size();
+    nodes[nodeIndex].count = 0;
+    nodes.push_back(left);
+    nodes.push_back(right);
+}
+
+void Bvh::refit(const BoundsSoA &bounds) {
+    PROFILE_ZONE("bvh refit");
+    auto startTime = std::chrono::steady_clock::now();
+    if (bounds.size() != primitives_.size()) {
+        build(bounds, nullptr);
+        return;
+    }
+    loadBoxes(bounds);
+    // Children are always stored after their parent, so walking backwards visits them first
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        BvhNode &node = nodes_[i];
+        empty_box(node.minimum, node.maximum);
+        if (node.count > 0) {
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+                grow(node, boxes_[slot]);
+            }
+        } else {
+            const BvhNode &left = nodes_[node.first];
+            const BvhNode &right = nodes_[node.first + 1];
+            grow_box(node.minimum, node.maximum, left.minimum, left.maximum);
+            grow_box(node.minimum, node.maximum, right.minimum, right.maximum);
+        }
+    }
+    stats_.refitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// 0 if the box is outside one of the planes in `mask`, otherwise `mask` minus the planes the box is fully inside
+static unsigned int classify(const Frustum &frustum, const float minimum[3], const float maximum[3],
+                             unsigned int mask, bool &outside) {
+    float center[3], extent[3];
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+        extent[axis] = (maximum[axis] - minimum[axis]) * 0.5f;
+    }
+    outside = false;
+    for (int p = 0; p < 6; p++) {
+        if ((mask & (1u << p)) == 0) {
+            continue;
+        }
+        const float *plane = frustum.planes[p];
+        float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+        float radius = std::fabs(plane[0]) * extent[0] + std::fabs(plane[1]) * extent[1] +
+                       std::fabs(plane[2]) * extent[2];
+        if (distance + radius < 0.0f) {
+            outside = true;
+            return 0;
+        }
+        if (distance - radius >= 0.0f) {
+            mask &= ~(1u << p);
+        }
+    }
+    return mask;
+}
+
+void Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) {
+    PROFILE_ZONE("bvh cull");
+    auto startTime = std::chrono::steady_clock::now();
+    stats_.nodesVisited = 0;
+    // Each entry is a node and the planes its box still straddles
+    std::vector<std::pair<uint32_t, unsigned int>> stack;
+    if (!nodes_.empty()) {
+        stack.emplace_back(0, 0x3fu);
+    }
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back().first;
+        unsigned int mask = stack.back().second;
+        stack.pop_back();
+        stats_.nodesVisited++;
+
+        const BvhNode &node = nodes_[nodeIndex];
+        if (mask != 0) {
+            bool outside;
+            mask = classify(frustum, node.minimum, node.maximum, mask, outside);
+            if (outside) {
+                continue;
+            }
+        }
+        if (node.count == 0 && mask == 0) {
+            // Partitioning is in place, so a subtree owns one contiguous run of slots, from its leftmost leaf to
+            // its rightmost one
+            const BvhNode *leftmost = &node;
+            while (leftmost->count == 0) {
+                leftmost = &nodes_[leftmost->first];
+            }
+            const BvhNode *rightmost = &node;
+            while (rightmost->count == 0) {
+                rightmost = &nodes_[rightmost->first + 1];
+            }
+            visible.insert(visible.end(), primitives_.begin() + leftmost->first,
+                           primitives_.begin() + rightmost->first + rightmost->count);
+            continue;
+        }
+        if (node.count == 0) {
+            stack.emplace_back(node.first + 1, mask);
+            stack.emplace_back(node.first, mask);
+            continue;
+        }
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+            uint32_t primitive = primitives_[slot];
+            bool outside = false;
+            if (mask != 0) {
+                classify(frustum, boxes_[slot].minimum, boxes_[slot].maximum, mask, outside);
+            }
+            if (!outside) {
+                visible.push_back(primitive);
+            }
+        }
+    }
+    stats_.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Distance along the ray where it enters the box, or FLT_MAX if it misses it within maxDistance
+static float ray_box(const float origin[3], const float inverseDirection[3], float maxDistance,
+                     const float minimum[3], const float maximum[3]) {
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        float t0 = (minimum[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (maximum[axis] - origin[axis]) * inverseDirection[axis];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        // NaN (origin on a slab of a ray parallel to it) compares false and leaves the interval alone
+        entry = t0 > entry ? t0 : entry;
+        exit = t1 < exit ? t1 : exit;
+    }
+    return entry <= exit ? entry : FLT_MAX;
+}
+
+bool Bvh::raycast(const float origin[3], const float direction[3], float maxDistance, RayHit &hit) const {
+    if (nodes_.empty()) {
+        return false;
+    }
+    float inverseDirection[3];
+    for (int axis = 0; axis < 3; axis++) {
+        inverseDirection[axis] = 1.0f / direction[axis];
+    }
+
+    bool found = false;
+    float closest = maxDistance;
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode &node = nodes_[stack.back()];
+        stack.pop_back();
+        if (ray_box(origin, inverseDirection, closest, node.minimum, node.maximum) == FLT_MAX) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+                uint32_t primitive = primitives_[slot];
+                float distance = ray_box(origin, inverseDirection, closest, boxes_[slot].minimum,
+                                         boxes_[slot].maximum);
+                if (distance != FLT_MAX && (!found || distance < closest)) {
+                    found = true;
+                    closest = distance;
+                    hit.primitive = primitive;
+                    hit.distance = distance;
+                }
+            }
+            continue;
+        }
+        // Visit the nearer child first so the far one is usually rejected by the shrunken interval
+        const BvhNode &left = nodes_[node.first];
+        const BvhNode &right = nodes_[node.first + 1];
+        float leftDistance = ray_box(origin, inverseDirection, closest, left.minimum, left.maximum);
+        float rightDistance = ray_box(origin, inverseDirection, closest, right.minimum, right.maximum);
+        uint32_t nearChild = leftDistance <= rightDistance ? node.first : node.first + 1;
+        uint32_t farChild = nearChild == node.first ? node.first + 1 : node.first;
+        if (std::max(leftDistance, rightDistance) != FLT_MAX) {
+            stack.push_back(farChild);
+        }
+        if (std::min(leftDistance, rightDistance) != FLT_MAX) {
+            stack.push_back(nearChild);
+        }
+    }
+    return found;
+}
+
+void Bvh::overlap(const float minimum[3], const float maximum[3], std::vector<uint32_t> &out) const {
+    auto overlaps = [&](const float otherMinimum[3], const float otherMaximum[3]) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (otherMinimum[axis] > maximum[axis] || otherMaximum[axis] < minimum[axis]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (nodes_.empty()) {
+        return;
+    }
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode &node = nodes_[stack.back()];
+        stack.pop_back();
+        if (!overlaps(node.minimum, node.maximum)) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+            continue;
+        }
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+            uint32_t primitive = primitives_[slot];
+            if (overlaps(boxes_[slot].minimum, boxes_[slot].maximum)) {
+                out.push_back(primitive);
+            }
+        }
+    }
+}
+
+void Bvh::withinDistance(const float point[3], float radius, std::vector<uint32_t> &out) const {
+    auto near = [&](const float minimum[3], const float maximum[3]) {
+        float squared = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float d = std::max(std::max(minimum[axis] - point[axis], point[axis] - maximum[axis]), 0.0f);
+            squared += d * d;
+        }
+        return squared <= radius * radius;
+    };
+    if (nodes_.empty()) {
+        return;
+    }
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode &node = nodes_[stack.back()];
+        stack.pop_back();
+        if (!near(node.minimum, node.maximum)) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+            continue;
+        }
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+            uint32_t primitive = primitives_[slot];
+            if (near(boxes_[slot].minimum, boxes_[slot].maximum)) {
+                out.push_back(primitive);
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef PROJECT_BVH_H
+#define PROJECT_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "culling.h"
+
+class JobSystem;
+
+// 32 bytes, two nodes per cache line. Interior nodes have count == 0 and their children at first and first + 1;
+// leaves own primitive slots [first, first + count).
+struct BvhNode {
+    float minimum[3];
+    uint32_t first;
+    float maximum[3];
+    uint32_t count;
+};
+
+struct RayHit {
+    uint32_t primitive = 0;
+    float distance = 0.0f;
+};
+
+// Bounding volume hierarchy over the boxes of a BoundsSoA. Built top-down with a binned surface area heuristic.
+// When the primitives move but keep roughly the same layout, refit() updates the boxes bottom-up in O(n) without
+// rebuilding the tree; quality degrades as they drift, so rebuild once they have moved far.
+//
+// All queries work on primitive bounds and return indices into the BoundsSoA the tree was built from.
+class Bvh {
+public:
+    struct Stats {
+        double buildMs = 0.0;
+        double refitMs = 0.0;
+        double cullMs = 0.0;
+        // Nodes touched by the last cull, to compare against a linear scan
+        size_t nodesVisited = 0;
+    };
+
+    void clear();
+    // Builds the lower levels on the job system's threads when given
+    void build(const BoundsSoA &bounds, JobSystem *jobs = nullptr);
+    // `bounds` must have the same size as at build time
+    void refit(const BoundsSoA &bounds);
+
+    // Appends every primitive that is not entirely outside the frustum. Subtrees fully inside are taken without
+    // testing their primitives.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+    // Closest primitive box the ray enters within maxDistance. `direction` need not be normalized; the distance is
+    // in multiples of it.
+    bool raycast(const float origin[3], const float direction[3], float maxDistance, RayHit &hit) const;
+    // Primitives whose boxes overlap the given box
+    void overlap(const float minimum[3], const float maximum[3], std::vector<uint32_t> &out) const;
+    // Primitives whose boxes come within `radius` of the point
+    void withinDistance(const float point[3], float radius, std::vector<uint32_t> &out) const;
+
+    bool empty() const { return nodes_.empty(); }
+    size_t nodeCount() const { return nodes_.size(); }
+    size_t primitiveCount() const { return primitives_.size(); }
+    const Stats &stats() const { return stats_; }
+
+private:
+    // Primitive boxes as min/max
+    struct Box {
+        float minimum[3];
+        float maximum[3];
+    };
+
+    void loadBoxes(const BoundsSoA &bounds);
+    // Splits nodes[nodeIndex] if the SAH says so, appending its children to `nodes`
+    void subdivide(std::vector<BvhNode> &nodes, uint32_t nodeIndex);
+    void grow(BvhNode &node, const Box &box) const;
+
+    std::vector<BvhNode> nodes_;
+    // Leaf slots, indices into the BoundsSoA, and the box of each slot
+    std::vector<uint32_t> primitives_;
+    std::vector<Box> boxes_;
+    Stats stats_;
+};
+
+#endif //PROJECT_BVH_H
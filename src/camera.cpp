@@ -0,0 +1,185 @@
+#include "camera.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+void matrix_identity(float out[16]) {
+    for (int i = 0; i < 16; i++) {
+        out[i] = i % 5 == 0 ? 1.0f : 0.0f;
+    }
+}
+
+void matrix_multiply(const float a[16], const float b[16], float out[16]) {
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            out[column * 4 + row] = sum;
+        }
+    }
+}
+
+void matrix_orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane,
+                         float out[16]) {
+    matrix_identity(out);
+    out[0] = 2.0f / (right - left);
+    out[5] = 2.0f / (top - bottom);
+    out[10] = -2.0f / (farPlane - nearPlane);
+    out[12] = -(right + left) / (right - left);
+    out[13] = -(top + bottom) / (top - bottom);
+    out[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+}
+
+void matrix_perspective(float fovY, float aspect, float nearPlane, float farPlane, float out[16]) {
+    float f = 1.0f / std::tan(fovY * 0.5f);
+    std::memset(out, 0, 16 * sizeof(float));
+    out[0] = f / aspect;
+    out[5] = f;
+    out[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    out[11] = -1.0f;
+    out[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+}
+
+static void normalize3(float v[3]) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void cross3(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void matrix_look_at(const float eye[3], const float target[3], const float up[3], float out[16]) {
+    float forward[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+    normalize3(forward);
+    float side[3];
+    cross3(forward, up, side);
+    normalize3(side);
+    float trueUp[3];
+    cross3(side, forward, trueUp);
+
+    matrix_identity(out);
+    for (int i = 0; i < 3; i++) {
+        out[i * 4 + 0] = side[i];
+        out[i * 4 + 1] = trueUp[i];
+        out[i * 4 + 2] = -forward[i];
+    }
+    out[12] = -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]);
+    out[13] = -(trueUp[0] * eye[0] + trueUp[1] * eye[1] + trueUp[2] * eye[2]);
+    out[14] = forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2];
+}
+
+bool matrix_invert(const float m[16], float out[16]) {
+    // Cofactor expansion via the 2x2 sub-determinants of the upper and lower row pairs
+    float s0 = m[0] * m[5] - m[4] * m[1];
+    float s1 = m[0] * m[9] - m[8] * m[1];
+    float s2 = m[0] * m[13] - m[12] * m[1];
+    float s3 = m[4] * m[9] - m[8] * m[5];
+    float s4 = m[4] * m[13] - m[12] * m[5];
+    float s5 = m[8] * m[13] - m[12] * m[9];
+    float c5 = m[10] * m[15] - m[14] * m[11];
+    float c4 = m[6] * m[15] - m[14] * m[7];
+    float c3 = m[6] * m[11] - m[10] * m[7];
+    float c2 = m[2] * m[15] - m[14] * m[3];
+    float c1 = m[2] * m[11] - m[10] * m[3];
+    float c0 = m[2] * m[7] - m[6] * m[3];
+    float determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (determinant == 0.0f) {
+        return false;
+    }
+    float inverse = 1.0f / determinant;
+    float result[16] = {
+            (m[5] * c5 - m[9] * c4 + m[13] * c3) * inverse,
+            (-m[1] * c5 + m[9] * c2 - m[13] * c1) * inverse,
+            (m[1] * c4 - m[5] * c2 + m[13] * c0) * inverse,
+            (-m[1] * c3 + m[5] * c1 - m[9] * c0) * inverse,
+            (-m[4] * c5 + m[8] * c4 - m[12] * c3) * inverse,
+            (m[0] * c5 - m[8] * c2 + m[12] * c1) * inverse,
+            (-m[0] * c4 + m[4] * c2 - m[12] * c0) * inverse,
+            (m[0] * c3 - m[4] * c1 + m[8] * c0) * inverse,
+            (m[7] * s5 - m[11] * s4 + m[15] * s3) * inverse,
+            (-m[3] * s5 + m[11] * s2 - m[15] * s1) * inverse,
+            (m[3] * s4 - m[7] * s2 + m[15] * s0) * inverse,
+            (-m[3] * s3 + m[7] * s1 - m[11] * s0) * inverse,
+            (-m[6] * s5 + m[10] * s4 - m[14] * s3) * inverse,
+            (m[2] * s5 - m[10] * s2 + m[14] * s1) * inverse,
+            (-m[2] * s4 + m[6] * s2 - m[14] * s0) * inverse,
+            (m[2] * s3 - m[6] * s1 + m[10] * s0) * inverse
+    };
+    std::memcpy(out, result, sizeof(result));
+    return true;
+}
+
+static bool unproject(const float inverseViewProjection[16], float x, float y, float z, float out[3]) {
+    const float *m = inverseViewProjection;
+    float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+    if (w == 0.0f) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        out[i] = (m[i] * x + m[4 + i] * y + m[8 + i] * z + m[12 + i]) / w;
+    }
+    return true;
+}
+
+bool ray_from_ndc(const float inverseViewProjection[16], float x, float y, float origin[3], float direction[3]) {
+    float farPoint[3];
+    if (!unproject(inverseViewProjection, x, y, -1.0f, origin) ||
+        !unproject(inverseViewProjection, x, y, 1.0f, farPoint)) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        direction[i] = farPoint[i] - origin[i];
+    }
+    return true;
+}
+
+float pixels_per_unit(const float viewProjection[16], const float center[3], float radius, float viewportHeight) {
+    const float *m = viewProjection;
+    // Clip-space y per unit along the steepest direction, and w at the nearest point of the sphere
+    float yScale = std::sqrt(m[1] * m[1] + m[5] * m[5] + m[9] * m[9]);
+    float w = m[3] * center[0] + m[7] * center[1] + m[11] * center[2] + m[15] -
+              radius * std::sqrt(m[3] * m[3] + m[7] * m[7] + m[11] * m[11]);
+    if (w <= 1e-6f) {
+        return FLT_MAX;
+    }
+    return 0.5f * viewportHeight * yScale / w;
+}
+
+Camera::Camera() {
+    matrix_identity(view_);
+    matrix_identity(projection_);
+}
+
+void Camera::setView(const float view[16]) {
+    std::memcpy(view_, view, sizeof(view_));
+}
+
+void Camera::setProjection(const float projection[16]) {
+    std::memcpy(projection_, projection, sizeof(projection_));
+}
+
+void Camera::lookAt(const float eye[3], const float target[3], const float up[3]) {
+    matrix_look_at(eye, target, up, view_);
+}
+
+void Camera::setPerspective(float fovY, float aspect, float nearPlane, float farPlane) {
+    matrix_perspective(fovY, aspect, nearPlane, farPlane, projection_);
+}
+
+void Camera::setOrthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane) {
+    matrix_orthographic(left, right, bottom, top, nearPlane, farPlane, projection_);
+}
+
+void Camera::viewProjection(float out[16]) const {
+    matrix_multiply(projection_, view_, out);
+}
@@ -0,0 +1,43 @@
+#ifndef PROJECT_CAMERA_H
+#define PROJECT_CAMERA_H
+
+// 4x4 matrices are column-major float[16], as glUniformMatrix4fv takes them without transposing
+
+void matrix_identity(float out[16]);
+// out = a * b; out may alias neither input
+void matrix_multiply(const float a[16], const float b[16], float out[16]);
+void matrix_orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane,
+                         float out[16]);
+void matrix_perspective(float fovY, float aspect, float nearPlane, float farPlane, float out[16]);
+void matrix_look_at(const float eye[3], const float target[3], const float up[3], float out[16]);
+// Returns false and leaves out untouched if m is singular
+bool matrix_invert(const float m[16], float out[16]);
+// Ray through a point in normalized device coordinates, from the near plane towards the far plane
+bool ray_from_ndc(const float inverseViewProjection[16], float x, float y, float origin[3], float direction[3]);
+
+// How many pixels one object unit covers around a sphere, for a viewport `viewportHeight` pixels tall. Uses the
+// sphere's nearest depth, so it never underestimates; FLT_MAX when the sphere reaches behind the eye.
+float pixels_per_unit(const float viewProjection[16], const float center[3], float radius, float viewportHeight);
+
+// View and projection for the scene. Starts out as identity for both, i.e. positions are already in clip space.
+class Camera {
+public:
+    Camera();
+
+    void setView(const float view[16]);
+    void setProjection(const float projection[16]);
+    void lookAt(const float eye[3], const float target[3], const float up[3]);
+    void setPerspective(float fovY, float aspect, float nearPlane, float farPlane);
+    void setOrthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane);
+
+    const float *view() const { return view_; }
+    const float *projection() const { return projection_; }
+    // projection * view
+    void viewProjection(float out[16]) const;
+
+private:
+    float view_[16];
+    float projection_[16];
+};
+
+#endif //PROJECT_CAMERA_H
@@ -0,0 +1,111 @@
+#include "cpu_profiler.h"
+
+#ifdef PROJECT_PROFILER
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+CpuProfiler::CpuProfiler() : startTicks_(ticks()), startTime_(std::chrono::steady_clock::now()) {}
+
+CpuProfiler &cpu_profiler() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+CpuProfiler::ThreadBuffer *CpuProfiler::threadBuffer() {
+    // Buffers are never freed, so the pointer stays valid for the life of the process
+    static thread_local ThreadBuffer *current = nullptr;
+    if (current == nullptr) {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->events.reset(new Event[EVENTS_PER_THREAD]);
+        std::lock_guard<std::mutex> lock(buffersMutex_);
+        buffer->id = (uint32_t) buffers_.size() + 1;
+        buffer->name = "thread " + std::to_string(buffer->id);
+        current = buffer.get();
+        buffers_.push_back(std::move(buffer));
+    }
+    return current;
+}
+
+void CpuProfiler::record(const char *name, uint64_t begin, uint64_t end) {
+    ThreadBuffer *buffer = threadBuffer();
+    uint64_t written = buffer->written.load(std::memory_order_relaxed);
+    Event &event = buffer->events[written & (EVENTS_PER_THREAD - 1)];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    buffer->written.store(written + 1, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char *name) {
+    ThreadBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    buffer->name = name;
+}
+
+// Names are string literals in the code, but quotes and backslashes would still break the JSON
+static void write_json_string(std::ostream &out, const char *text) {
+    out << '"';
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << ((unsigned char) *c < 0x20 ? ' ' : *c);
+    }
+    out << '"';
+}
+
+bool CpuProfiler::writeChromeTrace(const char *path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::PROFILER::CANNOT_CREATE " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime_).count();
+    uint64_t elapsedTicks = ticks() - startTicks_;
+    double usPerTick = elapsedTicks > 0 ? elapsedUs / (double) elapsedTicks : 0.0;
+
+    // Timestamps are relative to the earliest zone
+    uint64_t origin = UINT64_MAX;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers_) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t oldest = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = oldest; i < written; i++) {
+            origin = std::min(origin, buffer->events[i & (EVENTS_PER_THREAD - 1)].begin);
+        }
+    }
+
+    file << std::fixed;
+    file.precision(3);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers_) {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+             << ",\"args\":{\"name\":";
+        write_json_string(file, buffer->name.c_str());
+        file << "}}";
+        first = false;
+
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t oldest = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = oldest; i < written; i++) {
+            const Event &event = buffer->events[i & (EVENTS_PER_THREAD - 1)];
+            file << ",\n{\"name\":";
+            write_json_string(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":"
+                 << (double) (event.begin - origin) * usPerTick << ",\"dur\":"
+                 << (double) (event.end - event.begin) * usPerTick << "}";
+        }
+    }
+    file << "\n]}\n";
+    if (!file) {
+        std::cout << "ERROR::PROFILER::WRITE_FAILED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
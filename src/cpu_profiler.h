@@ -0,0 +1,122 @@
+#ifndef PROJECT_CPU_PROFILER_H
+#define PROJECT_CPU_PROFILER_H
+
+// Scoped CPU profiling zones:
+//
+//   PROFILE_ZONE("cull");          // times the rest of the enclosing block
+//   PROFILE_THREAD_NAME("render"); // labels the calling thread in the trace
+//
+// Zones are recorded only while the profiler is enabled, as complete begin/end pairs in a ring buffer owned by the
+// recording thread, so threads never contend. Each ring keeps the last EVENTS_PER_THREAD zones; the trace is written
+// in the Chrome trace event format, which chrome://tracing and Perfetto open.
+//
+// Without PROJECT_PROFILER (release builds) the macros expand to nothing and this header declares nothing else.
+
+#ifdef PROJECT_PROFILER
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROFILER_TSC 1
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#define PROFILER_TSC 1
+#include <intrin.h>
+#endif
+
+class CpuProfiler {
+public:
+    // Power of two
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    struct Event {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // Timestamp in ticks: the time stamp counter on x86, which costs half as much as reading the steady clock,
+    // nanoseconds elsewhere. Ticks are converted to time on export.
+    static uint64_t ticks() {
+#ifdef PROFILER_TSC
+        return __rdtsc();
+#else
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    CpuProfiler();
+
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // `name` must outlive the profiler, e.g. a string literal
+    void record(const char *name, uint64_t begin, uint64_t end);
+    void setThreadName(const char *name);
+
+    // Writes every zone still in the rings. Threads may keep recording meanwhile; zones they overwrite during the
+    // export can come out torn, so export once the interesting part of the run is over.
+    bool writeChromeTrace(const char *path);
+
+private:
+    struct ThreadBuffer {
+        std::string name;
+        uint32_t id;
+        std::unique_ptr<Event[]> events;
+        // Zones ever recorded; only the owning thread writes it
+        std::atomic<uint64_t> written{0};
+    };
+
+    ThreadBuffer *threadBuffer();
+
+    std::atomic<bool> enabled_{false};
+    // Tick counter and clock at construction, to measure the tick rate against when exporting
+    uint64_t startTicks_;
+    std::chrono::steady_clock::time_point startTime_;
+    // Buffers outlive their threads so the zones of finished threads still make it into the trace
+    std::mutex buffersMutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+// The process-wide profiler
+CpuProfiler &cpu_profiler();
+
+class ProfileZone {
+public:
+    explicit ProfileZone(const char *name)
+            : name_(name), begin_(cpu_profiler().enabled() ? CpuProfiler::ticks() : 0) {}
+    ~ProfileZone() {
+        if (begin_ != 0) {
+            cpu_profiler().record(name_, begin_, CpuProfiler::ticks());
+        }
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *name_;
+    uint64_t begin_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) cpu_profiler().setThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name) ((void) 0)
+#define PROFILE_THREAD_NAME(name) ((void) 0)
+
+#endif
+
+#endif //PROJECT_CPU_PROFILER_H
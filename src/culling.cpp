@@ -0,0 +1,289 @@
+#include "culling.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "cpu_profiler.h"
+#include "job_system.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// AVX2 code is compiled per function, so the rest of the build keeps its baseline instruction set
+#if defined(CULL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CULL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define CULL_TARGET_AVX2
+#endif
+
+// Boxes per job; a multiple of 8 so every chunk starts on a SIMD group
+static const size_t CULL_CHUNK = 16384;
+
+Frustum frustum_from_view_projection(const float m[16]) {
+    // Rows of the column-major matrix
+    float rows[4][4];
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            rows[row][column] = m[column * 4 + row];
+        }
+    }
+
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        for (int i = 0; i < 4; i++) {
+            frustum.planes[axis * 2][i] = rows[3][i] + rows[axis][i];
+            frustum.planes[axis * 2 + 1][i] = rows[3][i] - rows[axis][i];
+        }
+    }
+    for (float *plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (int i = 0; i < 4; i++) {
+                plane[i] /= length;
+            }
+        }
+    }
+    return frustum;
+}
+
+void BoundsSoA::clear() {
+    resize(0);
+}
+
+void BoundsSoA::resize(size_t count) {
+    count_ = count;
+    size_t padded = (count + 7) / 8 * 8;
+    for (std::vector<float> *component : {&centerX_, &centerY_, &centerZ_, &extentX_, &extentY_, &extentZ_}) {
+        component->resize(padded, 0.0f);
+    }
+}
+
+void BoundsSoA::set(size_t i, const float minimum[3], const float maximum[3]) {
+    centerX_[i] = (minimum[0] + maximum[0]) * 0.5f;
+    centerY_[i] = (minimum[1] + maximum[1]) * 0.5f;
+    centerZ_[i] = (minimum[2] + maximum[2]) * 0.5f;
+    extentX_[i] = (maximum[0] - minimum[0]) * 0.5f;
+    extentY_[i] = (maximum[1] - minimum[1]) * 0.5f;
+    extentZ_[i] = (maximum[2] - minimum[2]) * 0.5f;
+}
+
+size_t BoundsSoA::add(const float minimum[3], const float maximum[3]) {
+    size_t index = count_;
+    resize(count_ + 1);
+    set(index, minimum, maximum);
+    return index;
+}
+
+CullPath best_cull_path() {
+#if defined(CULL_X86) && (defined(__GNUC__) || defined(__clang__))
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CULL_AVX2;
+    }
+    return CULL_SSE;
+#elif defined(CULL_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        // The OS must save the YMM registers too
+        bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        if (fma && avx && (info[1] & (1 << 5)) != 0) {
+            return CULL_AVX2;
+        }
+    }
+    return CULL_SSE;
+#else
+    return CULL_SCALAR;
+#endif
+}
+
+const char *cull_path_name(CullPath path) {
+    switch (path) {
+        case CULL_SSE:
+            return "sse";
+        case CULL_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+// For every plane, the box center's signed distance plus its projected radius |n| . extent. The box is outside once
+// that is negative for any plane.
+static size_t cull_scalar(const BoundsSoA &bounds, const Frustum &frustum, size_t begin, size_t end,
+                          uint8_t *visible) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (const float *plane : frustum.planes) {
+            float distance = plane[0] * bounds.centerX()[i] + plane[1] * bounds.centerY()[i] +
+                             plane[2] * bounds.centerZ()[i] + plane[3];
+            float radius = std::fabs(plane[0]) * bounds.extentX()[i] + std::fabs(plane[1]) * bounds.extentY()[i] +
+                           std::fabs(plane[2]) * bounds.extentZ()[i];
+            inside = inside && distance + radius >= 0.0f;
+        }
+        visible[i - begin] = inside ? 1 : 0;
+        count += inside ? 1 : 0;
+    }
+    return count;
+}
+
+#ifdef CULL_X86
+static size_t cull_sse(const BoundsSoA &bounds, const Frustum &frustum, size_t begin, size_t end, uint8_t *visible) {
+    __m128 normal[6][3], absNormal[6][3], distance[6];
+    for (int p = 0; p < 6; p++) {
+        for (int axis = 0; axis < 3; axis++) {
+            normal[p][axis] = _mm_set1_ps(frustum.planes[p][axis]);
+            absNormal[p][axis] = _mm_set1_ps(std::fabs(frustum.planes[p][axis]));
+        }
+        distance[p] = _mm_set1_ps(frustum.planes[p][3]);
+    }
+
+    size_t count = 0;
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = begin; i < end; i += 4) {
+        __m128 cx = _mm_loadu_ps(bounds.centerX() + i);
+        __m128 cy = _mm_loadu_ps(bounds.centerY() + i);
+        __m128 cz = _mm_loadu_ps(bounds.centerZ() + i);
+        __m128 ex = _mm_loadu_ps(bounds.extentX() + i);
+        __m128 ey = _mm_loadu_ps(bounds.extentY() + i);
+        __m128 ez = _mm_loadu_ps(bounds.extentZ() + i);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[p][0], cx), _mm_mul_ps(normal[p][1], cy)),
+                                  _mm_add_ps(_mm_mul_ps(normal[p][2], cz), distance[p]));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormal[p][0], ex), _mm_mul_ps(absNormal[p][1], ey)),
+                                  _mm_mul_ps(absNormal[p][2], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+        }
+        int bits = _mm_movemask_ps(inside);
+        size_t lanes = end - i < 4 ? end - i : 4;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            uint8_t bit = (uint8_t) ((bits >> lane) & 1);
+            visible[i - begin + lane] = bit;
+            count += bit;
+        }
+    }
+    return count;
+}
+
+CULL_TARGET_AVX2
+static size_t cull_avx2(const BoundsSoA &bounds, const Frustum &frustum, size_t begin, size_t end,
+                        uint8_t *visible) {
+    __m256 normal[6][3], absNormal[6][3], distance[6];
+    for (int p = 0; p < 6; p++) {
+        for (int axis = 0; axis < 3; axis++) {
+            normal[p][axis] = _mm256_set1_ps(frustum.planes[p][axis]);
+            absNormal[p][axis] = _mm256_set1_ps(std::fabs(frustum.planes[p][axis]));
+        }
+        distance[p] = _mm256_set1_ps(frustum.planes[p][3]);
+    }
+
+    size_t count = 0;
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = begin; i < end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(bounds.centerX() + i);
+        __m256 cy = _mm256_loadu_ps(bounds.centerY() + i);
+        __m256 cz = _mm256_loadu_ps(bounds.centerZ() + i);
+        __m256 ex = _mm256_loadu_ps(bounds.extentX() + i);
+        __m256 ey = _mm256_loadu_ps(bounds.extentY() + i);
+        __m256 ez = _mm256_loadu_ps(bounds.extentZ() + i);
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_fmadd_ps(normal[p][0], cx,
+                                       _mm256_fmadd_ps(normal[p][1], cy,
+                                                       _mm256_fmadd_ps(normal[p][2], cz, distance[p])));
+            __m256 dr = _mm256_fmadd_ps(absNormal[p][0], ex,
+                                        _mm256_fmadd_ps(absNormal[p][1], ey,
+                                                        _mm256_fmadd_ps(absNormal[p][2], ez, d)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dr, zero, _CMP_GE_OQ));
+        }
+        int bits = _mm256_movemask_ps(inside);
+        size_t lanes = end - i < 8 ? end - i : 8;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            uint8_t bit = (uint8_t) ((bits >> lane) & 1);
+            visible[i - begin + lane] = bit;
+            count += bit;
+        }
+    }
+    return count;
+}
+#endif
+
+size_t cull_bounds(CullPath path, const BoundsSoA &bounds, const Frustum &frustum, size_t begin, size_t end,
+                   uint8_t *visible) {
+#ifdef CULL_X86
+    if (path == CULL_AVX2) {
+        return cull_avx2(bounds, frustum, begin, end, visible);
+    }
+    if (path == CULL_SSE) {
+        return cull_sse(bounds, frustum, begin, end, visible);
+    }
+#endif
+    return cull_scalar(bounds, frustum, begin, end, visible);
+}
+
+FrustumCuller::FrustumCuller() : path_(best_cull_path()) {
+}
+
+void FrustumCuller::cull(const BoundsSoA &bounds, const Frustum &frustum, JobSystem *jobs,
+                         std::vector<uint32_t> &visible) {
+    PROFILE_ZONE("frustum cull");
+    auto startTime = std::chrono::steady_clock::now();
+    size_t count = bounds.size();
+    size_t chunks = (count + CULL_CHUNK - 1) / CULL_CHUNK;
+    mask_.resize(count);
+    chunkVisible_.assign(chunks, 0);
+
+    // Test every chunk, then turn the per-chunk counts into output offsets so the chunks can write their visible
+    // indices without coordinating
+    auto test = [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            size_t begin = chunk * CULL_CHUNK;
+            size_t end = begin + CULL_CHUNK < count ? begin + CULL_CHUNK : count;
+            chunkVisible_[chunk] = cull_bounds(path_, bounds, frustum, begin, end, mask_.data() + begin);
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(chunks, 1, test);
+    } else {
+        test(0, chunks);
+    }
+
+    size_t total = 0;
+    for (size_t &chunkCount : chunkVisible_) {
+        size_t offset = total;
+        total += chunkCount;
+        chunkCount = offset;
+    }
+    visible.resize(total);
+
+    auto compact = [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            size_t begin = chunk * CULL_CHUNK;
+            size_t end = begin + CULL_CHUNK < count ? begin + CULL_CHUNK : count;
+            uint32_t *out = visible.data() + chunkVisible_[chunk];
+            for (size_t i = begin; i < end; i++) {
+                if (mask_[i] != 0) {
+                    *out++ = (uint32_t) i;
+                }
+            }
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(chunks, 1, compact);
+    } else {
+        compact(0, chunks);
+    }
+
+    stats_.submitted = count;
+    stats_.visible = total;
+    stats_.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
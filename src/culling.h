@@ -0,0 +1,84 @@
+#ifndef PROJECT_CULLING_H
+#define PROJECT_CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Six planes (left, right, bottom, top, near, far) as a*x + b*y + c*z + d, positive on the inside
+struct Frustum {
+    float planes[6][4];
+};
+
+// Extracts the clip planes of a column-major view-projection matrix (OpenGL clip space, -w <= z <= w)
+Frustum frustum_from_view_projection(const float viewProjection[16]);
+
+// Axis-aligned boxes stored as centers and half extents, one array per component, so the culling kernels can load
+// 4 or 8 boxes per instruction. Arrays are padded to a multiple of 8 so the kernels never need a scalar tail.
+class BoundsSoA {
+public:
+    void clear();
+    // New boxes are empty (zero extent at the origin). set() may be called from several threads for different i.
+    void resize(size_t count);
+    void set(size_t i, const float minimum[3], const float maximum[3]);
+    size_t add(const float minimum[3], const float maximum[3]);
+
+    size_t size() const { return count_; }
+    const float *centerX() const { return centerX_.data(); }
+    const float *centerY() const { return centerY_.data(); }
+    const float *centerZ() const { return centerZ_.data(); }
+    const float *extentX() const { return extentX_.data(); }
+    const float *extentY() const { return extentY_.data(); }
+    const float *extentZ() const { return extentZ_.data(); }
+
+private:
+    size_t count_ = 0;
+    std::vector<float> centerX_, centerY_, centerZ_;
+    std::vector<float> extentX_, extentY_, extentZ_;
+};
+
+enum CullPath {
+    CULL_SCALAR = 0,
+    CULL_SSE = 1,   // 4 boxes per instruction
+    CULL_AVX2 = 2   // 8 boxes per instruction, with FMA
+};
+
+// Widest path this CPU supports
+CullPath best_cull_path();
+const char *cull_path_name(CullPath path);
+
+// Tests boxes [begin, end) against the frustum, writing 1 (visible) or 0 to visible[i - begin]. `begin` must be a
+// multiple of 8. A box is visible unless it lies entirely outside one of the planes, so boxes near frustum corners
+// can be kept conservatively. Returns the number of visible boxes.
+size_t cull_bounds(CullPath path, const BoundsSoA &bounds, const Frustum &frustum, size_t begin, size_t end,
+                   uint8_t *visible);
+
+// Culls a whole BoundsSoA in parallel and compacts the result into a sorted list of visible indices
+class FrustumCuller {
+public:
+    struct Stats {
+        size_t submitted = 0;
+        size_t visible = 0;
+        double cullMs = 0.0;
+    };
+
+    FrustumCuller();
+
+    void setPath(CullPath path) { path_ = path; }
+    CullPath path() const { return path_; }
+
+    // Runs on the job system's threads when given, otherwise on the calling thread
+    void cull(const BoundsSoA &bounds, const Frustum &frustum, JobSystem *jobs, std::vector<uint32_t> &visible);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    CullPath path_;
+    std::vector<uint8_t> mask_;
+    std::vector<size_t> chunkVisible_;
+    Stats stats_;
+};
+
+#endif //PROJECT_CULLING_H
@@ -0,0 +1,228 @@
+#include "draw_queue.h"
+
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include "cpu_profiler.h"
+#include "gl_state.h"
+
+uint64_t DrawQueue::makeKey(unsigned int pass, unsigned int program, unsigned int material, float depth) {
+    // Non-negative IEEE floats order the same way as their bit patterns
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) {
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    }
+    return ((uint64_t) (pass & 0xFu) << 60) |
+           ((uint64_t) (program & 0xFFFu) << 48) |
+           ((uint64_t) (material & 0xFFFFu) << 32) |
+           (uint64_t) depthBits;
+}
+
+void DrawQueue::clear() {
+    keys_.clear();
+    commands_.clear();
+    order_.clear();
+}
+
+void DrawQueue::submit(uint64_t key, const DrawCommand &command) {
+    keys_.push_back(key);
+    commands_.push_back(command);
+}
+
+// Radix digits of 11 bits: a 64-bit key takes six passes instead of eight, and the histograms still fit in L2
+static const int DIGIT_BITS = 11;
+static const uint32_t DIGIT_BUCKETS = 1u << DIGIT_BITS;
+static const int MAX_PASSES = (64 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+// Stable LSD radix sort of `in` over bits [firstBit, firstBit + bits) of keyOf(element). Returns whichever of `in`
+// and `out` holds the result.
+template<typename T, typename KeyOf>
+static T *radix_sort(T *in, T *out, size_t count, int firstBit, int bits, KeyOf keyOf) {
+    int passes = (bits + DIGIT_BITS - 1) / DIGIT_BITS;
+    // Static: 48 KiB is too much for the stack of every thread that sorts
+    static thread_local uint32_t histograms[MAX_PASSES][DIGIT_BUCKETS];
+    std::memset(histograms, 0, sizeof(histograms[0]) * passes);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key = keyOf(in[i]) >> firstBit;
+        for (int pass = 0; pass < passes; pass++) {
+            histograms[pass][(key >> (pass * DIGIT_BITS)) & (DIGIT_BUCKETS - 1)]++;
+        }
+    }
+
+    for (int pass = 0; pass < passes; pass++) {
+        uint32_t *offsets = histograms[pass];
+        int shift = firstBit + pass * DIGIT_BITS;
+        // Every key has the same value for this digit, the pass would not move anything
+        if (offsets[(keyOf(in[0]) >> shift) & (DIGIT_BUCKETS - 1)] == count) {
+            continue;
+        }
+        uint32_t sum = 0;
+        for (uint32_t bucket = 0; bucket < DIGIT_BUCKETS; bucket++) {
+            uint32_t bucketCount = offsets[bucket];
+            offsets[bucket] = sum;
+            sum += bucketCount;
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[offsets[(keyOf(in[i]) >> shift) & (DIGIT_BUCKETS - 1)]++] = in[i];
+        }
+        std::swap(in, out);
+    }
+    return in;
+}
+
+void DrawQueue::sort() {
+    PROFILE_ZONE("draw sort");
+    auto start = std::chrono::steady_clock::now();
+    size_t count = keys_.size();
+    order_.resize(count);
+
+    // Only the bits that differ somewhere need sorting; a frame with a handful of programs and no depth varies in a
+    // narrow band of the key
+    uint64_t varying = 0;
+    for (uint64_t key : keys_) {
+        varying |= key ^ keys_[0];
+    }
+    if (varying == 0) {
+        for (size_t i = 0; i < count; i++) {
+            order_[i] = (uint32_t) i;
+        }
+        stats_.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return;
+    }
+    int low = 0, high = 64;
+    while (((varying >> low) & 1) == 0) {
+        low++;
+    }
+    while (((varying >> (high - 1)) & 1) == 0) {
+        high--;
+    }
+
+    // Key and draw index move together as one element, so each pass scatters into one array instead of two
+    if (high - low <= 32) {
+        // The varying bits and the index fit a single 64-bit word
+        packed_.resize(count);
+        packedScratch_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            packed_[i] = ((keys_[i] >> low) << 32) | (uint64_t) i;
+        }
+        const uint64_t *sorted = radix_sort(packed_.data(), packedScratch_.data(), count, 32, high - low,
+                                            [](uint64_t element) { return element; });
+        uint64_t span = (~0ull >> (64 - (high - low))) << low;
+        uint64_t fixedBits = keys_[0] & ~span;
+        for (size_t i = 0; i < count; i++) {
+            order_[i] = (uint32_t) sorted[i];
+            keys_[i] = fixedBits | ((sorted[i] >> 32) << low);
+        }
+    } else {
+        entries_.resize(count);
+        entryScratch_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            entries_[i].key = keys_[i];
+            entries_[i].index = (uint64_t) i;
+        }
+        const SortEntry *sorted = radix_sort(entries_.data(), entryScratch_.data(), count, low, high - low,
+                                             [](const SortEntry &element) { return element.key; });
+        for (size_t i = 0; i < count; i++) {
+            order_[i] = (uint32_t) sorted[i].index;
+            keys_[i] = sorted[i].key;
+        }
+    }
+
+    stats_.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const DrawQueue::ProgramUniforms &DrawQueue::uniformsFor(unsigned int program) {
+    for (const ProgramUniforms &uniforms : uniforms_) {
+        if (uniforms.program == program) {
+            return uniforms;
+        }
+    }
+    uniforms_.push_back({program, glGetUniformLocation(program, "uPositionScale"),
+                         glGetUniformLocation(program, "uPositionOffset"),
+                         glGetUniformLocation(program, "uViewProjection")});
+    return uniforms_.back();
+}
+
+// Scope names for the profiler, indexed by RenderPass
+static const char *PASS_NAMES[] = {"background pass", "opaque pass", "overlay pass"};
+
+void DrawQueue::execute(const float viewProjection[16], GpuProfiler *profiler) {
+    PROFILE_ZONE("draw submit");
+    GLStateCache &state = gl_state();
+    stats_.draws = 0;
+    stats_.programChanges = 0;
+    stats_.vaoChanges = 0;
+
+    unsigned int lastProgram = ~0u;
+    unsigned int lastVao = ~0u;
+    const ProgramUniforms *uniforms = nullptr;
+    const float *lastScale = nullptr;
+    const float *lastOffset = nullptr;
+    unsigned int lastPass = ~0u;
+    int passScope = -1;
+    for (size_t i = 0; i < order_.size(); i++) {
+        const DrawCommand &command = commands_[order_[i]];
+        // Sorted keys keep each pass together
+        unsigned int pass = (unsigned int) (keys_[i] >> 60);
+        if (profiler != nullptr && pass != lastPass) {
+            profiler->endScope(passScope);
+            passScope = profiler->beginScope(pass <= PASS_OVERLAY ? PASS_NAMES[pass] : "other pass");
+            lastPass = pass;
+        }
+        if (command.program != lastProgram) {
+            state.useProgram(command.program);
+            lastProgram = command.program;
+            stats_.programChanges++;
+            uniforms = &uniformsFor(command.program);
+            lastScale = lastOffset = nullptr;
+            if (uniforms->viewProjection >= 0) {
+                glUniformMatrix4fv(uniforms->viewProjection, 1, GL_FALSE, viewProjection);
+            }
+        }
+        // Uniforms are per program, so they only need setting again when the values change
+        if (uniforms->positionScale >= 0 &&
+            (lastScale == nullptr || std::memcmp(lastScale, command.positionScale, 3 * sizeof(float)) != 0)) {
+            glUniform3fv(uniforms->positionScale, 1, command.positionScale);
+            lastScale = command.positionScale;
+        }
+        if (uniforms->positionOffset >= 0 &&
+            (lastOffset == nullptr || std::memcmp(lastOffset, command.positionOffset, 3 * sizeof(float)) != 0)) {
+            glUniform3fv(uniforms->positionOffset, 1, command.positionOffset);
+            lastOffset = command.positionOffset;
+        }
+        if (command.vao != lastVao) {
+            state.bindVertexArray(command.vao);
+            lastVao = command.vao;
+            stats_.vaoChanges++;
+        }
+
+        if (command.instanceCount > 1) {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, command.indexType,
+                                              (void *) command.indexOffset, command.instanceCount,
+                                              command.baseVertex);
+        } else {
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.count, command.indexType, (void *) command.indexOffset,
+                                     command.baseVertex);
+        }
+        stats_.draws++;
+    }
+    if (profiler != nullptr) {
+        profiler->endScope(passScope);
+    }
+}
+
+DrawCommand make_draw_command(const GeometryArena &arena, const MeshHandle &mesh, unsigned int program, int lod) {
+    DrawCommand command;
+    command.program = program;
+    command.vao = arena.pages()[mesh.page].vao;
+    command.count = (GLsizei) mesh.lods[lod].indexCount;
+    command.indexType = mesh.indexType;
+    command.indexOffset = mesh.indexOffset + mesh.lods[lod].firstIndex * index_type_size(mesh.indexType);
+    command.baseVertex = mesh.baseVertex;
+    for (int axis = 0; axis < 3; axis++) {
+        command.positionScale[axis] = mesh.positionScale[axis];
+        command.positionOffset[axis] = mesh.positionOffset[axis];
+    }
+    return command;
+}
@@ -0,0 +1,138 @@
+#include "frame_pacing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <GLFW/glfw3.h>
+
+// Bounds of the spin margin: below the lower one a sleep that wakes on time still costs a late frame now and then,
+// above the upper one the sleep is broken and spinning would burn most of the frame
+static const std::chrono::microseconds MIN_MARGIN(50);
+static const std::chrono::microseconds MAX_MARGIN(4000);
+
+bool parse_present_mode(const char *text, PresentMode &mode) {
+    if (std::strcmp(text, "off") == 0) {
+        mode = PRESENT_VSYNC_OFF;
+    } else if (std::strcmp(text, "on") == 0) {
+        mode = PRESENT_VSYNC_ON;
+    } else if (std::strcmp(text, "adaptive") == 0) {
+        mode = PRESENT_ADAPTIVE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *present_mode_name(PresentMode mode) {
+    switch (mode) {
+        case PRESENT_VSYNC_OFF:
+            return "off";
+        case PRESENT_VSYNC_ON:
+            return "on";
+        case PRESENT_ADAPTIVE:
+            return "adaptive";
+    }
+    return "unknown";
+}
+
+PresentMode apply_present_mode(PresentMode mode) {
+    if (mode == PRESENT_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        std::cout << "WARNING::FRAME_PACING::NO_ADAPTIVE_VSYNC falling back to vsync" << std::endl;
+        mode = PRESENT_VSYNC_ON;
+    }
+    // A negative interval asks for adaptive vsync
+    glfwSwapInterval(mode == PRESENT_ADAPTIVE ? -1 : (mode == PRESENT_VSYNC_ON ? 1 : 0));
+    return mode;
+}
+
+void FrameLimiter::setRate(double framesPerSecond) {
+    rate_ = std::max(framesPerSecond, 0.0);
+    period_ = rate_ > 0.0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / rate_)) : std::chrono::steady_clock::duration(0);
+    started_ = false;
+}
+
+void FrameLimiter::wait() {
+    if (rate_ <= 0.0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (!started_) {
+        deadline_ = now;
+        started_ = true;
+    }
+    deadline_ += period_;
+    if (deadline_ <= now) {
+        // Late: start the next frame now and count the period from there
+        deadline_ = now;
+        return;
+    }
+
+    auto wakeUp = deadline_ - margin_;
+    if (wakeUp > now) {
+        std::this_thread::sleep_until(wakeUp);
+        auto overshoot = std::chrono::steady_clock::now() - wakeUp;
+        // Grow straight to a bad overshoot, shrink slowly after good ones
+        if (overshoot > margin_) {
+            margin_ = overshoot + overshoot / 4;
+        } else {
+            margin_ -= (margin_ - overshoot) / 16;
+        }
+        margin_ = std::max<std::chrono::steady_clock::duration>(std::min<std::chrono::steady_clock::duration>(
+                margin_, MAX_MARGIN), MIN_MARGIN);
+    }
+    while (std::chrono::steady_clock::now() < deadline_) {
+        std::this_thread::yield();
+    }
+}
+
+FrameTimeHistogram::FrameTimeHistogram() {
+    for (std::atomic<uint32_t> &count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void FrameTimeHistogram::record(double milliseconds) {
+    milliseconds = std::max(milliseconds, 0.0);
+    int bucket = (int) std::min(milliseconds / BUCKET_MS, (double) BUCKETS);
+    counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+    uint64_t us = (uint64_t) std::llround(milliseconds * 1000.0);
+    totalUs_.fetch_add(us, std::memory_order_relaxed);
+    // Only the recording thread writes the maximum
+    if (us > maxUs_.load(std::memory_order_relaxed)) {
+        maxUs_.store(us, std::memory_order_relaxed);
+    }
+}
+
+FrameTimeHistogram::Summary FrameTimeHistogram::summary() const {
+    Summary summary;
+    uint32_t counts[BUCKETS + 1];
+    uint64_t frames = 0;
+    for (int i = 0; i <= BUCKETS; i++) {
+        counts[i] = counts_[i].load(std::memory_order_relaxed);
+        frames += counts[i];
+    }
+    if (frames == 0) {
+        return summary;
+    }
+    summary.frames = frames;
+    summary.maxMs = (double) maxUs_.load(std::memory_order_relaxed) * 1e-3;
+    summary.meanMs = (double) totalUs_.load(std::memory_order_relaxed) * 1e-3 / (double) frames;
+
+    // A percentile is the upper edge of the bucket it falls in, but never more than the maximum
+    const double percentiles[3] = {0.50, 0.95, 0.99};
+    double *results[3] = {&summary.p50Ms, &summary.p95Ms, &summary.p99Ms};
+    uint64_t seen = 0;
+    int next = 0;
+    for (int i = 0; i <= BUCKETS && next < 3; i++) {
+        seen += counts[i];
+        while (next < 3 && (double) seen >= percentiles[next] * (double) frames) {
+            *results[next] = std::min((double) (i + 1) * BUCKET_MS, summary.maxMs);
+            next++;
+        }
+    }
+    return summary;
+}
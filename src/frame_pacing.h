@@ -0,0 +1,77 @@
+#ifndef PROJECT_FRAME_PACING_H
+#define PROJECT_FRAME_PACING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum PresentMode {
+    PRESENT_VSYNC_OFF = 0,
+    PRESENT_VSYNC_ON = 1,
+    // Waits for vertical blank unless the frame is late, then swaps right away and tears instead of stalling a
+    // whole refresh. Needs EXT_swap_control_tear; plain vsync without it.
+    PRESENT_ADAPTIVE = 2
+};
+
+// Parses "off", "on" or "adaptive"; false for anything else
+bool parse_present_mode(const char *text, PresentMode &mode);
+const char *present_mode_name(PresentMode mode);
+
+// Sets the swap interval of the current context. Returns the mode actually in effect.
+PresentMode apply_present_mode(PresentMode mode);
+
+// Holds frames to a fixed rate. The OS sleep overshoots by anything from tens of microseconds to a couple of
+// milliseconds, so wait() sleeps until a margin before the deadline and spins the rest; the margin follows the
+// overshoot it measures. A frame that starts late is not made up for by shortening the next ones.
+class FrameLimiter {
+public:
+    // Frames per second, or 0 for no limit
+    void setRate(double framesPerSecond);
+    double rate() const { return rate_; }
+
+    // Call once per frame, after presenting; returns when the next frame may start
+    void wait();
+
+    // Current spin margin
+    double marginMs() const { return std::chrono::duration<double, std::milli>(margin_).count(); }
+
+private:
+    double rate_ = 0.0;
+    std::chrono::steady_clock::duration period_{0};
+    std::chrono::steady_clock::duration margin_{std::chrono::milliseconds(1)};
+    std::chrono::steady_clock::time_point deadline_;
+    bool started_ = false;
+};
+
+// Distribution of frame times in BUCKET_MS wide buckets up to BUCKETS * BUCKET_MS, with the maximum kept exactly.
+// One thread records, any thread may read a summary at any time; counters are relaxed atomics, so a summary taken
+// while frames are being recorded can be a frame out of date.
+class FrameTimeHistogram {
+public:
+    static const int BUCKETS = 2000;
+    static constexpr double BUCKET_MS = 0.05;
+
+    struct Summary {
+        uint64_t frames = 0;
+        double meanMs = 0.0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    FrameTimeHistogram();
+
+    void record(double milliseconds);
+    Summary summary() const;
+
+private:
+    // The last bucket takes everything longer
+    std::atomic<uint32_t> counts_[BUCKETS + 1];
+    // Microseconds, integral so they fit an atomic
+    std::atomic<uint64_t> totalUs_{0};
+    std::atomic<uint64_t> maxUs_{0};
+};
+
+#endif //PROJECT_FRAME_PACING_H
@@ -0,0 +1,34 @@
+#ifndef PROJECT_FRAME_PACKET_H
+#define PROJECT_FRAME_PACKET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "draw_queue.h"
+#include "geometry_arena.h"
+#include "instancing.h"
+
+// One object the render thread should draw this frame
+struct SceneDraw {
+    RenderPass pass = PASS_OPAQUE;
+    unsigned int program = 0;
+    MeshHandle mesh;
+    // Level of detail picked by the simulation, see select_lod()
+    int lod = 0;
+};
+
+// Everything the render thread needs to draw one frame. Built by the simulation thread and never modified once
+// published, so the render thread can read it without locks.
+struct FramePacket {
+    uint64_t frameIndex = 0;
+    double time = 0.0;
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    float clearColor[4] = {.2f, .3f, .3f, 1.0f};
+    // Column-major; identity draws positions as clip coordinates
+    float viewProjection[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    std::vector<SceneDraw> draws;
+    std::vector<QuadInstance> instances;
+};
+
+#endif //PROJECT_FRAME_PACKET_H
@@ -0,0 +1,195 @@
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "gl_state.h"
+
+// Every mesh's indices start on a 4-byte boundary, whatever their type
+static const size_t INDEX_ALIGNMENT = 4;
+
+static size_t align_index_bytes(size_t bytes) {
+    return (bytes + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+}
+
+GeometryArena::GeometryArena(size_t verticesPerPage, size_t indexBytesPerPage)
+        : verticesPerPage_(verticesPerPage), indexBytesPerPage_(indexBytesPerPage) {
+}
+
+GeometryArena::~GeometryArena() {
+    destroy();
+}
+
+void GeometryArena::destroy() {
+    if (cpuStorage_) {
+        pages_.clear();
+        return;
+    }
+    GLStateCache &state = gl_state();
+    for (Page &page : pages_) {
+        state.deleteVertexArray(page.vao);
+        state.deleteBuffer(page.vbo);
+        state.deleteBuffer(page.ebo);
+    }
+    pages_.clear();
+}
+
+int GeometryArena::findPage(VertexFormat format, size_t vertexCount, size_t indexBytes) {
+    for (size_t i = 0; i < pages_.size(); i++) {
+        const Page &page = pages_[i];
+        if (page.format == format && page.vertexCount + vertexCount <= page.vertexCapacity &&
+            align_index_bytes(page.indexBytes) + indexBytes <= page.indexCapacity) {
+            return (int) i;
+        }
+    }
+    return createPage(format, std::max(vertexCount, verticesPerPage_), std::max(indexBytes, indexBytesPerPage_));
+}
+
+int GeometryArena::createPage(VertexFormat format, size_t vertexCapacity, size_t indexCapacity) {
+    Page page;
+    page.format = format;
+    page.vertexCapacity = vertexCapacity;
+    page.indexCapacity = indexCapacity;
+    if (cpuStorage_) {
+        page.vao = (unsigned int) pages_.size() + 1;
+        pages_.push_back(page);
+        return (int) pages_.size() - 1;
+    }
+
+    glGenVertexArrays(1, &page.vao);
+    glGenBuffers(1, &page.vbo);
+    glGenBuffers(1, &page.ebo);
+
+    GLStateCache &state = gl_state();
+    state.bindVertexArray(page.vao);
+
+    state.bindBuffer(GL_ARRAY_BUFFER, page.vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (vertexCapacity * vertex_format_stride(format)), NULL,
+                 GL_STATIC_DRAW);
+
+    // The element buffer binding is VAO state, so it stays attached to this page's VAO
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) indexCapacity, NULL, GL_STATIC_DRAW);
+
+    setup_position_attribute(format);
+
+    pages_.push_back(page);
+    return (int) pages_.size() - 1;
+}
+
+PackOptions GeometryArena::packOptions() const {
+    PackOptions options;
+    options.quantizationError = quantizationError_;
+    options.allowByteIndices = allowByteIndices_;
+    options.optimize = optimizeMeshes_;
+    options.lodLevels = lodLevels_;
+    return options;
+}
+
+MeshHandle GeometryArena::addMesh(const float *positions, int vertexCount, const unsigned int *indices,
+                                  int indexCount) {
+    PackedMesh packed;
+    MeshOptimizeReport report;
+    if (!pack_mesh(positions, vertexCount, indices, indexCount, packOptions(), packed, &report)) {
+        return MeshHandle();
+    }
+    if (optimizeMeshes_) {
+        optimizeReports_.push_back(report);
+    }
+    return addPackedMesh(view_of(packed));
+}
+
+std::vector<MeshHandle> GeometryArena::addMeshClusters(const float *positions, int vertexCount,
+                                                       const unsigned int *indices, int indexCount) {
+    MeshOptimizeReport report;
+    std::vector<PackedMesh> packed = pack_mesh_clusters(positions, vertexCount, indices, indexCount, packOptions(),
+                                                        &report);
+    if (optimizeMeshes_ && !packed.empty()) {
+        optimizeReports_.push_back(report);
+    }
+
+    std::vector<MeshHandle> clusters;
+    for (const PackedMesh &cluster : packed) {
+        MeshHandle mesh = addPackedMesh(view_of(cluster));
+        if (mesh.valid()) {
+            clusters.push_back(mesh);
+        }
+    }
+    return clusters;
+}
+
+MeshHandle GeometryArena::addPackedMesh(const PackedMeshView &packed) {
+    MeshHandle mesh;
+    if (packed.vertexCount <= 0 || packed.indexCount <= 0) {
+        std::cout << "ERROR::GEOMETRY_ARENA::EMPTY_MESH" << std::endl;
+        return mesh;
+    }
+
+    size_t stride = vertex_format_stride(packed.format);
+    size_t vertexBytes = (size_t) packed.vertexCount * stride;
+    size_t indexBytes = (size_t) packed.indexCount * index_type_size(packed.indexType);
+
+    int pageIndex = findPage(packed.format, (size_t) packed.vertexCount, indexBytes);
+    Page &page = pages_[pageIndex];
+    page.indexBytes = align_index_bytes(page.indexBytes);
+
+    mesh.page = pageIndex;
+    mesh.baseVertex = (int) page.vertexCount;
+    mesh.vertexCount = packed.vertexCount;
+    mesh.indexOffset = page.indexBytes;
+    mesh.indexCount = full_detail_index_count(packed);
+    mesh.indexType = packed.indexType;
+    if (packed.lodCount > 0) {
+        mesh.lodCount = std::min(packed.lodCount, MAX_MESH_LODS);
+        std::copy(packed.lods, packed.lods + mesh.lodCount, mesh.lods);
+    } else {
+        mesh.lods[0] = {0, (uint32_t) packed.indexCount, 0.0f};
+        mesh.lodCount = 1;
+    }
+    mesh.format = packed.format;
+    for (int axis = 0; axis < 3; axis++) {
+        mesh.positionScale[axis] = packed.positionScale[axis];
+        mesh.positionOffset[axis] = packed.positionOffset[axis];
+        mesh.boundsMin[axis] = packed.boundsMin[axis];
+        mesh.boundsMax[axis] = packed.boundsMax[axis];
+    }
+
+    if (cpuStorage_) {
+        const auto *vertices = (const unsigned char *) packed.vertexData;
+        const auto *indices = (const unsigned char *) packed.indexData;
+        page.vertexData.resize(page.vertexCount * stride);
+        page.vertexData.insert(page.vertexData.end(), vertices, vertices + vertexBytes);
+        page.indexData.resize(page.indexBytes);
+        page.indexData.insert(page.indexData.end(), indices, indices + indexBytes);
+    } else {
+        // The element buffer can only be reached through its VAO, so bind that rather than the EBO on its own
+        GLStateCache &state = gl_state();
+        state.bindVertexArray(page.vao);
+        state.bindBuffer(GL_ARRAY_BUFFER, page.vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (page.vertexCount * stride), (GLsizeiptr) vertexBytes,
+                        packed.vertexData);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr) page.indexBytes, (GLsizeiptr) indexBytes,
+                        packed.indexData);
+    }
+
+    page.vertexCount += (size_t) packed.vertexCount;
+    page.indexBytes += indexBytes;
+    return mesh;
+}
+
+void GeometryArena::bindPage(int page) const {
+    gl_state().bindVertexArray(pages_[page].vao);
+}
+
+void GeometryArena::draw(const MeshHandle &mesh) const {
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void *) mesh.indexOffset,
+                             mesh.baseVertex);
+}
+
+int select_lod(const MeshHandle &mesh, float pixelsPerUnit, float maxPixelError) {
+    int lod = 0;
+    while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * pixelsPerUnit <= maxPixelError) {
+        lod++;
+    }
+    return lod;
+}
@@ -0,0 +1,121 @@
+#ifndef PROJECT_GEOMETRY_ARENA_H
+#define PROJECT_GEOMETRY_ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+#include "mesh_optimizer.h"
+#include "packed_mesh.h"
+#include "vertex_format.h"
+
+// Where a mesh lives inside the arena. Indices are relative to baseVertex, so every mesh can be drawn from the page
+// VAO with glDrawElementsBaseVertex without rebinding any buffers.
+struct MeshHandle {
+    int page = -1;
+    int baseVertex = 0;
+    int vertexCount = 0;
+    size_t indexOffset = 0; // in bytes, into the page's element buffer
+    int indexCount = 0; // of the full-detail level
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    // Levels of detail, firstIndex counted from indexOffset. lods[0] is the full mesh.
+    MeshLod lods[MAX_MESH_LODS] = {};
+    int lodCount = 0;
+    // Position storage; the shader decodes with position * positionScale + positionOffset
+    VertexFormat format = VERTEX_FLOAT3;
+    float positionScale[3] = {1.0f, 1.0f, 1.0f};
+    float positionOffset[3] = {0.0f, 0.0f, 0.0f};
+    // Object-space bounds of the decoded positions
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+
+    bool valid() const { return page >= 0; }
+};
+
+// Packs static meshes into a few large VBO/EBO pages instead of two buffer objects and a VAO per mesh. Each page
+// owns one VAO with the position layout already set up; meshes are appended with glBufferSubData. A page holds one
+// vertex format, so meshes quantized to different formats end up in different pages.
+//
+// Indices are stored as narrow as the mesh allows. Only the vertex range a mesh's indices actually reference is
+// uploaded, and indices are rebased to the start of that range, so anything spanning at most 65536 vertices gets
+// 16-bit indices. Larger meshes can be split into 16-bit clusters with addMeshClusters(). Meshes that were packed
+// ahead of time (see PackedMesh and MappedMeshFile) skip all of that and are copied in as they are.
+class GeometryArena {
+public:
+    struct Page {
+        unsigned int vao = 0;
+        unsigned int vbo = 0;
+        unsigned int ebo = 0;
+        VertexFormat format = VERTEX_FLOAT3;
+        size_t vertexCapacity = 0; // in vertices
+        size_t indexCapacity = 0;  // in bytes
+        size_t vertexCount = 0;
+        size_t indexBytes = 0;
+        // Page contents, kept only in CPU storage mode
+        std::vector<unsigned char> vertexData;
+        std::vector<unsigned char> indexData;
+    };
+
+    // Page sizes are in vertices and in index bytes. Meshes larger than a page get a page of their own.
+    explicit GeometryArena(size_t verticesPerPage = 1 << 18, size_t indexBytesPerPage = 4 << 20);
+    ~GeometryArena();
+
+    void destroy();
+
+    // Positions are tightly packed xyz floats. Meshes referencing more than 65536 vertices fall back to 32-bit indices.
+    MeshHandle addMesh(const float *positions, int vertexCount, const unsigned int *indices, int indexCount);
+
+    // Splits the mesh into clusters of at most MAX_CLUSTER_VERTICES vertices so every part draws with 16-bit (or
+    // narrower) indices. Vertices shared across a cluster boundary are duplicated. Triangle order is kept.
+    std::vector<MeshHandle> addMeshClusters(const float *positions, int vertexCount, const unsigned int *indices,
+                                            int indexCount);
+
+    // Uploads an already packed mesh straight from its storage, without looking at the data
+    MeshHandle addPackedMesh(const PackedMeshView &mesh);
+
+    // GL_UNSIGNED_BYTE indices are core, but several desktop drivers convert them on the CPU at draw time, so
+    // meshes with at most 256 vertices only use them when asked to
+    void setAllowByteIndices(bool allow) { allowByteIndices_ = allow; }
+
+    // Run meshes through optimize_mesh() (vertex cache, overdraw and vertex fetch order) before uploading them.
+    // The cache statistics of every optimized mesh are kept in optimizeReports().
+    void setOptimizeMeshes(bool optimize) { optimizeMeshes_ = optimize; }
+    const std::vector<MeshOptimizeReport> &optimizeReports() const { return optimizeReports_; }
+
+    // Build this many simplified levels of detail for every mesh added from raw positions (see generate_lods)
+    void setLodLevels(int levels) { lodLevels_ = levels; }
+
+    // Keep pages in CPU memory instead of GL buffers, for the software renderer; no GL call is made. Page VAO names
+    // are then page index + 1, so draw commands still tell pages apart. Set before adding meshes.
+    void setCpuStorage(bool cpuStorage) { cpuStorage_ = cpuStorage; }
+    bool cpuStorage() const { return cpuStorage_; }
+
+    // Store positions in the smallest VertexFormat that keeps every vertex within `maxError` (per axis, in object
+    // units) of its source position. Zero keeps full floats.
+    void setQuantizationError(float maxError) { quantizationError_ = maxError; }
+
+    void bindPage(int page) const;
+    void draw(const MeshHandle &mesh) const;
+
+    const std::vector<Page> &pages() const { return pages_; }
+
+private:
+    PackOptions packOptions() const;
+    int findPage(VertexFormat format, size_t vertexCount, size_t indexBytes);
+    int createPage(VertexFormat format, size_t vertexCapacity, size_t indexCapacity);
+
+    size_t verticesPerPage_;
+    size_t indexBytesPerPage_;
+    bool cpuStorage_ = false;
+    bool allowByteIndices_ = false;
+    bool optimizeMeshes_ = false;
+    float quantizationError_ = 0.0f;
+    int lodLevels_ = 0;
+    std::vector<MeshOptimizeReport> optimizeReports_;
+    std::vector<Page> pages_;
+};
+
+// Coarsest level whose error stays within `maxPixelError` when an object unit covers `pixelsPerUnit` pixels
+int select_lod(const MeshHandle &mesh, float pixelsPerUnit, float maxPixelError);
+
+#endif //PROJECT_GEOMETRY_ARENA_H
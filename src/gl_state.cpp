@@ -0,0 +1,190 @@
+#include "gl_state.h"
+
+static const unsigned int UNKNOWN = ~0u;
+
+static int buffer_slot(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_COPY_READ_BUFFER:
+            return 3;
+        case GL_COPY_WRITE_BUFFER:
+            return 4;
+        case GL_PIXEL_PACK_BUFFER:
+            return 5;
+        case GL_PIXEL_UNPACK_BUFFER:
+            return 6;
+        default:
+            return -1;
+    }
+}
+
+static int texture_slot(GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_3D:
+            return 1;
+        case GL_TEXTURE_CUBE_MAP:
+            return 2;
+        case GL_TEXTURE_2D_ARRAY:
+            return 3;
+        case GL_TEXTURE_BUFFER:
+            return 4;
+        default:
+            return -1;
+    }
+}
+
+GLStateCache::GLStateCache() {
+    invalidate();
+}
+
+bool GLStateCache::changed(unsigned int &shadow, unsigned int value) {
+    bool issue = shadow != value;
+    shadow = value;
+    count(issue);
+    return issue;
+}
+
+void GLStateCache::count(bool issued) {
+    if (issued) {
+        frame_.issued++;
+        total_.issued++;
+    } else {
+        frame_.elided++;
+        total_.elided++;
+    }
+}
+
+void GLStateCache::useProgram(unsigned int program) {
+    if (changed(program_, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLStateCache::bindVertexArray(unsigned int vao) {
+    if (changed(vao_, vao)) {
+        glBindVertexArray(vao);
+        // The element buffer binding is part of the VAO
+        buffers_[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, unsigned int buffer) {
+    int slot = buffer_slot(target);
+    if (slot < 0) {
+        count(true);
+        glBindBuffer(target, buffer);
+    } else if (changed(buffers_[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLStateCache::activeTexture(GLenum unit) {
+    if (changed(activeUnit_, unit - GL_TEXTURE0)) {
+        glActiveTexture(unit);
+    }
+}
+
+void GLStateCache::bindTexture(GLenum target, unsigned int texture) {
+    int slot = texture_slot(target);
+    if (slot < 0 || activeUnit_ >= MAX_TEXTURE_UNITS) {
+        count(true);
+        glBindTexture(target, texture);
+    } else if (changed(textures_[activeUnit_][slot], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLStateCache::setCapability(GLenum capability, bool enabled) {
+    int slot = 0;
+    while (slot < capabilityCount_ && capabilityNames_[slot] != capability) {
+        slot++;
+    }
+    if (slot == capabilityCount_) {
+        if (capabilityCount_ == MAX_CAPABILITIES) {
+            // Out of slots, so just pass it through
+            count(true);
+            enabled ? glEnable(capability) : glDisable(capability);
+            return;
+        }
+        capabilityNames_[slot] = capability;
+        capabilityValues_[slot] = UNKNOWN;
+        capabilityCount_++;
+    }
+
+    if (changed(capabilityValues_[slot], enabled ? 1 : 0)) {
+        enabled ? glEnable(capability) : glDisable(capability);
+    }
+}
+
+void GLStateCache::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLStateCache::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLStateCache::deleteProgram(unsigned int program) {
+    // A deleted program stays in use until something else is bound, so the shadow remains valid
+    glDeleteProgram(program);
+}
+
+void GLStateCache::deleteVertexArray(unsigned int vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (vao_ == vao) {
+        vao_ = 0;
+        buffers_[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void GLStateCache::deleteBuffer(unsigned int buffer) {
+    glDeleteBuffers(1, &buffer);
+    for (unsigned int &bound : buffers_) {
+        if (bound == buffer) {
+            bound = 0;
+        }
+    }
+}
+
+void GLStateCache::deleteTexture(unsigned int texture) {
+    glDeleteTextures(1, &texture);
+    for (auto &unit : textures_) {
+        for (unsigned int &bound : unit) {
+            if (bound == texture) {
+                bound = 0;
+            }
+        }
+    }
+}
+
+void GLStateCache::invalidate() {
+    program_ = UNKNOWN;
+    vao_ = UNKNOWN;
+    for (unsigned int &buffer : buffers_) {
+        buffer = UNKNOWN;
+    }
+    activeUnit_ = UNKNOWN;
+    for (auto &unit : textures_) {
+        for (unsigned int &texture : unit) {
+            texture = UNKNOWN;
+        }
+    }
+    capabilityCount_ = 0;
+}
+
+void GLStateCache::beginFrame() {
+    lastFrame_ = frame_;
+    frame_ = Counters();
+}
+
+GLStateCache &gl_state() {
+    static thread_local GLStateCache cache;
+    return cache;
+}
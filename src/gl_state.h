@@ -0,0 +1,72 @@
+#ifndef PROJECT_GL_STATE_H
+#define PROJECT_GL_STATE_H
+
+#include <glad/glad.h>
+
+// Shadows the bound program, VAO, buffers, textures and capability toggles of the current context and skips GL calls
+// that would not change anything. Every shadowed value starts out unknown, so the first call always reaches the
+// driver; invalidate() gets back to that point after code that talks to GL directly.
+//
+// GL state belongs to the context and a context is current on one thread at a time, so there is one cache per thread
+// (see gl_state()). A thread that takes over a context another thread has used must call invalidate() before relying
+// on its cache. Deleting an object that is bound resets the binding to 0 in GL, so deletes go through the cache too.
+class GLStateCache {
+public:
+    struct Counters {
+        unsigned int issued = 0;
+        unsigned int elided = 0;
+    };
+
+    GLStateCache();
+
+    void useProgram(unsigned int program);
+    void bindVertexArray(unsigned int vao);
+    void bindBuffer(GLenum target, unsigned int buffer);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, unsigned int texture);
+    void enable(GLenum capability);
+    void disable(GLenum capability);
+
+    void deleteProgram(unsigned int program);
+    void deleteVertexArray(unsigned int vao);
+    void deleteBuffer(unsigned int buffer);
+    void deleteTexture(unsigned int texture);
+
+    // Forget everything, e.g. after handing the context to other code
+    void invalidate();
+
+    // Moves the running counters into lastFrame() and starts counting again
+    void beginFrame();
+    const Counters &lastFrame() const { return lastFrame_; }
+    const Counters &thisFrame() const { return frame_; }
+    const Counters &total() const { return total_; }
+
+private:
+    static const int MAX_TEXTURE_UNITS = 16;
+    static const int TEXTURE_TARGETS = 5;
+    static const int BUFFER_TARGETS = 7;
+    static const int MAX_CAPABILITIES = 16;
+
+    bool changed(unsigned int &shadow, unsigned int value);
+    void count(bool issued);
+    void setCapability(GLenum capability, bool enabled);
+
+    unsigned int program_;
+    unsigned int vao_;
+    unsigned int buffers_[BUFFER_TARGETS];
+    unsigned int activeUnit_;
+    unsigned int textures_[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+
+    GLenum capabilityNames_[MAX_CAPABILITIES];
+    unsigned int capabilityValues_[MAX_CAPABILITIES];
+    int capabilityCount_;
+
+    Counters frame_;
+    Counters lastFrame_;
+    Counters total_;
+};
+
+// The cache for the context current on the calling thread
+GLStateCache &gl_state();
+
+#endif //PROJECT_GL_STATE_H
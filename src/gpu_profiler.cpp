@@ -0,0 +1,144 @@
+#include "gpu_profiler.h"
+
+#include <iostream>
+
+GpuProfiler::~GpuProfiler() {
+    destroy();
+}
+
+bool GpuProfiler::init() {
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if (glGetError() != GL_NO_ERROR || bits == 0) {
+        std::cout << "ERROR::GPU_PROFILER::NO_TIMER_QUERIES" << std::endl;
+        return false;
+    }
+    available_ = true;
+    return true;
+}
+
+void GpuProfiler::destroy() {
+    for (Frame &frame : frames_) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+        }
+        frame = Frame();
+    }
+    available_ = false;
+    measuring_ = false;
+}
+
+void GpuProfiler::timestamp(Frame &frame, size_t &index) {
+    if (frame.usedQueries == frame.queries.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    index = frame.usedQueries++;
+    glQueryCounter(frame.queries[index], GL_TIMESTAMP);
+}
+
+bool GpuProfiler::collect(Frame &frame, bool wait) {
+    if (!frame.pending) {
+        return true;
+    }
+    if (!wait) {
+        // Checked for every query rather than the last one, the spec does not promise they complete in order
+        for (size_t i = 0; i < frame.usedQueries; i++) {
+            GLuint ready = 0;
+            glGetQueryObjectuiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (!ready) {
+                return false;
+            }
+        }
+    }
+
+    for (const Record &record : frame.records) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[record.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[record.endQuery], GL_QUERY_RESULT, &end);
+        double gpuMs = end > begin ? (double) (end - begin) * 1e-6 : 0.0;
+
+        ScopeTotals *totals = nullptr;
+        for (ScopeTotals &scope : totals_) {
+            if (scope.name == record.name && scope.depth == record.depth) {
+                totals = &scope;
+                break;
+            }
+        }
+        if (totals == nullptr) {
+            totals_.push_back({record.name, record.depth, 0.0, 0.0});
+            totals = &totals_.back();
+        }
+        totals->gpuMs += gpuMs;
+        totals->cpuMs += record.cpuMs;
+    }
+    frame.pending = false;
+    stats_.framesMeasured++;
+    return true;
+}
+
+void GpuProfiler::beginFrame() {
+    if (!available_) {
+        return;
+    }
+    // Oldest first, so the totals list scopes in a stable order
+    for (int i = 1; i <= FRAME_LATENCY; i++) {
+        collect(frames_[(current_ + i) % FRAME_LATENCY], false);
+    }
+    current_ = (current_ + 1) % FRAME_LATENCY;
+    Frame &frame = frames_[current_];
+    measuring_ = !frame.pending;
+    if (!measuring_) {
+        stats_.framesSkipped++;
+        return;
+    }
+    frame.usedQueries = 0;
+    frame.records.clear();
+    depth_ = 0;
+}
+
+void GpuProfiler::endFrame() {
+    if (measuring_) {
+        Frame &frame = frames_[current_];
+        frame.pending = !frame.records.empty();
+    }
+    measuring_ = false;
+}
+
+int GpuProfiler::beginScope(const char *name) {
+    if (!measuring_) {
+        return -1;
+    }
+    Frame &frame = frames_[current_];
+    Record record;
+    record.name = name;
+    record.depth = depth_++;
+    record.endQuery = 0;
+    record.cpuBegin = std::chrono::steady_clock::now();
+    record.cpuMs = 0.0;
+    timestamp(frame, record.beginQuery);
+    frame.records.push_back(record);
+    return (int) frame.records.size() - 1;
+}
+
+void GpuProfiler::endScope(int scope) {
+    if (!measuring_ || scope < 0) {
+        return;
+    }
+    Frame &frame = frames_[current_];
+    Record &record = frame.records[scope];
+    timestamp(frame, record.endQuery);
+    record.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record.cpuBegin)
+            .count();
+    depth_--;
+}
+
+void GpuProfiler::flush() {
+    if (!available_) {
+        return;
+    }
+    for (int i = 1; i <= FRAME_LATENCY; i++) {
+        collect(frames_[(current_ + i) % FRAME_LATENCY], true);
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef PROJECT_GPU_PROFILER_H
+#define PROJECT_GPU_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+// Measures how long the GPU spends in named scopes. Every scope is bracketed by two GL_TIMESTAMP queries, which,
+// unlike GL_TIME_ELAPSED, may nest; the CPU time spent issuing its commands is taken alongside. Queries come from a
+// pool per frame and are read FRAME_LATENCY frames later, once the GPU is long done with them, so profiling never
+// stalls the pipeline. If the GPU falls further behind than that, frames go unmeasured rather than waited for.
+//
+// Times are summed per scope, identified by name and nesting depth, over all measured frames. Names must outlive
+// the profiler, e.g. string literals.
+class GpuProfiler {
+public:
+    static const int FRAME_LATENCY = 4;
+
+    struct ScopeTotals {
+        const char *name;
+        int depth;
+        double gpuMs;
+        double cpuMs;
+    };
+
+    struct Stats {
+        unsigned long framesMeasured = 0;
+        unsigned long framesSkipped = 0;
+    };
+
+    ~GpuProfiler();
+
+    // Returns false if the context has no timer queries
+    bool init();
+    void destroy();
+
+    // Collects the results that are ready and starts recording a frame
+    void beginFrame();
+    void endFrame();
+
+    // Returns the handle for endScope(), or -1 when this frame is not measured
+    int beginScope(const char *name);
+    void endScope(int scope);
+
+    // Waits for and collects every frame still in flight; for the end of a run
+    void flush();
+
+    // Scopes in the order they were first seen, so children follow their parent
+    const std::vector<ScopeTotals> &totals() const { return totals_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Record {
+        const char *name;
+        int depth;
+        size_t beginQuery;
+        size_t endQuery;
+        std::chrono::steady_clock::time_point cpuBegin;
+        double cpuMs;
+    };
+
+    struct Frame {
+        std::vector<GLuint> queries;
+        size_t usedQueries = 0;
+        std::vector<Record> records;
+        // Recorded and not collected yet
+        bool pending = false;
+    };
+
+    // Issues a timestamp query from the frame's pool and returns its index
+    void timestamp(Frame &frame, size_t &index);
+    bool collect(Frame &frame, bool wait);
+
+    bool available_ = false;
+    Frame frames_[FRAME_LATENCY];
+    int current_ = 0;
+    bool measuring_ = false;
+    int depth_ = 0;
+    std::vector<ScopeTotals> totals_;
+    Stats stats_;
+};
+
+// Times the enclosing block; does nothing without a profiler
+class GpuScope {
+public:
+    GpuScope(GpuProfiler *profiler, const char *name)
+            : profiler_(profiler), scope_(profiler != nullptr ? profiler->beginScope(name) : -1) {}
+    ~GpuScope() {
+        if (profiler_ != nullptr) {
+            profiler_->endScope(scope_);
+        }
+    }
+
+    GpuScope(const GpuScope &) = delete;
+    GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+    GpuProfiler *profiler_;
+    int scope_;
+};
+
+#endif //PROJECT_GPU_PROFILER_H
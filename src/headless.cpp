@@ -0,0 +1,191 @@
+#include "headless.h"
+
+#include <iostream>
+#include <string>
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static const EGLint CONTEXT_ATTRIBS[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+};
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+static EGLDisplay open_display() {
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+        return display;
+    }
+
+    // No display server: ask Mesa for a surfaceless platform display instead
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay == nullptr) {
+        return EGL_NO_DISPLAY;
+    }
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+        return display;
+    }
+    return EGL_NO_DISPLAY;
+}
+
+bool HeadlessContext::create(int width, int height) {
+    width_ = width;
+    height_ = height;
+
+    EGLDisplay display = open_display();
+    if (display == EGL_NO_DISPLAY) {
+        std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+        return false;
+    }
+    display_ = display;
+    ownsDisplay_ = true;
+
+    const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        std::cout << "ERROR::HEADLESS::NO_EGL_CONFIG" << std::endl;
+        return false;
+    }
+    config_ = config;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "ERROR::HEADLESS::OPENGL_API_UNAVAILABLE" << std::endl;
+        return false;
+    }
+
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, CONTEXT_ATTRIBS);
+    if (context == EGL_NO_CONTEXT) {
+        std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED " << std::hex << eglGetError() << std::dec
+                  << std::endl;
+        return false;
+    }
+    context_ = context;
+
+    // We never present, so a surfaceless context is enough. Drivers without it get a tiny pbuffer.
+    EGLSurface surface = EGL_NO_SURFACE;
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == nullptr || std::string(extensions).find("EGL_KHR_surfaceless_context") == std::string::npos) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+        surface_ = surface;
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        std::cout << "ERROR::HEADLESS::MAKE_CURRENT_FAILED" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::createShared(const HeadlessContext &share) {
+    if (share.context_ == nullptr) {
+        return false;
+    }
+    display_ = share.display_;
+    config_ = share.config_;
+    ownsDisplay_ = false;
+    // The API binding is per thread
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext context = eglCreateContext(display_, config_, share.context_, CONTEXT_ATTRIBS);
+    if (context == EGL_NO_CONTEXT) {
+        std::cout << "ERROR::HEADLESS::SHARED_CONTEXT_CREATION_FAILED " << std::hex << eglGetError() << std::dec
+                  << std::endl;
+        return false;
+    }
+    context_ = context;
+
+    // Same choice of surface as the context we share with
+    if (share.surface_ != nullptr) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface_ = eglCreatePbufferSurface(display_, config_, pbufferAttribs);
+    }
+    return true;
+}
+
+void HeadlessContext::destroy() {
+    if (display_ == nullptr) {
+        return;
+    }
+    if (!ownsDisplay_) {
+        // Released by the thread that used it; the display stays with the context we share with
+        if (surface_ != nullptr) {
+            eglDestroySurface(display_, surface_);
+        }
+        if (context_ != nullptr) {
+            eglDestroyContext(display_, context_);
+        }
+        display_ = config_ = context_ = surface_ = nullptr;
+        return;
+    }
+    if (fbo_ != 0) {
+        glDeleteFramebuffers(1, &fbo_);
+        glDeleteRenderbuffers(1, &colorBuffer_);
+        glDeleteRenderbuffers(1, &depthBuffer_);
+        fbo_ = colorBuffer_ = depthBuffer_ = 0;
+    }
+
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface_ != nullptr) {
+        eglDestroySurface(display_, surface_);
+    }
+    if (context_ != nullptr) {
+        eglDestroyContext(display_, context_);
+    }
+    eglTerminate(display_);
+    display_ = config_ = context_ = surface_ = nullptr;
+    ownsDisplay_ = false;
+}
+
+bool HeadlessContext::makeCurrent() const {
+    return eglMakeCurrent(display_, surface_ != nullptr ? surface_ : EGL_NO_SURFACE,
+                          surface_ != nullptr ? surface_ : EGL_NO_SURFACE, context_) == EGL_TRUE;
+}
+
+void HeadlessContext::releaseCurrent() const {
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+bool HeadlessContext::createFramebuffer() {
+    glGenRenderbuffers(1, &colorBuffer_);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+
+    glGenRenderbuffers(1, &depthBuffer_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer_);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::bindFramebuffer() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+}
+
+void *HeadlessContext::getProcAddress(const char *name) {
+    return (void *) eglGetProcAddress(name);
+}
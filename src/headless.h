@@ -0,0 +1,47 @@
+#ifndef PROJECT_HEADLESS_H
+#define PROJECT_HEADLESS_H
+
+// Window-less GL 3.3 core context backed by EGL. Works on GPU-less hosts through Mesa's llvmpipe: if the default
+// EGL display cannot be initialised (no X/Wayland server) we fall back to the surfaceless Mesa platform.
+// Rendering goes to an offscreen framebuffer object instead of a default framebuffer.
+class HeadlessContext {
+public:
+    ~HeadlessContext();
+
+    // Creates the EGL display/context and makes it current on the calling thread
+    bool create(int width, int height);
+    // Creates a second context on the display of `share` that shares its objects, e.g. for a thread that builds
+    // shaders. It has no framebuffer and is not made current.
+    bool createShared(const HeadlessContext &share);
+    void destroy();
+
+    // Hand the context over to another thread: release it on the old thread, then make it current on the new one
+    bool makeCurrent() const;
+    void releaseCurrent() const;
+
+    // Must be called after GLAD is loaded, since it creates GL objects
+    bool createFramebuffer();
+    void bindFramebuffer() const;
+
+    // GLAD loader. EGL_KHR_get_all_proc_addresses lets this return core entry points too.
+    static void *getProcAddress(const char *name);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    unsigned int framebuffer() const { return fbo_; }
+
+private:
+    void *display_ = nullptr;
+    void *config_ = nullptr;
+    void *context_ = nullptr;
+    void *surface_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    unsigned int fbo_ = 0;
+    unsigned int colorBuffer_ = 0;
+    unsigned int depthBuffer_ = 0;
+    // Shared contexts leave the display to the context they share with
+    bool ownsDisplay_ = false;
+};
+
+#endif //PROJECT_HEADLESS_H
@@ -0,0 +1,184 @@
+#include "image_diff.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IMAGE_DIFF_X86 1
+#include <emmintrin.h>
+#endif
+
+void Image::resize(int newWidth, int newHeight) {
+    width = std::max(newWidth, 0);
+    height = std::max(newHeight, 0);
+    pixels.assign((size_t) width * height * 4, 0);
+}
+
+bool write_ppm(const char *path, const Image &image) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::IMAGE::CANNOT_CREATE " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    // PPM rows run top to bottom
+    std::vector<unsigned char> row((size_t) image.width * 3);
+    for (int y = image.height - 1; y >= 0; y--) {
+        const unsigned char *source = image.pixels.data() + (size_t) y * image.width * 4;
+        for (int x = 0; x < image.width; x++) {
+            row[x * 3] = source[x * 4];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        file.write((const char *) row.data(), (std::streamsize) row.size());
+    }
+    if (!file) {
+        std::cout << "ERROR::IMAGE::WRITE_FAILED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Next header number, skipping whitespace and # comments
+static bool read_ppm_number(std::istream &file, int &value) {
+    int c = file.get();
+    while (c == '#' || std::isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = file.get();
+            }
+        }
+        c = file.get();
+    }
+    if (c < '0' || c > '9') {
+        return false;
+    }
+    value = 0;
+    while (c >= '0' && c <= '9' && value < (1 << 20)) {
+        value = value * 10 + (c - '0');
+        c = file.get();
+    }
+    // Exactly one whitespace character separates the header from the pixels
+    return std::isspace(c) != 0;
+}
+
+bool read_ppm(const char *path, Image &image) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::IMAGE::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+    char magic[2] = {};
+    file.read(magic, 2);
+    int width, height, maxValue;
+    if (magic[0] != 'P' || magic[1] != '6' || !read_ppm_number(file, width) || !read_ppm_number(file, height) ||
+        !read_ppm_number(file, maxValue) || maxValue != 255 || width <= 0 || height <= 0) {
+        std::cout << "ERROR::IMAGE::NOT_A_PPM " << path << std::endl;
+        return false;
+    }
+
+    image.resize(width, height);
+    std::vector<unsigned char> row((size_t) width * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        if (!file.read((char *) row.data(), (std::streamsize) row.size())) {
+            std::cout << "ERROR::IMAGE::TRUNCATED " << path << std::endl;
+            return false;
+        }
+        unsigned char *target = image.pixels.data() + (size_t) y * width * 4;
+        for (int x = 0; x < width; x++) {
+            target[x * 4] = row[x * 3];
+            target[x * 4 + 1] = row[x * 3 + 1];
+            target[x * 4 + 2] = row[x * 3 + 2];
+            target[x * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+// Fills in `result` and writes the per-pixel difference (largest color channel difference) of `count` pixels.
+// Alpha is left out: PPM does not keep it, so a golden image always reads back opaque.
+static void diff_pixels(const unsigned char *a, const unsigned char *b, size_t count, int tolerance,
+                        unsigned char *differences, ImageDiff &result) {
+    uint64_t sum = 0;
+    size_t differing = 0;
+    int maxDifference = 0;
+    size_t i = 0;
+#ifdef IMAGE_DIFF_X86
+    // Four pixels per step: |a - b| per byte from two saturating subtractions, alpha masked off, then the max of
+    // each pixel's bytes ends up in the low byte of its lane
+    const __m128i low = _mm_set1_epi32(0xFF);
+    const __m128i color = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i limit = _mm_set1_epi32(tolerance);
+    __m128i sums = _mm_setzero_si128();
+    __m128i maxima = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i * 4));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i * 4));
+        __m128i d = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x)), color);
+        d = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+        d = _mm_max_epu8(d, _mm_srli_epi32(d, 16));
+        d = _mm_and_si128(d, low);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(d, _mm_setzero_si128()));
+        maxima = _mm_max_epu8(maxima, d);
+        int over = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(d, limit)));
+        differing += (size_t) ((over & 1) + ((over >> 1) & 1) + ((over >> 2) & 1) + ((over >> 3) & 1));
+        int four = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(d, d), d));
+        differences[i] = (unsigned char) four;
+        differences[i + 1] = (unsigned char) (four >> 8);
+        differences[i + 2] = (unsigned char) (four >> 16);
+        differences[i + 3] = (unsigned char) (four >> 24);
+    }
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i *) halves, sums);
+    sum = halves[0] + halves[1];
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *) lanes, maxima);
+    maxDifference = (int) std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        int difference = 0;
+        for (int channel = 0; channel < 3; channel++) {
+            difference = std::max(difference, std::abs((int) a[i * 4 + channel] - (int) b[i * 4 + channel]));
+        }
+        differences[i] = (unsigned char) difference;
+        sum += (uint64_t) difference;
+        maxDifference = std::max(maxDifference, difference);
+        differing += difference > tolerance ? 1 : 0;
+    }
+    result.differing = differing;
+    result.maxDifference = maxDifference;
+    result.meanDifference = count > 0 ? (double) sum / (double) count : 0.0;
+}
+
+bool diff_images(const Image &actual, const Image &golden, int tolerance, ImageDiff &result, Image *heatmap) {
+    result = ImageDiff();
+    if (actual.width != golden.width || actual.height != golden.height) {
+        return false;
+    }
+    size_t count = (size_t) actual.width * actual.height;
+    std::vector<unsigned char> differences(count);
+    diff_pixels(actual.pixels.data(), golden.pixels.data(), count, tolerance, differences.data(), result);
+
+    if (heatmap != nullptr) {
+        heatmap->resize(golden.width, golden.height);
+        for (size_t i = 0; i < count; i++) {
+            unsigned char *target = heatmap->pixels.data() + i * 4;
+            const unsigned char *source = golden.pixels.data() + i * 4;
+            if (differences[i] > tolerance) {
+                target[0] = 255;
+                target[1] = differences[i];
+                target[2] = 0;
+            } else {
+                int gray = (source[0] + source[1] + source[2]) / 12;
+                target[0] = target[1] = target[2] = (unsigned char) gray;
+            }
+            target[3] = 255;
+        }
+    }
+    return true;
+}
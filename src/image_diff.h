@@ -0,0 +1,35 @@
+#ifndef PROJECT_IMAGE_DIFF_H
+#define PROJECT_IMAGE_DIFF_H
+
+#include <cstddef>
+#include <vector>
+
+// RGBA8 pixels with the first row at the bottom, as glReadPixels returns them
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+
+    void resize(int newWidth, int newHeight);
+};
+
+// Binary PPM (P6), the simplest format every image viewer opens. Alpha is dropped on write and read back as 255.
+// Both return false (printing why) on failure.
+bool write_ppm(const char *path, const Image &image);
+bool read_ppm(const char *path, Image &image);
+
+struct ImageDiff {
+    // Pixels with a color channel more than the tolerance apart
+    size_t differing = 0;
+    // Largest and mean per-pixel difference, the per-pixel difference being that of its most different channel
+    int maxDifference = 0;
+    double meanDifference = 0.0;
+};
+
+// Compares the color channels of two images of the same size pixel by pixel; alpha is ignored, as PPM drops it.
+// When `heatmap` is given it gets the golden image dimmed to a quarter, with pixels beyond the tolerance drawn from red
+// (just beyond) to yellow (255 apart). Returns false if the sizes differ.
+bool diff_images(const Image &actual, const Image &golden, int tolerance, ImageDiff &result,
+                 Image *heatmap = nullptr);
+
+#endif //PROJECT_IMAGE_DIFF_H
@@ -0,0 +1,219 @@
+#include "instancing.h"
+
+#include <cmath>
+#include <cstddef>
+#include <glad/glad.h>
+
+#include "cpu_profiler.h"
+#include "culling.h"
+#include "gl_state.h"
+#include "job_system.h"
+#include "shader.h"
+
+// Instances animated per job
+static const size_t ANIMATE_GRAIN = 4096;
+
+static const char *instancedVertexSource = "#version 330 core\n"
+                                           "layout (location = 0) in vec3 aPos;\n"
+                                           "layout (location = 1) in vec2 aOffset;\n"
+                                           "layout (location = 2) in vec2 aScale;\n"
+                                           "layout (location = 3) in vec4 aColor;\n"
+                                           "uniform mat4 uViewProjection;\n"
+                                           "out vec4 vColor;\n"
+                                           "void main()\n"
+                                           "{\n"
+                                           "   vColor = aColor;\n"
+                                           "   vec2 position = aPos.xy * aScale + aOffset;\n"
+                                           "   gl_Position = uViewProjection * vec4(position, aPos.z, 1.0);\n"
+                                           "}\0";
+
+static const char *instancedFragSource = "#version 330 core\n"
+                                         "in vec4 vColor;\n"
+                                         "out vec4 FragColor;\n"
+                                         "\n"
+                                         "void main()\n"
+                                         "{\n"
+                                         "    FragColor = vColor;\n"
+                                         "}\0";
+
+InstancedQuads::~InstancedQuads() {
+    destroy();
+}
+
+void InstancedQuads::requestProgram(ShaderBuilder &builder) {
+    builder_ = &builder;
+    programTicket_ = builder.submit(instancedVertexSource, instancedFragSource);
+}
+
+bool InstancedQuads::init() {
+    if (builder_ != nullptr) {
+        program_ = builder_->finish(programTicket_);
+        builder_ = nullptr;
+    } else {
+        program_ = build_program(instancedVertexSource, instancedFragSource);
+    }
+    if (program_ == 0) {
+        return false;
+    }
+    // Identity until a draw queue sets the camera, so draw() keeps working on its own
+    const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    gl_state().useProgram(program_);
+    glUniformMatrix4fv(glGetUniformLocation(program_, "uViewProjection"), 1, GL_FALSE, identity);
+
+    // Unit quad centered on the origin, scaled and moved per instance
+    float vertices[] = {
+            0.5f, 0.5f, 0.0f,  // top right
+            0.5f, -0.5f, 0.0f,  // bottom right
+            -0.5f, -0.5f, 0.0f,  // bottom left
+            -0.5f, 0.5f, 0.0f   // top left
+    };
+    unsigned int indices[] = {
+            0, 1, 3,
+            1, 2, 3
+    };
+
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &quadVbo_);
+    glGenBuffers(1, &quadEbo_);
+
+    GLStateCache &state = gl_state();
+    state.bindVertexArray(vao_);
+
+    state.bindBuffer(GL_ARRAY_BUFFER, quadVbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+    glEnableVertexAttribArray(0);
+
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEbo_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // Pointers for the instance attributes are set in setInstances, once we know where the data landed
+    for (unsigned int attribute = 1; attribute <= 3; attribute++) {
+        glVertexAttribDivisor(attribute, 1);
+    }
+    return true;
+}
+
+void InstancedQuads::destroy() {
+    if (vao_ == 0) {
+        return;
+    }
+    GLStateCache &state = gl_state();
+    state.deleteVertexArray(vao_);
+    state.deleteBuffer(quadVbo_);
+    state.deleteBuffer(quadEbo_);
+    state.deleteProgram(program_);
+    vao_ = quadVbo_ = quadEbo_ = program_ = 0;
+    instanceCount_ = 0;
+}
+
+bool InstancedQuads::setInstances(StreamBuffer &stream, const std::vector<QuadInstance> &instances) {
+    instanceCount_ = 0;
+    if (instances.empty()) {
+        return true;
+    }
+    long long offset = stream.write(instances.data(), instances.size() * sizeof(QuadInstance), 16);
+    if (offset < 0) {
+        return false;
+    }
+
+    GLStateCache &state = gl_state();
+    state.bindVertexArray(vao_);
+    state.bindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+    const char *base = (const char *) (size_t) offset;
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), base + offsetof(QuadInstance, offset));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), base + offsetof(QuadInstance, scale));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), base + offsetof(QuadInstance, color));
+    for (unsigned int attribute = 1; attribute <= 3; attribute++) {
+        glEnableVertexAttribArray(attribute);
+    }
+    instanceCount_ = (int) instances.size();
+    return true;
+}
+
+void InstancedQuads::draw() const {
+    if (instanceCount_ == 0) {
+        return;
+    }
+    GLStateCache &state = gl_state();
+    state.useProgram(program_);
+    state.bindVertexArray(vao_);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, instanceCount_);
+}
+
+DrawCommand InstancedQuads::drawCommand() const {
+    DrawCommand command;
+    command.program = program_;
+    command.vao = vao_;
+    command.count = 6;
+    command.instanceCount = instanceCount_;
+    return command;
+}
+
+std::vector<QuadInstance> make_quad_grid(int count) {
+    std::vector<QuadInstance> instances;
+    if (count <= 0) {
+        return instances;
+    }
+    instances.reserve(count);
+
+    int columns = (int) std::ceil(std::sqrt((double) count));
+    int rows = (count + columns - 1) / columns;
+    float cellWidth = 2.0f / (float) columns;
+    float cellHeight = 2.0f / (float) rows;
+
+    for (int i = 0; i < count; i++) {
+        int column = i % columns;
+        int row = i / columns;
+        QuadInstance instance{};
+        instance.offset[0] = -1.0f + cellWidth * ((float) column + 0.5f);
+        instance.offset[1] = -1.0f + cellHeight * ((float) row + 0.5f);
+        // Leave a small gap between neighbours so individual rectangles stay visible
+        instance.scale[0] = cellWidth * 0.8f;
+        instance.scale[1] = cellHeight * 0.8f;
+        instance.color[0] = (float) column / (float) columns;
+        instance.color[1] = (float) row / (float) rows;
+        instance.color[2] = 0.5f;
+        instance.color[3] = 1.0f;
+        instances.push_back(instance);
+    }
+    return instances;
+}
+
+void animate_quad_grid(const std::vector<QuadInstance> &base, double time, std::vector<QuadInstance> &out,
+                       JobSystem *jobs) {
+    PROFILE_ZONE("animate instances");
+    out.resize(base.size());
+    auto animate = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            QuadInstance instance = base[i];
+            instance.offset[1] += 0.02f * (float) std::sin(time * 3.0 + instance.offset[0] * 4.0);
+            out[i] = instance;
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(base.size(), ANIMATE_GRAIN, animate);
+    } else {
+        animate(0, base.size());
+    }
+}
+
+void quad_instance_bounds(const std::vector<QuadInstance> &instances, BoundsSoA &bounds, JobSystem *jobs) {
+    PROFILE_ZONE("instance bounds");
+    bounds.resize(instances.size());
+    auto compute = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const QuadInstance &instance = instances[i];
+            float halfWidth = std::fabs(instance.scale[0]) * 0.5f;
+            float halfHeight = std::fabs(instance.scale[1]) * 0.5f;
+            float minimum[3] = {instance.offset[0] - halfWidth, instance.offset[1] - halfHeight, 0.0f};
+            float maximum[3] = {instance.offset[0] + halfWidth, instance.offset[1] + halfHeight, 0.0f};
+            bounds.set(i, minimum, maximum);
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(instances.size(), ANIMATE_GRAIN, compute);
+    } else {
+        compute(0, instances.size());
+    }
+}
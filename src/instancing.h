@@ -0,0 +1,62 @@
+#ifndef PROJECT_INSTANCING_H
+#define PROJECT_INSTANCING_H
+
+#include <vector>
+
+#include "draw_queue.h"
+#include "shader_builder.h"
+#include "stream_buffer.h"
+
+// Per-instance data, streamed through attributes 1-3 with a divisor of 1
+struct QuadInstance {
+    float offset[2];
+    float scale[2];
+    float color[4];
+};
+
+// Draws any number of axis-aligned rectangles with a single glDrawElementsInstanced call. All rectangles share one
+// unit quad; position, size and color come from instance data streamed through a StreamBuffer.
+class InstancedQuads {
+public:
+    ~InstancedQuads();
+
+    // Starts building the program on `builder`, so it compiles while the caller does other work; init() collects it
+    void requestProgram(ShaderBuilder &builder);
+    bool init();
+    void destroy();
+
+    // Writes the instance data into the stream buffer and points the instance attributes at it
+    bool setInstances(StreamBuffer &stream, const std::vector<QuadInstance> &instances);
+    void draw() const;
+    // Same draw as draw(), for submission through a DrawQueue
+    DrawCommand drawCommand() const;
+
+    unsigned int program() const { return program_; }
+    unsigned int vao() const { return vao_; }
+    int instanceCount() const { return instanceCount_; }
+
+private:
+    ShaderBuilder *builder_ = nullptr;
+    ShaderBuilder::Ticket programTicket_ = 0;
+    unsigned int program_ = 0;
+    unsigned int vao_ = 0;
+    unsigned int quadVbo_ = 0;
+    unsigned int quadEbo_ = 0;
+    int instanceCount_ = 0;
+};
+
+class BoundsSoA;
+class JobSystem;
+
+// Lays out `count` rectangles in a square grid covering clip space, with deterministic colors
+std::vector<QuadInstance> make_quad_grid(int count);
+
+// Writes `base` into `out` with a travelling wave applied to the offsets, for a bit of per-frame motion. Spread over
+// the job system's threads when one is given.
+void animate_quad_grid(const std::vector<QuadInstance> &base, double time, std::vector<QuadInstance> &out,
+                       JobSystem *jobs = nullptr);
+
+// Writes the bounds of every rectangle (the unit quad scaled and moved, at z = 0) into `bounds`
+void quad_instance_bounds(const std::vector<QuadInstance> &instances, BoundsSoA &bounds, JobSystem *jobs = nullptr);
+
+#endif //PROJECT_INSTANCING_H
@@ -0,0 +1,114 @@
+// Micro-benchmark for the job system: spawn cost, steal cost and parallel-for scaling
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "job_system.h"
+
+// Jobs spawned per batch under one parent; well below JobSystem::JOBS_PER_THREAD
+#define BATCH_SIZE 1024
+#define REPEATS 10
+
+static double now_ms() {
+    return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void empty_job(Job *, void *) {
+}
+
+// Creates, runs and waits for `batches` batches of empty jobs. Returns nanoseconds per job.
+static double spawn_batches(JobSystem &jobs, int batches) {
+    double start = now_ms();
+    for (int batch = 0; batch < batches; batch++) {
+        Job *root = jobs.create(&empty_job);
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            jobs.run(jobs.create(&empty_job, root));
+        }
+        jobs.run(root);
+        jobs.wait(root);
+    }
+    return (now_ms() - start) * 1e6 / ((double) batches * (BATCH_SIZE + 1));
+}
+
+// A few dependent flops per item, enough that the loop is not bound by memory bandwidth alone
+static void parallel_for_body(const float *input, float *output, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        float x = input[i];
+        for (int k = 0; k < 8; k++) {
+            x = x * 0.999f + std::sqrt(x + 1.0f);
+        }
+        output[i] = x;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t items = 1000000;
+    size_t grain = 4096;
+    int maxThreads = (int) std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--items") == 0 && i + 1 < argc) {
+            items = (size_t) std::atol(argv[++i]);
+        } else if (std::strcmp(argv[i], "--grain") == 0 && i + 1 < argc) {
+            grain = (size_t) std::atol(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            maxThreads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--items N] [--grain N] [--threads N]" << std::endl;
+            return -1;
+        }
+    }
+
+    // Spawn overhead: everything runs on the spawning thread, nothing is stolen
+    {
+        JobSystem jobs;
+        jobs.init(0);
+        spawn_batches(jobs, 16);
+        std::cout << "Spawn + run + wait, 1 thread: " << spawn_batches(jobs, 256) << " ns/job" << std::endl;
+    }
+
+    // Steal overhead: one thread spawns, the others can only get work by stealing it
+    if (maxThreads > 1) {
+        JobSystem jobs;
+        jobs.init(maxThreads - 1);
+        spawn_batches(jobs, 16);
+        JobSystem::Stats before = jobs.stats();
+        double nsPerJob = spawn_batches(jobs, 256);
+        JobSystem::Stats after = jobs.stats();
+        std::cout << "Spawn + run + wait, " << maxThreads << " threads: " << nsPerJob << " ns/job, "
+                  << after.stolen - before.stolen << " of " << after.executed - before.executed << " jobs stolen"
+                  << std::endl;
+    }
+
+    // Parallel-for scaling
+    std::vector<float> input(items), output(items);
+    for (size_t i = 0; i < items; i++) {
+        input[i] = (float) (i % 1000) * 0.001f;
+    }
+    double singleThreadMs = 0.0;
+    std::cout << "Parallel for over " << items << " items, grain " << grain << ":" << std::endl;
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads)
+                                                                                 : threads + 1) {
+        JobSystem jobs;
+        jobs.init(threads - 1);
+        double best = 1e30;
+        for (int repeat = 0; repeat < REPEATS; repeat++) {
+            double start = now_ms();
+            jobs.parallelFor(items, grain, [&](size_t begin, size_t end) {
+                parallel_for_body(input.data(), output.data(), begin, end);
+            });
+            best = std::min(best, now_ms() - start);
+        }
+        if (threads == 1) {
+            singleThreadMs = best;
+        }
+        double speedup = singleThreadMs / best;
+        std::cout << "  " << jobs.threadCount() << " threads: " << best << " ms, speedup " << speedup
+                  << ", efficiency " << speedup / threads * 100.0 << "%" << std::endl;
+    }
+    return 0;
+}
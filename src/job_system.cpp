@@ -0,0 +1,292 @@
+#include "job_system.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "cpu_profiler.h"
+
+// Spin (yielding) this many times without finding work before an idle worker goes to sleep
+static const int IDLE_SPINS = 64;
+
+// Which slot of which job system the current thread owns
+struct CurrentThread {
+    const JobSystem *system = nullptr;
+    int index = -1;
+};
+
+static thread_local CurrentThread current_thread;
+
+bool WorkStealingQueue::push(Job *job) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+        return false;
+    }
+    jobs_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    bottom_.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+Job *WorkStealingQueue::pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        // Empty
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = jobs_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last item: race the thieves for it
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *WorkStealingQueue::steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+    Job *job = jobs_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+JobSystem::~JobSystem() {
+    shutdown();
+}
+
+bool JobSystem::init(int workerCount) {
+    if (!slots_.empty()) {
+        return false;
+    }
+    if (workerCount < 0) {
+        workerCount = std::max(0, (int) std::thread::hardware_concurrency() - 1);
+    }
+
+    slots_.resize(1 + workerCount + MAX_ATTACHED_THREADS);
+    for (ThreadSlot *&slot : slots_) {
+        slot = new ThreadSlot();
+        slot->jobs = std::vector<Job>(JOBS_PER_THREAD);
+    }
+
+    slots_[0]->attached.store(true);
+    current_thread.system = this;
+    current_thread.index = 0;
+
+    running_.store(true);
+    for (int i = 1; i <= workerCount; i++) {
+        workers_.emplace_back(&JobSystem::workerMain, this, i);
+    }
+    return true;
+}
+
+void JobSystem::shutdown() {
+    if (slots_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_.store(false);
+    }
+    wake_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+
+    for (ThreadSlot *slot : slots_) {
+        delete slot;
+    }
+    slots_.clear();
+    if (current_thread.system == this) {
+        current_thread = CurrentThread();
+    }
+}
+
+bool JobSystem::attachThread() {
+    if (current_thread.system == this) {
+        return true;
+    }
+    for (size_t i = 1 + workers_.size(); i < slots_.size(); i++) {
+        bool expected = false;
+        if (slots_[i]->attached.compare_exchange_strong(expected, true)) {
+            current_thread.system = this;
+            current_thread.index = (int) i;
+            return true;
+        }
+    }
+    std::cout << "ERROR::JOB_SYSTEM::TOO_MANY_THREADS" << std::endl;
+    return false;
+}
+
+void JobSystem::detachThread() {
+    ThreadSlot *slot = currentSlot();
+    if (slot == nullptr) {
+        return;
+    }
+    // Nobody else would run what is still queued here, except by stealing it
+    while (Job *job = slot->queue.pop()) {
+        execute(job);
+    }
+    slot->attached.store(false);
+    current_thread = CurrentThread();
+}
+
+JobSystem::ThreadSlot *JobSystem::currentSlot() const {
+    return current_thread.system == this ? slots_[current_thread.index] : nullptr;
+}
+
+Job *JobSystem::allocate() {
+    ThreadSlot *slot = currentSlot();
+    if (slot == nullptr) {
+        std::cout << "ERROR::JOB_SYSTEM::THREAD_NOT_ATTACHED" << std::endl;
+        return nullptr;
+    }
+    // Jobs are handed out in ring order; skip any that are still in flight
+    for (int attempt = 0; attempt < JOBS_PER_THREAD; attempt++) {
+        Job *job = &slot->jobs[slot->nextJob];
+        slot->nextJob = (slot->nextJob + 1) % JOBS_PER_THREAD;
+        if (job->unfinished.load(std::memory_order_acquire) == 0) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+Job *JobSystem::create(Job::Function function, Job *parent) {
+    Job *job = allocate();
+    if (job == nullptr) {
+        return nullptr;
+    }
+    job->function = function;
+    job->parent = parent;
+    job->system = this;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent != nullptr) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::run(Job *job) {
+    ThreadSlot *slot = currentSlot();
+    if (slot == nullptr || !slot->queue.push(job)) {
+        // Nowhere to queue it, so do it now
+        execute(job);
+        return;
+    }
+    if (sleeping_.load(std::memory_order_relaxed) > 0) {
+        wake_.notify_one();
+    }
+}
+
+void JobSystem::wait(const Job *job) {
+    int index = current_thread.system == this ? current_thread.index : -1;
+    while (job->unfinished.load(std::memory_order_acquire) > 0) {
+        Job *next = index >= 0 ? findJob(*slots_[index]) : nullptr;
+        if (next != nullptr) {
+            execute(next);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+Job *JobSystem::findJob(ThreadSlot &slot) {
+    Job *job = slot.queue.pop();
+    if (job != nullptr) {
+        return job;
+    }
+
+    // Start at a different victim on every thread so thieves do not all pile onto the same deque
+    size_t count = slots_.size();
+    size_t start = (size_t) current_thread.index + 1;
+    for (size_t i = 0; i < count; i++) {
+        ThreadSlot *victim = slots_[(start + i) % count];
+        if (victim == &slot) {
+            continue;
+        }
+        job = victim->queue.steal();
+        if (job != nullptr) {
+            slot.stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Job *job) {
+    PROFILE_ZONE("job");
+    job->function(job, job->data);
+    ThreadSlot *slot = currentSlot();
+    if (slot != nullptr) {
+        slot->executed.fetch_add(1, std::memory_order_relaxed);
+    }
+    finish(job);
+}
+
+void JobSystem::finish(Job *job) {
+    while (job != nullptr) {
+        Job *parent = job->parent;
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        job = parent;
+    }
+}
+
+void JobSystem::workerMain(int index) {
+    PROFILE_THREAD_NAME("job worker");
+    current_thread.system = this;
+    current_thread.index = index;
+    ThreadSlot &slot = *slots_[index];
+    slot.attached.store(true);
+
+    int idle = 0;
+    while (running_.load(std::memory_order_relaxed)) {
+        Job *job = findJob(slot);
+        if (job != nullptr) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // run() only notifies when someone is asleep; the timeout covers a notify that slips in before the wait
+        slot.sleeps.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (!running_.load(std::memory_order_relaxed)) {
+            break;
+        }
+        sleeping_.fetch_add(1, std::memory_order_relaxed);
+        wake_.wait_for(lock, std::chrono::milliseconds(1));
+        sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+    current_thread = CurrentThread();
+}
+
+JobSystem::Stats JobSystem::stats() const {
+    Stats stats;
+    for (const ThreadSlot *slot : slots_) {
+        stats.executed += slot->executed.load(std::memory_order_relaxed);
+        stats.stolen += slot->stolen.load(std::memory_order_relaxed);
+        stats.sleeps += slot->sleeps.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,205 @@
+#ifndef PROJECT_JOB_SYSTEM_H
+#define PROJECT_JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobSystem;
+
+// A unit of work. Jobs are small fixed-size records allocated from per-thread rings, with the closure stored inline,
+// so spawning one is a couple of stores and no heap allocation.
+//
+// A job counts as finished once it has run and all of its children have finished. Waiting on a parent therefore
+// waits for the whole tree spawned under it.
+struct alignas(64) Job {
+    using Function = void (*)(Job *job, void *data);
+
+    Function function = nullptr;
+    Job *parent = nullptr;
+    JobSystem *system = nullptr;
+    std::atomic<int> unfinished{0};
+    // Closure storage; see JobSystem::create()
+    alignas(16) unsigned char data[128 - 32];
+};
+
+static_assert(sizeof(Job) == 128, "Job should stay two cache lines");
+
+// Chase-Lev work-stealing deque. The owning thread pushes and pops at the bottom (LIFO, so it keeps working on what
+// is hot in its cache); any other thread steals from the top (FIFO, so thieves take the oldest and usually largest
+// pieces of work). Only steals and the owner's last-item pop synchronize with each other.
+class WorkStealingQueue {
+public:
+    static const int CAPACITY = 4096;
+
+    // Owner only. Returns false when full.
+    bool push(Job *job);
+    // Owner only
+    Job *pop();
+    // Any thread
+    Job *steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) std::atomic<Job *> jobs_[CAPACITY];
+};
+
+// Work-stealing scheduler. Every participating thread owns a deque; jobs run on the thread that spawned them unless
+// an idle thread steals them. The thread that calls init() participates as thread 0, workers are started for the
+// rest, and other threads (e.g. the render thread) can take part after attachThread().
+//
+// Jobs live in per-thread rings of JOBS_PER_THREAD records, reused in order. A thread must not have more than that
+// many unfinished jobs it created at once.
+class JobSystem {
+public:
+    static const int JOBS_PER_THREAD = 4096;
+    // Threads besides the workers that may attach
+    static const int MAX_ATTACHED_THREADS = 4;
+
+    struct Stats {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        uint64_t sleeps = 0;
+    };
+
+    JobSystem() = default;
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // Starts `workerCount` threads besides the calling one; negative means one per remaining hardware thread
+    bool init(int workerCount = -1);
+    void shutdown();
+
+    // Lets the calling thread create, run and wait on jobs. The init() thread is attached already.
+    bool attachThread();
+    void detachThread();
+
+    // The job is not scheduled until run() is called on it. A parent must not have finished when children are added
+    // to it, i.e. children are created from the parent itself or before the parent is run.
+    Job *create(Job::Function function, Job *parent = nullptr);
+
+    // Stores `closure` (anything callable as closure(), up to sizeof(Job::data) bytes) inside the job. Plain
+    // Job::Function pointers go to the overload above.
+    template<typename F>
+    Job *create(F &&closure, Job *parent = nullptr);
+
+    void run(Job *job);
+
+    // Runs other jobs until `job` and all its children are done
+    void wait(const Job *job);
+
+    // Calls body(begin, end) over [0, count) in chunks of at most `grain` items. Ranges are split in half
+    // recursively, so idle threads steal large pieces first. Returns when every chunk has run.
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, F &&body);
+
+    int threadCount() const { return (int) workers_.size() + 1; }
+    Stats stats() const;
+
+private:
+    struct alignas(64) ThreadSlot {
+        WorkStealingQueue queue;
+        std::vector<Job> jobs;
+        unsigned int nextJob = 0;
+        std::atomic<bool> attached{false};
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> sleeps{0};
+    };
+
+    template<typename F>
+    struct ParallelForRange {
+        F *body;
+        size_t begin;
+        size_t end;
+        size_t grain;
+    };
+
+    template<typename Closure>
+    static void runClosure(Job *job, void *data);
+
+    template<typename F>
+    static void parallelForJob(Job *job, void *data);
+
+    ThreadSlot *currentSlot() const;
+    Job *allocate();
+    Job *findJob(ThreadSlot &slot);
+    void execute(Job *job);
+    void finish(Job *job);
+    void workerMain(int index);
+
+    std::vector<ThreadSlot *> slots_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_{false};
+    // Idle workers sleep here once stealing keeps coming up empty
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<int> sleeping_{0};
+};
+
+template<typename F>
+Job *JobSystem::create(F &&closure, Job *parent) {
+    using Closure = typename std::decay<F>::type;
+    static_assert(sizeof(Closure) <= sizeof(Job::data), "closure too large to store in a job");
+    static_assert(alignof(Closure) <= 16, "closure alignment too large to store in a job");
+
+    Job *job = create(&JobSystem::runClosure<Closure>, parent);
+    if (job != nullptr) {
+        new(job->data) Closure(std::forward<F>(closure));
+    }
+    return job;
+}
+
+template<typename Closure>
+void JobSystem::runClosure(Job *, void *data) {
+    Closure *closure = (Closure *) data;
+    (*closure)();
+    closure->~Closure();
+}
+
+template<typename F>
+void JobSystem::parallelForJob(Job *job, void *data) {
+    ParallelForRange<F> range = *(ParallelForRange<F> *) data;
+    // Hand the upper half off and keep splitting the lower half on this thread
+    while (range.end - range.begin > range.grain) {
+        size_t middle = range.begin + (range.end - range.begin) / 2;
+        Job *child = job->system->create(&JobSystem::parallelForJob<F>, job);
+        if (child == nullptr) {
+            break;
+        }
+        new(child->data) ParallelForRange<F>{range.body, middle, range.end, range.grain};
+        job->system->run(child);
+        range.end = middle;
+    }
+    (*range.body)(range.begin, range.end);
+}
+
+template<typename F>
+void JobSystem::parallelFor(size_t count, size_t grain, F &&body) {
+    using Body = typename std::remove_reference<F>::type;
+    static_assert(sizeof(ParallelForRange<Body>) <= sizeof(Job::data), "range does not fit in a job");
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    Job *root = create(&JobSystem::parallelForJob<Body>);
+    if (root == nullptr) {
+        body((size_t) 0, count);
+        return;
+    }
+    new(root->data) ParallelForRange<Body>{&body, 0, count, grain};
+    run(root);
+    wait(root);
+}
+
+#endif //PROJECT_JOB_SYSTEM_H
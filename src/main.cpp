@@ -1,15 +1,68 @@
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "asset_importer.h"
+#include "bvh.h"
+#include "camera.h"
+#include "cpu_profiler.h"
+#include "culling.h"
+#include "draw_queue.h"
+#include "frame_packet.h"
+#include "frame_pacing.h"
+#include "geometry_arena.h"
+#include "gl_state.h"
+#include "gpu_profiler.h"
+#include "image_diff.h"
+#include "instancing.h"
+#include "job_system.h"
+#include "mesh_file.h"
+#include "mesh_import.h"
+#include "occlusion.h"
+#include "program_cache.h"
+#include "shader_builder.h"
+#include "software_renderer.h"
+#include "stream_buffer.h"
+#include "triple_buffer.h"
+
+#ifdef PROJECT_HEADLESS
+#include "headless.h"
+#endif
+
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
 
+// The simulation thread publishes a new frame packet at this rate, independent of how fast frames are presented
+#define SIMULATION_TICK (1.0 / 120.0)
+
+#define STREAM_BUFFER_SIZE (16 * 1024 * 1024)
+
+// Imported geometry uploaded per frame before the render thread stops taking more assets
+#define IMPORT_UPLOAD_BUDGET (8 * 1024 * 1024)
+
+// --pick also reports the instances within this distance of the picked point
+#define PICK_NEIGHBOUR_RADIUS 0.1f
+
 const char *vertexShaderSource = "#version 330 core\n"
                                  "layout (location = 0) in vec3 aPos;\n"
+                                 "uniform vec3 uPositionScale;\n"
+                                 "uniform vec3 uPositionOffset;\n"
+                                 "uniform mat4 uViewProjection;\n"
                                  "void main()\n"
                                  "{\n"
-                                 "   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
+                                 "   vec3 position = aPos * uPositionScale + uPositionOffset;\n"
+                                 "   gl_Position = uViewProjection * vec4(position.x, position.y, position.z, 1.0);\n"
                                  "}\0";
 
 const char *fragShaderSource_orange = "#version 330 core\n"
@@ -28,108 +81,565 @@ const char *fragShaderSource_blue = "#version 330 core\n"
                                     "    FragColor = vec4(0.18f, 0.96f, 0.93f, 1.0f);\n"
                                     "}\0";
 
-void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    glViewport(0, 0, width, height);
+// An imported asset after the render thread has put it into the arena
+struct UploadedAsset {
+    std::string path;
+    bool ok = false;
+    std::vector<MeshHandle> meshes;
+    int vertexCount = 0;
+    int triangleCount = 0;
+    double importMs = 0.0;
+};
+
+// Everything the render thread works with. It owns the GL context from the moment it starts until it returns.
+struct RenderThread {
+    GLFWwindow *window = NULL;
+#ifdef PROJECT_HEADLESS
+    HeadlessContext *headlessContext = nullptr;
+#endif
+    GeometryArena *arena = nullptr;
+    InstancedQuads *instancedQuads = nullptr;
+    TripleBuffer<FramePacket> *packets = nullptr;
+    std::atomic<bool> *running = nullptr;
+    AssetImporter *importer = nullptr;
+    // Set in --software mode, which draws on the CPU through the job system instead of through GL
+    SoftwareRenderer *software = nullptr;
+    JobSystem *jobs = nullptr;
+    // Stop after this many frames, or run until `running` is cleared if negative
+    long maxFrames = -1;
+    // Draw every packet exactly once and report each frame in `framesDrawn`, so the simulation can wait for it
+    bool lockstep = false;
+    std::atomic<long> framesDrawn{0};
+    // Read the last frame back into `captured`
+    bool capture = false;
+    // Time the parts of each frame on the GPU
+    bool gpuProfile = false;
+    // Swap interval of the window, and the frame rate limit (0 for none)
+    PresentMode presentMode = PRESENT_VSYNC_ON;
+    double maxFps = 0.0;
+    // Time from the end of one frame to the end of the next, recorded for every frame
+    FrameTimeHistogram frameTimes;
+
+    // Filled in when the thread finishes
+    long frames = 0;
+    double seconds = 0.0;
+    GLStateCache::Counters stateCounters;
+    DrawQueue::Stats queueStats;
+    StreamBuffer::Stats streamStats;
+    // Frames whose instance data did not fit the stream buffer and were drawn without the grid
+    unsigned long instanceUploadFailures = 0;
+    SoftwareRenderer::Stats softwareStats;
+    Image captured;
+    std::vector<GpuProfiler::ScopeTotals> gpuTimings;
+    GpuProfiler::Stats gpuStats;
+
+    // Imports uploaded so far, collected by the simulation thread
+    std::mutex uploadedMutex;
+    std::vector<UploadedAsset> uploaded;
+};
+
+// Moves finished imports into the arena, stopping once the frame's upload budget is spent
+static void upload_imported_assets(RenderThread &renderer) {
+    PROFILE_ZONE("upload imports");
+    size_t uploadedBytes = 0;
+    ImportedAsset asset;
+    while (uploadedBytes < IMPORT_UPLOAD_BUDGET && renderer.importer->takeFinished(asset)) {
+        UploadedAsset result;
+        result.path = asset.path;
+        result.ok = asset.ok;
+        result.vertexCount = asset.vertexCount;
+        result.triangleCount = asset.triangleCount;
+        result.importMs = asset.importMs;
+        for (const PackedMeshView &part : asset.parts) {
+            MeshHandle mesh = renderer.arena->addPackedMesh(part);
+            if (mesh.valid()) {
+                result.meshes.push_back(mesh);
+            }
+        }
+        uploadedBytes += asset.bytes;
+
+        std::lock_guard<std::mutex> lock(renderer.uploadedMutex);
+        renderer.uploaded.push_back(std::move(result));
+    }
 }
 
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// Holds the frame rate to the limit and records how long the frame took
+static void end_frame(RenderThread &renderer, FrameLimiter &limiter,
+                      std::chrono::steady_clock::time_point &lastFrameEnd) {
+    {
+        PROFILE_ZONE("frame limiter");
+        limiter.wait();
+    }
+    auto frameEnd = std::chrono::steady_clock::now();
+    renderer.frameTimes.record(std::chrono::duration<double, std::milli>(frameEnd - lastFrameEnd).count());
+    lastFrameEnd = frameEnd;
+}
 
-    // Create a window
-    GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+// Waits for a packet newer than the one in front, uploading imports meanwhile since the simulation may be waiting
+// for them. Returns false if the simulation stops first.
+static bool wait_for_packet(RenderThread &renderer) {
+    while (!renderer.packets->acquire()) {
+        if (!renderer.running->load(std::memory_order_acquire)) {
+            return false;
+        }
+        if (renderer.importer != nullptr) {
+            upload_imported_assets(renderer);
+        }
+        std::this_thread::yield();
     }
+    return true;
+}
 
-    glfwMakeContextCurrent(window);
+static void render_thread_main(RenderThread &renderer) {
+    PROFILE_THREAD_NAME("render");
+#ifdef PROJECT_HEADLESS
+    if (renderer.headlessContext != nullptr) {
+        renderer.headlessContext->makeCurrent();
+    }
+#endif
+    if (renderer.window != NULL) {
+        glfwMakeContextCurrent(renderer.window);
+        apply_present_mode(renderer.presentMode);
+    }
 
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+    GLStateCache &glState = gl_state();
+    DrawQueue drawQueue;
+    // Per-frame instance data is streamed; big enough for a few frames in flight of a large grid
+    StreamBuffer streamBuffer;
+    streamBuffer.init(STREAM_BUFFER_SIZE);
+    int viewportWidth = 0, viewportHeight = 0;
+    // Left uninitialized it measures nothing, and its scopes cost nothing
+    GpuProfiler gpuProfiler;
+    if (renderer.gpuProfile) {
+        gpuProfiler.init();
     }
+    FrameLimiter limiter;
+    limiter.setRate(renderer.maxFps);
+    auto startTime = std::chrono::steady_clock::now();
 
-    // If you set the values differently from the window w/h and 0,0 you can display other things outside the openGL
-    // viewport
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    // Nothing to draw until the simulation has published its first packet. Without one the loop is skipped, but the
+    // context is still given back below.
+    bool started = wait_for_packet(renderer);
+    auto lastFrameEnd = std::chrono::steady_clock::now();
 
-    // CREATE SHADERS
-    unsigned int vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
+    while (started && renderer.running->load(std::memory_order_acquire) &&
+           (renderer.maxFrames < 0 || renderer.frames < renderer.maxFrames)) {
+        bool freshPacket = renderer.frames == 0 || renderer.packets->acquire();
+        if (!freshPacket && renderer.lockstep) {
+            if (!wait_for_packet(renderer)) {
+                break;
+            }
+            freshPacket = true;
+        }
+        const FramePacket &packet = renderer.packets->front();
+        PROFILE_ZONE("render frame");
 
-    {
-        int success;
-        char infoLog[512];
-        glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            glad_glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glState.beginFrame();
+        gpuProfiler.beginFrame();
+        int frameScope = gpuProfiler.beginScope("frame");
+        if (renderer.importer != nullptr) {
+            GpuScope importScope(&gpuProfiler, "imports");
+            upload_imported_assets(renderer);
+        }
+        if (packet.framebufferWidth != viewportWidth || packet.framebufferHeight != viewportHeight) {
+            viewportWidth = packet.framebufferWidth;
+            viewportHeight = packet.framebufferHeight;
+            glViewport(0, 0, viewportWidth, viewportHeight);
         }
+        {
+            GpuScope clearScope(&gpuProfiler, "clear");
+            glClearColor(packet.clearColor[0], packet.clearColor[1], packet.clearColor[2], packet.clearColor[3]);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+
+        InstancedQuads &instancedQuads = *renderer.instancedQuads;
+        if (freshPacket) {
+            GpuScope streamScope(&gpuProfiler, "instance stream");
+            // On failure the grid is left out of the frame rather than drawn from stale data; the stream stats count it
+            if (!instancedQuads.setInstances(streamBuffer, packet.instances)) {
+                renderer.instanceUploadFailures++;
+            }
+        }
+
+        // Submission order does not matter, the queue groups draws by pass, program and VAO
+        drawQueue.clear();
+        if (instancedQuads.instanceCount() > 0) {
+            drawQueue.submit(DrawQueue::makeKey(PASS_BACKGROUND, instancedQuads.program(), instancedQuads.vao(), 0.0f),
+                             instancedQuads.drawCommand());
+        }
+        for (const SceneDraw &draw : packet.draws) {
+            DrawCommand command = make_draw_command(*renderer.arena, draw.mesh, draw.program, draw.lod);
+            drawQueue.submit(DrawQueue::makeKey(draw.pass, command.program, command.vao, 0.0f), command);
+        }
+        drawQueue.sort();
+        drawQueue.execute(packet.viewProjection, &gpuProfiler);
+        streamBuffer.endFrame();
+        gpuProfiler.endScope(frameScope);
+        gpuProfiler.endFrame();
+
+        if (renderer.window != NULL) {
+            PROFILE_ZONE("swap buffers");
+            glfwSwapBuffers(renderer.window);
+        }
+        end_frame(renderer, limiter, lastFrameEnd);
+        renderer.frames++;
+        renderer.framesDrawn.store(renderer.frames, std::memory_order_release);
     }
 
-    unsigned int fragmentShader_orange;
-    fragmentShader_orange = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader_orange, 1, &fragShaderSource_orange, NULL);
-    glCompileShader(fragmentShader_orange);
+    if (renderer.capture && renderer.frames > 0) {
+        renderer.captured.resize(viewportWidth, viewportHeight);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, viewportWidth, viewportHeight, GL_RGBA, GL_UNSIGNED_BYTE, renderer.captured.pixels.data());
+    }
+    // Nothing is presented headless, so wait for the GPU to drain before taking the time
+    glFinish();
+    renderer.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    renderer.stateCounters = glState.lastFrame();
+    renderer.queueStats = drawQueue.stats();
+    renderer.streamStats = streamBuffer.stats();
+    streamBuffer.destroy();
+    gpuProfiler.flush();
+    renderer.gpuTimings = gpuProfiler.totals();
+    renderer.gpuStats = gpuProfiler.stats();
+    gpuProfiler.destroy();
 
-    int success;
-    char infoLog[512];
-    glGetShaderiv(fragmentShader_orange, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glad_glGetShaderInfoLog(fragmentShader_orange, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    // Tell the simulation we are done (headless frame limit reached) and give the context back
+    renderer.running->store(false, std::memory_order_release);
+#ifdef PROJECT_HEADLESS
+    if (renderer.headlessContext != nullptr) {
+        renderer.headlessContext->releaseCurrent();
     }
+#endif
+    if (renderer.window != NULL) {
+        glfwMakeContextCurrent(NULL);
+    }
+}
 
-    unsigned int fragmentShader_blue;
-    fragmentShader_blue = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader_blue, 1, &fragShaderSource_blue, NULL);
-    glCompileShader(fragmentShader_blue);
+// The frame loop of render_thread_main() drawn by the software renderer. No GL context is involved.
+static void software_render_thread_main(RenderThread &renderer) {
+    PROFILE_THREAD_NAME("render");
+    SoftwareRenderer &software = *renderer.software;
+    renderer.jobs->attachThread();
+    DrawQueue drawQueue;
+    FrameLimiter limiter;
+    limiter.setRate(renderer.maxFps);
+    auto startTime = std::chrono::steady_clock::now();
 
-    glGetShaderiv(fragmentShader_blue, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glad_glGetShaderInfoLog(fragmentShader_blue, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED " << success << "\n" << infoLog << std::endl;
+    if (!wait_for_packet(renderer)) {
+        renderer.jobs->detachThread();
+        return;
     }
+    auto lastFrameEnd = std::chrono::steady_clock::now();
 
-    unsigned int shaderProgram_orange;
-    shaderProgram_orange = glCreateProgram();
-    glAttachShader(shaderProgram_orange, vertexShader);
-    glAttachShader(shaderProgram_orange, fragmentShader_orange);
-    glLinkProgram(shaderProgram_orange);
+    while (renderer.running->load(std::memory_order_acquire) &&
+           (renderer.maxFrames < 0 || renderer.frames < renderer.maxFrames)) {
+        bool freshPacket = renderer.frames == 0 || renderer.packets->acquire();
+        if (!freshPacket && renderer.lockstep) {
+            if (!wait_for_packet(renderer)) {
+                break;
+            }
+            freshPacket = true;
+        }
+        const FramePacket &packet = renderer.packets->front();
+        PROFILE_ZONE("render frame");
+
+        if (renderer.importer != nullptr) {
+            upload_imported_assets(renderer);
+        }
+        if (packet.framebufferWidth != software.width() || packet.framebufferHeight != software.height()) {
+            software.resize(packet.framebufferWidth, packet.framebufferHeight);
+        }
+        software.clear(packet.clearColor);
+        if (freshPacket) {
+            software.setInstances(packet.instances);
+        }
+
+        drawQueue.clear();
+        DrawCommand instances = software.instanceDrawCommand();
+        if (instances.instanceCount > 0) {
+            drawQueue.submit(DrawQueue::makeKey(PASS_BACKGROUND, instances.program, 0, 0.0f), instances);
+        }
+        for (const SceneDraw &draw : packet.draws) {
+            DrawCommand command = make_draw_command(*renderer.arena, draw.mesh, draw.program, draw.lod);
+            drawQueue.submit(DrawQueue::makeKey(draw.pass, command.program, command.vao, 0.0f), command);
+        }
+        drawQueue.sort();
+        software.execute(drawQueue, *renderer.arena, packet.viewProjection, renderer.jobs);
+        end_frame(renderer, limiter, lastFrameEnd);
+        renderer.frames++;
+        renderer.framesDrawn.store(renderer.frames, std::memory_order_release);
+    }
 
-    // check for linking errors
-    glGetProgramiv(shaderProgram_orange, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram_orange, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    if (renderer.capture && renderer.frames > 0) {
+        renderer.captured.resize(software.width(), software.height());
+        software.readPixels(0, 0, software.width(), software.height(), renderer.captured.pixels.data());
     }
 
-    unsigned int shaderProgram_blue;
-    shaderProgram_blue = glCreateProgram();
-    glAttachShader(shaderProgram_blue, vertexShader);
-    glAttachShader(shaderProgram_blue, fragmentShader_blue);
-    glLinkProgram(shaderProgram_blue);
+    renderer.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    renderer.queueStats = drawQueue.stats();
+    renderer.softwareStats = software.stats();
+    renderer.running->store(false, std::memory_order_release);
+    renderer.jobs->detachThread();
+}
 
-    // check for linking errors
-    glGetProgramiv(shaderProgram_blue, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram_blue, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+int main(int argc, char **argv) {
+    // --headless renders into an offscreen framebuffer without a window and exits after --frames N frames
+    bool headless = false;
+    long maxFrames = -1;
+    // --instances N draws N extra rectangles behind the scene through the instanced path
+    int instanceCount = 0;
+    bool optimizeMeshes = false;
+    // --quantize E stores positions in the smallest format that stays within E of the source
+    float quantizationError = 0.0f;
+    // --mesh FILE draws a packed mesh file (repeatable); --export-mesh FILE writes the built-in meshes as one
+    std::vector<const char *> meshFiles;
+    const char *exportMeshFile = nullptr;
+    // --import FILE loads an OBJ, glTF or packed mesh file in the background (repeatable)
+    std::vector<const char *> importFiles;
+    int importThreads = 0;
+    // --job-threads N sets the number of job system workers besides the main thread
+    int jobThreads = -1;
+    // --zoom Z looks at 1/Z of the scene through a camera that pans around, so most objects get culled
+    float zoom = 0.0f;
+    // --flat-cull tests every bounding box instead of walking the BVHs
+    bool flatCull = false;
+    // --pick X Y casts a ray through that pixel at exit and reports what it hits
+    float pickX = -1.0f, pickY = -1.0f;
+    // --lods N builds N simplified levels per mesh; each object draws the coarsest one whose error stays within
+    // --lod-error pixels on screen
+    int lodLevels = 0;
+    float lodPixelError = 1.0f;
+    // --occluder FILE draws an OBJ or glTF mesh and rasterizes it into the occlusion buffer every tick, hiding what
+    // lies behind it (repeatable)
+    std::vector<const char *> occluderFiles;
+    // --software draws with the built-in CPU rasterizer instead of GL; implies --headless and needs no GPU
+    bool software = false;
+    // --capture FILE writes the last frame as a PPM image; --compare GOLDEN diffs it against one and exits with 1 if
+    // any pixel has a channel more than --tolerance N apart, --heatmap FILE showing where. Both imply --headless and
+    // render every import and every simulation tick, in lockstep, so the same arguments always draw the same frames.
+    // The golden_check build target runs the scenes in golden/ this way.
+    const char *capturePath = nullptr, *comparePath = nullptr, *heatmapPath = nullptr;
+    int tolerance = 0;
+    // --gpu-profile prints the GPU and CPU time of each part of the frame at exit (GL only, not with --software)
+    bool gpuProfile = false;
+    // --trace FILE records the CPU profiling zones of every thread and writes them as a Chrome trace at exit
+    const char *tracePath = nullptr;
+    // --vsync off|on|adaptive sets the swap interval of the window; --fps N caps the frame rate
+    PresentMode presentMode = PRESENT_VSYNC_ON;
+    double maxFps = 0.0;
+    // --shader-cache DIR keeps linked program binaries there, so later runs skip compiling; --no-shader-cache turns
+    // the cache off
+    const char *shaderCacheDirectory = "shader_cache";
+    // --shader-thread builds the programs on a worker thread with a context of its own
+    bool shaderThread = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            maxFrames = std::atol(argv[++i]);
+        } else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instanceCount = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--optimize-meshes") == 0) {
+            optimizeMeshes = true;
+        } else if (std::strcmp(argv[i], "--quantize") == 0 && i + 1 < argc) {
+            quantizationError = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            meshFiles.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--export-mesh") == 0 && i + 1 < argc) {
+            exportMeshFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+            importFiles.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--import-threads") == 0 && i + 1 < argc) {
+            importThreads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--job-threads") == 0 && i + 1 < argc) {
+            jobThreads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--zoom") == 0 && i + 1 < argc) {
+            zoom = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--flat-cull") == 0) {
+            flatCull = true;
+        } else if (std::strcmp(argv[i], "--pick") == 0 && i + 2 < argc) {
+            pickX = (float) std::atof(argv[++i]);
+            pickY = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc) {
+            lodLevels = std::max(0, std::min(std::atoi(argv[++i]), MAX_MESH_LODS - 1));
+        } else if (std::strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc) {
+            lodPixelError = (float) std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--occluder") == 0 && i + 1 < argc) {
+            occluderFiles.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--software") == 0) {
+            software = true;
+            headless = true;
+        } else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capturePath = argv[++i];
+            headless = true;
+        } else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            comparePath = argv[++i];
+            headless = true;
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = std::max(0, std::min(std::atoi(argv[++i]), 255));
+        } else if (std::strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            heatmapPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--gpu-profile") == 0) {
+            gpuProfile = true;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--vsync") == 0 && i + 1 < argc &&
+                   parse_present_mode(argv[i + 1], presentMode)) {
+            i++;
+        } else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            maxFps = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+            shaderCacheDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-shader-cache") == 0) {
+            shaderCacheDirectory = nullptr;
+        } else if (std::strcmp(argv[i], "--shader-thread") == 0) {
+            shaderThread = true;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--headless] [--frames N] [--instances N] [--optimize-meshes]"
+                      << " [--quantize MAX_ERROR] [--mesh FILE]... [--export-mesh FILE]"
+                      << " [--import FILE]... [--import-threads N] [--job-threads N]"
+                      << " [--zoom Z] [--flat-cull] [--pick X Y] [--lods N] [--lod-error PIXELS]"
+                      << " [--occluder FILE]... [--software]"
+                      << " [--capture FILE] [--compare GOLDEN] [--tolerance N] [--heatmap FILE]"
+                      << " [--gpu-profile] [--trace FILE] [--vsync off|on|adaptive] [--fps N]"
+                      << " [--shader-cache DIR] [--no-shader-cache] [--shader-thread]" << std::endl;
+            return -1;
+        }
+    }
+    if (tracePath != nullptr) {
+#ifdef PROJECT_PROFILER
+        cpu_profiler().setEnabled(true);
+        PROFILE_THREAD_NAME("simulation");
+#else
+        std::cout << "Profiling is not available in this build (configure with PROJECT_PROFILER=ON, not as Release)"
+                  << std::endl;
+        return -1;
+#endif
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader_orange);
-    glDeleteShader(fragmentShader_blue);
+    GLFWwindow *window = NULL;
+#ifdef PROJECT_HEADLESS
+    HeadlessContext headlessContext;
+#endif
+    if (software) {
+        if (maxFrames < 0) {
+            maxFrames = 1;
+        }
+    } else if (headless) {
+#ifdef PROJECT_HEADLESS
+        if (!headlessContext.create(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+            std::cout << "Failed to create headless context" << std::endl;
+            return -1;
+        }
+        if (!gladLoadGLLoader((GLADloadproc) HeadlessContext::getProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        if (!headlessContext.createFramebuffer()) {
+            return -1;
+        }
+        if (maxFrames < 0) {
+            maxFrames = 1;
+        }
+#else
+        std::cout << "Headless mode is not available in this build (configure with PROJECT_HEADLESS=ON)" << std::endl;
+        return -1;
+#endif
+    } else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Create a window
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+    }
+
+    unsigned int shaderProgram_orange = 0, shaderProgram_blue = 0;
+    ProgramCache programCache;
+    // Context of the shader thread; declared before the builder so it outlives the thread
+#ifdef PROJECT_HEADLESS
+    HeadlessContext shaderContext;
+#endif
+    GLFWwindow *shaderWindow = NULL;
+    ShaderBuilder shaderBuilder;
+    ShaderBuilder::Ticket ticket_orange = 0, ticket_blue = 0;
+    InstancedQuads instancedQuads;
+    SoftwareRenderer softwareRenderer;
+    if (software) {
+        // The software renderer's programs are the flat colors of the fragment shaders below
+        const float orange[4] = {1.0f, 0.5f, 0.2f, 1.0f};
+        const float blue[4] = {0.18f, 0.96f, 0.93f, 1.0f};
+        shaderProgram_orange = softwareRenderer.createProgram(orange);
+        shaderProgram_blue = softwareRenderer.createProgram(blue);
+    } else {
+        // If you set the values differently from the window w/h and 0,0 you can display other things outside the openGL
+        // viewport
+        glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+        // CREATE SHADERS
+        // Only submitted here: they build while the meshes below load, and are collected before the scene needs them
+        if (shaderCacheDirectory != nullptr) {
+            programCache.init(shaderCacheDirectory);
+        }
+        shaderBuilder.init(programCache);
+        if (shaderThread) {
+#ifdef PROJECT_HEADLESS
+            if (headless && shaderContext.createShared(headlessContext)) {
+                shaderBuilder.startThread(&shaderContext, [](void *context) {
+                    return ((HeadlessContext *) context)->makeCurrent();
+                }, [](void *context) {
+                    ((HeadlessContext *) context)->releaseCurrent();
+                });
+            }
+#endif
+            if (!headless) {
+                // A hidden window, only for its context
+                glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+                shaderWindow = glfwCreateWindow(1, 1, "", NULL, window);
+                glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+                if (shaderWindow != NULL) {
+                    shaderBuilder.startThread(shaderWindow, [](void *context) {
+                        glfwMakeContextCurrent((GLFWwindow *) context);
+                        return glfwGetCurrentContext() == (GLFWwindow *) context;
+                    }, [](void *) {
+                        glfwMakeContextCurrent(NULL);
+                    });
+                }
+            }
+        }
+        ticket_orange = shaderBuilder.submit(vertexShaderSource, fragShaderSource_orange);
+        ticket_blue = shaderBuilder.submit(vertexShaderSource, fragShaderSource_blue);
+        if (instanceCount > 0) {
+            instancedQuads.requestProgram(shaderBuilder);
+        }
+    }
 
     // VERTICES
-    unsigned int VAO_right, VAO_left;
+    // All static meshes share the arena's buffers and are drawn with a base vertex from one VAO
+    GeometryArena geometryArena;
+    geometryArena.setCpuStorage(software);
+    geometryArena.setOptimizeMeshes(optimizeMeshes);
+    geometryArena.setQuantizationError(quantizationError);
+    geometryArena.setLodLevels(lodLevels);
+    MeshHandle mesh_right, mesh_left;
+    PackOptions exportOptions;
+    exportOptions.quantizationError = quantizationError;
+    exportOptions.optimize = optimizeMeshes;
+    exportOptions.lodLevels = lodLevels;
+    std::vector<PackedMesh> exportParts;
     {
         float vertices_right[] = {
                 0.25f, 0.5f, 0.0f,  // top right
@@ -141,26 +651,11 @@ int main() {
                 0, 1, 3,
                 1, 2, 3
         };
-
-        unsigned int VBO_right, EBO_right;
-        glGenBuffers(1, &VBO_right);
-        glGenVertexArrays(1, &VAO_right);
-        glGenBuffers(1, &EBO_right);
-
-        glBindVertexArray(VAO_right);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_right);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_right), vertices_right, GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_right);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_right), indices_right, GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
-        glEnableVertexAttribArray(0);
-
-        // Unbind the buffer
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        mesh_right = geometryArena.addMesh(vertices_right, 4, indices_right, 6);
+        if (exportMeshFile != nullptr) {
+            exportParts.emplace_back();
+            pack_mesh(vertices_right, 4, indices_right, 6, exportOptions, exportParts.back());
+        }
     }
 
     // VERTICES
@@ -175,47 +670,452 @@ int main() {
                 3, 0, 2,
                 0, 1, 2
         };
+        mesh_left = geometryArena.addMesh(vertices_left, 4, indices_left, 6);
+        if (exportMeshFile != nullptr) {
+            exportParts.emplace_back();
+            pack_mesh(vertices_left, 4, indices_left, 6, exportOptions, exportParts.back());
+        }
+    }
+
+    if (exportMeshFile != nullptr && !write_mesh_file(exportMeshFile, exportParts)) {
+        return -1;
+    }
+
+    // Packed mesh files go from the mapping straight into the arena's buffers
+    std::vector<MeshHandle> fileMeshes;
+    for (const char *path : meshFiles) {
+        MappedMeshFile meshFile;
+        if (!meshFile.open(path)) {
+            return -1;
+        }
+        for (size_t part = 0; part < meshFile.partCount(); part++) {
+            MeshHandle mesh = geometryArena.addPackedMesh(meshFile.part(part));
+            if (mesh.valid()) {
+                fileMeshes.push_back(mesh);
+            }
+        }
+    }
+
+    // Occluders stay on the CPU as well, for the occlusion buffer
+    std::vector<ImportedGeometry> occluders(occluderFiles.size());
+    for (size_t i = 0; i < occluderFiles.size(); i++) {
+        ImportedGeometry &occluder = occluders[i];
+        if (!import_geometry(occluderFiles[i], occluder)) {
+            return -1;
+        }
+        std::vector<MeshHandle> parts = geometryArena.addMeshClusters(occluder.positions.data(),
+                                                                      (int) (occluder.positions.size() / 3),
+                                                                      occluder.indices.data(),
+                                                                      (int) occluder.indices.size());
+        fileMeshes.insert(fileMeshes.end(), parts.begin(), parts.end());
+    }
+
+    for (const MeshOptimizeReport &report : geometryArena.optimizeReports()) {
+        std::cout << "Optimized mesh: ACMR " << report.before.acmr << " -> " << report.after.acmr << ", ATVR "
+                  << report.before.atvr << " -> " << report.after.atvr << std::endl;
+    }
+
+    std::vector<QuadInstance> quadGrid;
+    if (instanceCount > 0) {
+        if (!software && !instancedQuads.init()) {
+            return -1;
+        }
+        quadGrid = make_quad_grid(instanceCount);
+    }
+    if (!software) {
+        shaderProgram_orange = shaderBuilder.finish(ticket_orange);
+        shaderProgram_blue = shaderBuilder.finish(ticket_blue);
+        // Nothing else to build
+        shaderBuilder.stop();
+        if (shaderWindow != NULL) {
+            glfwDestroyWindow(shaderWindow);
+        }
+        if (shaderProgram_orange == 0 || shaderProgram_blue == 0) {
+            return -1;
+        }
+    }
+
+    std::vector<SceneDraw> scene;
+    scene.push_back({PASS_OPAQUE, shaderProgram_blue, mesh_right});
+    scene.push_back({PASS_OPAQUE, shaderProgram_orange, mesh_left});
+    for (const MeshHandle &mesh : fileMeshes) {
+        scene.push_back({PASS_OPAQUE, shaderProgram_orange, mesh});
+    }
+
+    // CPU-side frame work on the simulation thread is spread over the job system
+    JobSystem jobSystem;
+    jobSystem.init(jobThreads);
+
+    // Imports are parsed and packed on worker threads while the scene is already on screen
+    AssetImporter importer;
+    if (!importFiles.empty()) {
+        PackOptions importOptions;
+        importOptions.quantizationError = quantizationError;
+        importOptions.optimize = optimizeMeshes;
+        importOptions.lodLevels = lodLevels;
+        importer.start(importThreads);
+        for (const char *path : importFiles) {
+            importer.request(path, importOptions);
+        }
+    }
+
+    // From here on the context belongs to the render thread; this thread handles input and simulation
+    TripleBuffer<FramePacket> packets;
+    std::atomic<bool> running(true);
+    RenderThread renderer;
+    renderer.window = window;
+#ifdef PROJECT_HEADLESS
+    renderer.headlessContext = headless ? &headlessContext : nullptr;
+#endif
+    renderer.arena = &geometryArena;
+    renderer.instancedQuads = &instancedQuads;
+    renderer.packets = &packets;
+    renderer.running = &running;
+    renderer.importer = importFiles.empty() ? nullptr : &importer;
+    renderer.software = software ? &softwareRenderer : nullptr;
+    renderer.jobs = &jobSystem;
+    renderer.maxFrames = headless ? maxFrames : -1;
+    bool lockstep = capturePath != nullptr || comparePath != nullptr;
+    renderer.lockstep = lockstep;
+    renderer.capture = lockstep;
+    renderer.gpuProfile = gpuProfile;
+    renderer.presentMode = presentMode;
+    renderer.maxFps = maxFps;
+
+#ifdef PROJECT_HEADLESS
+    if (headless && !software) {
+        headlessContext.releaseCurrent();
+    }
+#endif
+    if (!headless) {
+        glfwMakeContextCurrent(NULL);
+    }
+    std::thread renderThread(software ? software_render_thread_main : render_thread_main, std::ref(renderer));
 
-        unsigned int VBO_left, EBO_left;
-        glGenBuffers(1, &VBO_left);
-        glGenVertexArrays(1, &VAO_left);
-        glGenBuffers(1, &EBO_left);
+    // Visibility: scene objects and instanced rectangles are culled against the camera frustum every tick. The scene
+    // BVH is rebuilt when objects are added; the instance BVH is refit as the grid animates. With occluders, whatever
+    // survives the frustum is then tested against their rasterized depth.
+    Camera camera;
+    OcclusionBuffer occlusion;
+    BoundsSoA sceneBounds, instanceBounds;
+    FrustumCuller sceneCuller, instanceCuller;
+    Bvh sceneBvh, instanceBvh;
+    std::vector<uint32_t> visibleScene, visibleInstances;
+    std::vector<QuadInstance> animatedQuads;
+    bool sceneChanged = true;
+    int viewWidth = WINDOW_WIDTH, viewHeight = WINDOW_HEIGHT;
+    size_t lodTriangles = 0, fullTriangles = 0;
+    size_t importsDone = 0;
+    auto lastTitleUpdate = std::chrono::steady_clock::now();
 
-        glBindVertexArray(VAO_left);
+    uint64_t tick = 0;
+    auto nextTick = std::chrono::steady_clock::now();
+    const auto tickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(SIMULATION_TICK));
+    while (running.load(std::memory_order_acquire)) {
+        PROFILE_ZONE("simulation tick");
+        if (!headless) {
+            if (glfwWindowShouldClose(window)) {
+                running.store(false, std::memory_order_release);
+                break;
+            }
+            // The frame time distribution so far, in the title bar
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastTitleUpdate >= std::chrono::seconds(1)) {
+                FrameTimeHistogram::Summary frameTimes = renderer.frameTimes.summary();
+                char title[160];
+                std::snprintf(title, sizeof(title), "LearnOpenGL - p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms",
+                              frameTimes.p50Ms, frameTimes.p95Ms, frameTimes.p99Ms, frameTimes.maxMs);
+                glfwSetWindowTitle(window, title);
+                lastTitleUpdate = now;
+            }
+        }
+
+        std::vector<UploadedAsset> uploaded;
+        {
+            std::lock_guard<std::mutex> lock(renderer.uploadedMutex);
+            uploaded.swap(renderer.uploaded);
+        }
+        for (const UploadedAsset &asset : uploaded) {
+            if (!asset.ok) {
+                std::cout << "Failed to import " << asset.path << std::endl;
+                continue;
+            }
+            std::cout << "Imported " << asset.path << ": " << asset.vertexCount << " vertices, "
+                      << asset.triangleCount << " triangles in " << asset.meshes.size() << " parts ("
+                      << asset.importMs << " ms)" << std::endl;
+            for (const MeshHandle &mesh : asset.meshes) {
+                scene.push_back({PASS_OPAQUE, shaderProgram_orange, mesh});
+            }
+            sceneChanged = true;
+        }
+        importsDone += uploaded.size();
+        // In lockstep the first tick already sees every import, however long they take
+        if (lockstep && importsDone < importFiles.size()) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (sceneChanged) {
+            sceneBounds.resize(scene.size());
+            for (size_t i = 0; i < scene.size(); i++) {
+                sceneBounds.set(i, scene[i].mesh.boundsMin, scene[i].mesh.boundsMax);
+            }
+            sceneBvh.build(sceneBounds, &jobSystem);
+            sceneChanged = false;
+        }
+
+        FramePacket &packet = packets.back();
+        packet.frameIndex = tick;
+        packet.time = (double) tick * SIMULATION_TICK;
+        if (headless) {
+            packet.framebufferWidth = WINDOW_WIDTH;
+            packet.framebufferHeight = WINDOW_HEIGHT;
+        } else {
+            glfwGetFramebufferSize(window, &packet.framebufferWidth, &packet.framebufferHeight);
+        }
+
+        if (zoom > 0.0f) {
+            float extent = 1.0f / zoom;
+            float centerX = (1.0f - extent) * (float) std::cos(packet.time * 0.5);
+            float centerY = (1.0f - extent) * (float) std::sin(packet.time * 0.5);
+            camera.setOrthographic(centerX - extent, centerX + extent, centerY - extent, centerY + extent, -1.0f,
+                                   1.0f);
+        }
+        camera.viewProjection(packet.viewProjection);
+        Frustum frustum = frustum_from_view_projection(packet.viewProjection);
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_left);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_left), vertices_left, GL_STATIC_DRAW);
+        if (flatCull) {
+            sceneCuller.cull(sceneBounds, frustum, &jobSystem, visibleScene);
+        } else {
+            visibleScene.clear();
+            sceneBvh.cull(frustum, visibleScene);
+        }
+        if (!occluders.empty()) {
+            occlusion.begin(packet.viewProjection);
+            for (const ImportedGeometry &occluder : occluders) {
+                occlusion.addOccluder(occluder.positions.data(), occluder.positions.size() / 3,
+                                      occluder.indices.data(), occluder.indices.size());
+            }
+            occlusion.finish();
+            occlusion.cull(sceneBounds, &jobSystem, visibleScene);
+        }
+        packet.draws.clear();
+        lodTriangles = fullTriangles = 0;
+        for (uint32_t index : visibleScene) {
+            SceneDraw draw = scene[index];
+            const float center[3] = {sceneBounds.centerX()[index], sceneBounds.centerY()[index],
+                                     sceneBounds.centerZ()[index]};
+            float radius = std::sqrt(sceneBounds.extentX()[index] * sceneBounds.extentX()[index] +
+                                     sceneBounds.extentY()[index] * sceneBounds.extentY()[index] +
+                                     sceneBounds.extentZ()[index] * sceneBounds.extentZ()[index]);
+            float scale = pixels_per_unit(packet.viewProjection, center, radius, (float) packet.framebufferHeight);
+            draw.lod = select_lod(draw.mesh, scale, lodPixelError);
+            lodTriangles += draw.mesh.lods[draw.lod].indexCount / 3;
+            fullTriangles += draw.mesh.lods[0].indexCount / 3;
+            packet.draws.push_back(draw);
+        }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_left);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_left), indices_left, GL_STATIC_DRAW);
+        animate_quad_grid(quadGrid, packet.time, animatedQuads, &jobSystem);
+        quad_instance_bounds(animatedQuads, instanceBounds, &jobSystem);
+        if (flatCull) {
+            instanceCuller.cull(instanceBounds, frustum, &jobSystem, visibleInstances);
+        } else {
+            if (instanceBvh.empty()) {
+                instanceBvh.build(instanceBounds, &jobSystem);
+            } else {
+                instanceBvh.refit(instanceBounds);
+            }
+            visibleInstances.clear();
+            instanceBvh.cull(frustum, visibleInstances);
+        }
+        if (!occluders.empty()) {
+            occlusion.cull(instanceBounds, &jobSystem, visibleInstances);
+        }
+        packet.instances.resize(visibleInstances.size());
+        jobSystem.parallelFor(visibleInstances.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                packet.instances[i] = animatedQuads[visibleInstances[i]];
+            }
+        });
+        viewWidth = packet.framebufferWidth;
+        viewHeight = packet.framebufferHeight;
+        packets.publish();
+        tick++;
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
-        glEnableVertexAttribArray(0);
+        if (lockstep) {
+            PROFILE_ZONE("wait for render");
+            while (renderer.framesDrawn.load(std::memory_order_acquire) < (long) tick &&
+                   running.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
 
-        // Unbind the buffer
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        // Keep processing input while the render thread is blocked in swap
+        nextTick += tickLength;
+        if (headless) {
+            PROFILE_ZONE("wait for tick");
+            std::this_thread::sleep_until(nextTick);
+        } else {
+            PROFILE_ZONE("poll events");
+            double timeout = std::chrono::duration<double>(nextTick - std::chrono::steady_clock::now()).count();
+            if (timeout > 0.0) {
+                glfwWaitEventsTimeout(timeout);
+            } else {
+                glfwPollEvents();
+            }
+        }
+    }
+    renderThread.join();
+    importer.stop();
+#ifdef PROJECT_PROFILER
+    if (tracePath != nullptr) {
+        cpu_profiler().setEnabled(false);
+        cpu_profiler().writeChromeTrace(tracePath);
     }
+#endif
 
-//    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    while (!glfwWindowShouldClose(window)) {
-        glClearColor(.2f, .3f, .3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+    // Take the context back to release GL objects while it is still alive
+#ifdef PROJECT_HEADLESS
+    if (headless && !software) {
+        headlessContext.makeCurrent();
+    }
+#endif
+    if (!headless) {
+        glfwMakeContextCurrent(window);
+    }
+    // This thread's cache still holds the bindings from setup; the render thread has changed them since
+    gl_state().invalidate();
+    instancedQuads.destroy();
+    geometryArena.destroy();
 
-        glUseProgram(shaderProgram_blue);
-        glBindVertexArray(VAO_right);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    if (pickX >= 0.0f && pickY >= 0.0f) {
+        if (flatCull) {
+            sceneBvh.build(sceneBounds, &jobSystem);
+            instanceBvh.build(instanceBounds, &jobSystem);
+        }
+        float viewProjection[16], inverse[16], origin[3], direction[3];
+        camera.viewProjection(viewProjection);
+        // Window coordinates have y pointing down
+        float ndcX = 2.0f * (pickX + 0.5f) / (float) viewWidth - 1.0f;
+        float ndcY = 1.0f - 2.0f * (pickY + 0.5f) / (float) viewHeight;
+        if (matrix_invert(viewProjection, inverse) && ray_from_ndc(inverse, ndcX, ndcY, origin, direction)) {
+            RayHit hit;
+            std::cout << "Pick " << pickX << "," << pickY << ": ";
+            if (sceneBvh.raycast(origin, direction, 1.0f, hit)) {
+                std::cout << "object " << hit.primitive;
+            } else {
+                std::cout << "no object";
+            }
+            if (instanceBvh.raycast(origin, direction, 1.0f, hit)) {
+                std::cout << ", instance " << hit.primitive;
+                float point[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    point[axis] = origin[axis] + direction[axis] * hit.distance;
+                }
+                std::vector<uint32_t> neighbours;
+                instanceBvh.withinDistance(point, PICK_NEIGHBOUR_RADIUS, neighbours);
+                std::cout << " (" << neighbours.size() << " instances within " << PICK_NEIGHBOUR_RADIUS << ")";
+            }
+            std::cout << std::endl;
+        }
+    }
 
-        glUseProgram(shaderProgram_orange);
-        glBindVertexArray(VAO_left);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    if (gpuProfile && !software) {
+        unsigned long measured = std::max(renderer.gpuStats.framesMeasured, 1ul);
+        std::cout << "GPU profile, per frame over " << renderer.gpuStats.framesMeasured << " measured frames ("
+                  << renderer.gpuStats.framesSkipped << " skipped):" << std::endl;
+        for (const GpuProfiler::ScopeTotals &scope : renderer.gpuTimings) {
+            std::cout << std::string(2 + 2 * scope.depth, ' ') << scope.name << ": " << scope.gpuMs / measured
+                      << " ms GPU, " << scope.cpuMs / measured << " ms CPU" << std::endl;
+        }
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    int exitCode = 0;
+    if (capturePath != nullptr && !write_ppm(capturePath, renderer.captured)) {
+        exitCode = 1;
+    }
+    if (comparePath != nullptr) {
+        Image golden, heatmap;
+        Image *heatmapTarget = heatmapPath != nullptr ? &heatmap : nullptr;
+        ImageDiff diff;
+        if (!read_ppm(comparePath, golden)) {
+            exitCode = 1;
+        } else if (!diff_images(renderer.captured, golden, tolerance, diff, heatmapTarget)) {
+            std::cout << "Compare: frame is " << renderer.captured.width << "x" << renderer.captured.height
+                      << ", golden image is " << golden.width << "x" << golden.height << std::endl;
+            exitCode = 1;
+        } else {
+            std::cout << "Compare: " << diff.differing << " of " << (size_t) golden.width * golden.height
+                      << " pixels differ by more than " << tolerance << " (max " << diff.maxDifference << ", mean "
+                      << diff.meanDifference << ")" << std::endl;
+            if (heatmapPath != nullptr && !write_ppm(heatmapPath, heatmap)) {
+                exitCode = 1;
+            }
+            if (diff.differing > 0) {
+                exitCode = 1;
+            }
+        }
     }
 
-    glfwTerminate();
-    return 0;
-}
\ No newline at end of file
+    if (headless) {
+        double seconds = renderer.seconds;
+        std::cout << "Rendered " << renderer.frames << " frames in " << seconds * 1000.0 << " ms ("
+                  << (seconds > 0.0 ? renderer.frames / seconds : 0.0) << " fps), " << tick
+                  << " simulation ticks" << std::endl;
+        if (software) {
+            const SoftwareRenderer::Stats &stats = renderer.softwareStats;
+            std::cout << "Software renderer (" << cull_path_name(softwareRenderer.path()) << "): " << stats.draws
+                      << " draws, " << stats.triangles << " triangles in " << stats.binned << " tile bins, set up in "
+                      << stats.setupMs << " ms, rasterized in " << stats.rasterMs << " ms, sorted in "
+                      << renderer.queueStats.sortMs << " ms" << std::endl;
+        } else {
+            std::cout << "State changes per frame: " << renderer.stateCounters.issued << " issued, "
+                      << renderer.stateCounters.elided << " elided" << std::endl;
+            std::cout << "Draw queue: " << renderer.queueStats.draws << " draws, "
+                      << renderer.queueStats.programChanges << " program changes, " << renderer.queueStats.vaoChanges
+                      << " VAO changes, sorted in " << renderer.queueStats.sortMs << " ms" << std::endl;
+            std::cout << "Streamed " << renderer.streamStats.bytesWritten / 1024 << " KiB, "
+                      << renderer.streamStats.waits << " fence waits (" << renderer.streamStats.waitMs << " ms), "
+                      << renderer.streamStats.failures << " failed allocations, " << renderer.instanceUploadFailures
+                      << " frames without instances" << std::endl;
+            const ProgramCache::Stats &cacheStats = programCache.stats();
+            std::cout << "Program cache (" << (programCache.enabled() ? "on" : "off") << "): " << cacheStats.loaded
+                      << " loaded in " << cacheStats.loadMs << " ms, " << cacheStats.compiled << " compiled in "
+                      << cacheStats.compileMs << " ms, " << cacheStats.rejected << " rejected" << std::endl;
+            const ShaderBuilder::Stats &buildStats = shaderBuilder.stats();
+            std::cout << "Shader builds (" << shaderBuilder.modeName() << "): " << buildStats.programs << " programs, "
+                      << buildStats.submitMs << " ms submitting, " << buildStats.waitMs << " ms waiting" << std::endl;
+        }
+        std::cout << "Culling (" << (flatCull ? cull_path_name(instanceCuller.path()) : "bvh") << "): "
+                  << visibleScene.size() << " of " << sceneBounds.size() << " objects and " << visibleInstances.size()
+                  << " of " << instanceBounds.size() << " instances visible, ";
+        if (flatCull) {
+            std::cout << sceneCuller.stats().cullMs + instanceCuller.stats().cullMs << " ms" << std::endl;
+        } else {
+            std::cout << sceneBvh.stats().cullMs + instanceBvh.stats().cullMs << " ms, "
+                      << sceneBvh.stats().nodesVisited + instanceBvh.stats().nodesVisited << " nodes visited, refit in "
+                      << instanceBvh.stats().refitMs << " ms" << std::endl;
+        }
+        if (!occluders.empty()) {
+            std::cout << "Occlusion: " << occlusion.stats().occluded << " of " << occlusion.stats().tested
+                      << " objects and instances hidden by " << occlusion.stats().occluderTriangles
+                      << " occluder triangles, rasterized in " << occlusion.stats().rasterMs << " ms, tested in "
+                      << occlusion.stats().testMs << " ms" << std::endl;
+        }
+        std::cout << "LOD: " << lodTriangles << " of " << fullTriangles << " triangles submitted" << std::endl;
+        JobSystem::Stats jobStats = jobSystem.stats();
+        std::cout << "Jobs: " << jobStats.executed << " executed on " << jobSystem.threadCount() << " threads, "
+                  << jobStats.stolen << " stolen" << std::endl;
+    } else {
+        glfwTerminate();
+    }
+
+    FrameTimeHistogram::Summary frameTimes = renderer.frameTimes.summary();
+    if (frameTimes.frames > 0) {
+        std::cout << "Frame times over " << frameTimes.frames << " frames: p50 " << frameTimes.p50Ms << " ms, p95 "
+                  << frameTimes.p95Ms << " ms, p99 " << frameTimes.p99Ms << " ms, max " << frameTimes.maxMs
+                  << " ms, mean " << frameTimes.meanMs << " ms" << std::endl;
+    }
+    return exitCode;
+}
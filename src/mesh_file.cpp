@@ -0,0 +1,285 @@
+#include "mesh_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(MeshFileHeader) == 48, "MeshFileHeader layout changed");
+static_assert(sizeof(MeshFilePart) == 96, "MeshFilePart layout changed");
+static_assert(sizeof(MeshLod) == 12, "MeshLod layout changed");
+
+static uint64_t align_file_offset(uint64_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+// Largest index in the stream; `data` must be aligned for `type`
+static uint32_t max_index(const void *data, uint32_t count, GLenum type) {
+    uint32_t maxIndex = 0;
+    switch (type) {
+        case GL_UNSIGNED_BYTE: {
+            const auto *bytes = (const unsigned char *) data;
+            for (uint32_t i = 0; i < count; i++) {
+                maxIndex = std::max(maxIndex, (uint32_t) bytes[i]);
+            }
+            break;
+        }
+        case GL_UNSIGNED_SHORT: {
+            const auto *shorts = (const unsigned short *) data;
+            for (uint32_t i = 0; i < count; i++) {
+                maxIndex = std::max(maxIndex, (uint32_t) shorts[i]);
+            }
+            break;
+        }
+        default: {
+            const auto *ints = (const uint32_t *) data;
+            for (uint32_t i = 0; i < count; i++) {
+                maxIndex = std::max(maxIndex, ints[i]);
+            }
+            break;
+        }
+    }
+    return maxIndex;
+}
+
+bool write_mesh_file(const char *path, const std::vector<PackedMesh> &parts) {
+    MeshFileHeader header = {};
+    std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+    header.version = MESH_FILE_VERSION;
+    header.partCount = (uint32_t) parts.size();
+
+    // Lay the streams out after the part table
+    std::vector<MeshFilePart> table(parts.size());
+    uint64_t offset = sizeof(MeshFileHeader) + sizeof(MeshFilePart) * parts.size();
+    for (size_t i = 0; i < parts.size(); i++) {
+        const PackedMesh &mesh = parts[i];
+        MeshFilePart &part = table[i];
+        part.format = (uint32_t) mesh.format;
+        part.indexType = (uint32_t) mesh.indexType;
+        part.vertexCount = (uint32_t) mesh.vertexCount;
+        part.indexCount = (uint32_t) mesh.indexCount;
+        part.lodCount = (uint32_t) mesh.lods.size();
+        if (!mesh.lods.empty()) {
+            part.lodOffset = align_file_offset(offset);
+            offset = part.lodOffset + sizeof(MeshLod) * mesh.lods.size();
+        }
+        part.vertexOffset = align_file_offset(offset);
+        part.indexOffset = align_file_offset(part.vertexOffset + mesh.vertexData.size());
+        offset = part.indexOffset + mesh.indexData.size();
+        for (int axis = 0; axis < 3; axis++) {
+            part.positionScale[axis] = mesh.positionScale[axis];
+            part.positionOffset[axis] = mesh.positionOffset[axis];
+            part.boundsMin[axis] = mesh.boundsMin[axis];
+            part.boundsMax[axis] = mesh.boundsMax[axis];
+            header.boundsMin[axis] = i == 0 ? mesh.boundsMin[axis] : std::min(header.boundsMin[axis],
+                                                                                mesh.boundsMin[axis]);
+            header.boundsMax[axis] = i == 0 ? mesh.boundsMax[axis] : std::max(header.boundsMax[axis],
+                                                                                mesh.boundsMax[axis]);
+        }
+    }
+    header.fileSize = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::MESH_FILE::CANNOT_CREATE " << path << std::endl;
+        return false;
+    }
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) table.data(), (std::streamsize) (sizeof(MeshFilePart) * table.size()));
+
+    static const char padding[MESH_FILE_ALIGNMENT] = {};
+    uint64_t written = sizeof(MeshFileHeader) + sizeof(MeshFilePart) * table.size();
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (!parts[i].lods.empty()) {
+            file.write(padding, (std::streamsize) (table[i].lodOffset - written));
+            file.write((const char *) parts[i].lods.data(), (std::streamsize) (sizeof(MeshLod) * parts[i].lods.size()));
+            written = table[i].lodOffset + sizeof(MeshLod) * parts[i].lods.size();
+        }
+        file.write(padding, (std::streamsize) (table[i].vertexOffset - written));
+        file.write((const char *) parts[i].vertexData.data(), (std::streamsize) parts[i].vertexData.size());
+        written = table[i].vertexOffset + parts[i].vertexData.size();
+        file.write(padding, (std::streamsize) (table[i].indexOffset - written));
+        file.write((const char *) parts[i].indexData.data(), (std::streamsize) parts[i].indexData.size());
+        written = table[i].indexOffset + parts[i].indexData.size();
+    }
+
+    if (!file) {
+        std::cout << "ERROR::MESH_FILE::WRITE_FAILED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MappedMeshFile::~MappedMeshFile() {
+    close();
+}
+
+bool MappedMeshFile::open(const char *path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cout << "ERROR::MESH_FILE::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        std::cout << "ERROR::MESH_FILE::CANNOT_OPEN " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (data == NULL) {
+        std::cout << "ERROR::MESH_FILE::MAP_FAILED " << path << std::endl;
+        if (mapping != NULL) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    size_ = (size_t) fileSize.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cout << "ERROR::MESH_FILE::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        std::cout << "ERROR::MESH_FILE::CANNOT_OPEN " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "ERROR::MESH_FILE::MAP_FAILED " << path << std::endl;
+        return false;
+    }
+    // Uploads read every stream front to back once
+    madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+    size_ = (size_t) info.st_size;
+#endif
+    data_ = (const unsigned char *) data;
+
+    if (!validate(path)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedMeshFile::validate(const char *path) {
+    if (size_ < sizeof(MeshFileHeader)) {
+        std::cout << "ERROR::MESH_FILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+    const MeshFileHeader &fileHeader = header();
+    if (std::memcmp(fileHeader.magic, MESH_FILE_MAGIC, sizeof(fileHeader.magic)) != 0) {
+        std::cout << "ERROR::MESH_FILE::NOT_A_MESH_FILE " << path << std::endl;
+        return false;
+    }
+    if (fileHeader.version != MESH_FILE_VERSION) {
+        std::cout << "ERROR::MESH_FILE::UNSUPPORTED_VERSION " << fileHeader.version << " " << path << std::endl;
+        return false;
+    }
+    if (fileHeader.fileSize != size_ ||
+        (size_ - sizeof(MeshFileHeader)) / sizeof(MeshFilePart) < fileHeader.partCount) {
+        std::cout << "ERROR::MESH_FILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+
+    const auto *table = (const MeshFilePart *) (data_ + sizeof(MeshFileHeader));
+    parts_.resize(fileHeader.partCount);
+    for (uint32_t i = 0; i < fileHeader.partCount; i++) {
+        const MeshFilePart &part = table[i];
+        if (part.format >= VERTEX_FORMAT_COUNT ||
+            (part.indexType != GL_UNSIGNED_BYTE && part.indexType != GL_UNSIGNED_SHORT &&
+             part.indexType != GL_UNSIGNED_INT)) {
+            std::cout << "ERROR::MESH_FILE::BAD_PART " << i << " " << path << std::endl;
+            return false;
+        }
+        uint64_t vertexBytes = (uint64_t) part.vertexCount * vertex_format_stride((VertexFormat) part.format);
+        size_t indexSize = index_type_size(part.indexType);
+        uint64_t indexBytes = (uint64_t) part.indexCount * indexSize;
+        if (part.vertexOffset > size_ || vertexBytes > size_ - part.vertexOffset ||
+            part.indexOffset > size_ || indexBytes > size_ - part.indexOffset || part.indexOffset % indexSize != 0) {
+            std::cout << "ERROR::MESH_FILE::BAD_PART " << i << " " << path << std::endl;
+            return false;
+        }
+        if (part.lodCount > (uint32_t) MAX_MESH_LODS ||
+            (part.lodCount > 0 && (part.lodOffset > size_ || part.lodOffset % alignof(MeshLod) != 0 ||
+                                   sizeof(MeshLod) * part.lodCount > size_ - part.lodOffset))) {
+            std::cout << "ERROR::MESH_FILE::BAD_PART " << i << " " << path << std::endl;
+            return false;
+        }
+        // Every level is a range of the index stream, so checking the whole stream covers them all. A draw never
+        // reads past the part's vertices, whatever the file says.
+        if (part.indexCount > 0 && max_index(data_ + part.indexOffset, part.indexCount, part.indexType) >=
+                                       part.vertexCount) {
+            std::cout << "ERROR::MESH_FILE::INDEX_OUT_OF_RANGE part " << i << " " << path << std::endl;
+            return false;
+        }
+        const auto *lods = part.lodCount > 0 ? (const MeshLod *) (data_ + part.lodOffset) : nullptr;
+        for (uint32_t lod = 0; lod < part.lodCount; lod++) {
+            if (lods[lod].firstIndex > part.indexCount ||
+                lods[lod].indexCount > part.indexCount - lods[lod].firstIndex) {
+                std::cout << "ERROR::MESH_FILE::BAD_PART " << i << " " << path << std::endl;
+                return false;
+            }
+        }
+
+        PackedMeshView &view = parts_[i];
+        view.format = (VertexFormat) part.format;
+        view.vertexCount = (int) part.vertexCount;
+        view.vertexData = data_ + part.vertexOffset;
+        view.indexType = (GLenum) part.indexType;
+        view.indexCount = (int) part.indexCount;
+        view.indexData = data_ + part.indexOffset;
+        view.lods = lods;
+        view.lodCount = (int) part.lodCount;
+        for (int axis = 0; axis < 3; axis++) {
+            view.positionScale[axis] = part.positionScale[axis];
+            view.positionOffset[axis] = part.positionOffset[axis];
+            view.boundsMin[axis] = part.boundsMin[axis];
+            view.boundsMax[axis] = part.boundsMax[axis];
+        }
+    }
+    return true;
+}
+
+void MappedMeshFile::close() {
+    parts_.clear();
+    if (data_ == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle((HANDLE) mapping_);
+    CloseHandle((HANDLE) file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    munmap((void *) data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
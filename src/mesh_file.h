@@ -0,0 +1,84 @@
+#ifndef PROJECT_MESH_FILE_H
+#define PROJECT_MESH_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "packed_mesh.h"
+
+// Binary mesh container holding PackedMesh parts exactly as the arena uploads them, so loading is a memory map and
+// one glBufferSubData per stream with nothing parsed or copied in between:
+//
+//     MeshFileHeader
+//     MeshFilePart[partCount]
+//     per part: MeshLod[lodCount], vertex and index streams, each starting on a MESH_FILE_ALIGNMENT boundary
+//
+// All fields are little endian. Offsets are in bytes from the start of the file.
+static const char MESH_FILE_MAGIC[4] = {'L', 'O', 'G', 'M'};
+// Version 2 added levels of detail
+static const uint32_t MESH_FILE_VERSION = 2;
+static const size_t MESH_FILE_ALIGNMENT = 64;
+
+struct MeshFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t partCount;
+    uint32_t reserved;
+    uint64_t fileSize;
+    // Bounds of all parts together
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct MeshFilePart {
+    uint32_t format;    // VertexFormat
+    uint32_t indexType; // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float positionScale[3];
+    float positionOffset[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    // Levels of detail as ranges of the index stream; zero means the index stream is one level
+    uint32_t lodCount;
+    uint32_t reserved;
+    uint64_t lodOffset;
+};
+
+// Writes the parts to `path`. Returns false (printing why) if the file cannot be written.
+bool write_mesh_file(const char *path, const std::vector<PackedMesh> &parts);
+
+// Read-only memory mapping of a mesh file. The views returned by part() point into the mapping and stay valid
+// until close(). open() checks the header, the part table, every level's range and every index against its part's
+// vertex count, so the views can be uploaded and drawn as they are.
+class MappedMeshFile {
+public:
+    MappedMeshFile() = default;
+    ~MappedMeshFile();
+    MappedMeshFile(const MappedMeshFile &) = delete;
+    MappedMeshFile &operator=(const MappedMeshFile &) = delete;
+
+    bool open(const char *path);
+    void close();
+
+    size_t partCount() const { return parts_.size(); }
+    const PackedMeshView &part(size_t i) const { return parts_[i]; }
+    const MeshFileHeader &header() const { return *(const MeshFileHeader *) data_; }
+    size_t size() const { return size_; }
+
+private:
+    bool validate(const char *path);
+
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+    std::vector<PackedMeshView> parts_;
+};
+
+#endif //PROJECT_MESH_FILE_H
@@ -0,0 +1,930 @@
+#include "mesh_import.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+// OBJ
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skip_spaces(const char *&p, const char *end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+}
+
+// Decimal float with optional sign, fraction and exponent. Much faster than strtof and needs no terminator.
+static bool parse_float(const char *&p, const char *end, float &out) {
+    static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                           1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    skip_spaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    const char *start = p;
+    double value = 0.0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10.0 + (*p - '0');
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        double fraction = 0.0;
+        int digits = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 18) {
+                fraction = fraction * 10.0 + (*p - '0');
+                digits++;
+            }
+            p++;
+        }
+        value += fraction / POWERS_OF_TEN[digits];
+    }
+    if (p == start) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        int exponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            exponent = std::min(exponent * 10 + (*p - '0'), 400);
+            p++;
+        }
+        value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+    }
+    out = (float) (negative ? -value : value);
+    return true;
+}
+
+static bool parse_int(const char *&p, const char *end, long &out) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    const char *start = p;
+    long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        int digit = *p - '0';
+        if (value > (LONG_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        p++;
+    }
+    out = negative ? -value : value;
+    return p != start;
+}
+
+bool parse_obj(const char *text, size_t size, ImportedGeometry &out) {
+    out.positions.clear();
+    out.indices.clear();
+    const char *p = text;
+    const char *end = text + size;
+    int line = 1;
+    std::vector<unsigned int> polygon;
+
+    while (p < end) {
+        skip_spaces(p, end);
+        if (p + 1 < end && p[0] == 'v' && is_space(p[1])) {
+            p += 2;
+            float xyz[3];
+            for (float &component : xyz) {
+                if (!parse_float(p, end, component)) {
+                    std::cout << "ERROR::MESH_IMPORT::OBJ_BAD_VERTEX line " << line << std::endl;
+                    return false;
+                }
+            }
+            out.positions.insert(out.positions.end(), xyz, xyz + 3);
+        } else if (p + 1 < end && p[0] == 'f' && is_space(p[1])) {
+            p += 2;
+            long vertexCount = (long) (out.positions.size() / 3);
+            polygon.clear();
+            skip_spaces(p, end);
+            while (p < end && *p != '\n' && *p != '#') {
+                long index;
+                if (!parse_int(p, end, index) || index == 0) {
+                    std::cout << "ERROR::MESH_IMPORT::OBJ_BAD_FACE line " << line << std::endl;
+                    return false;
+                }
+                // Relative indices count back from the last vertex read so far. Either kind has to name a vertex
+                // already read, which also keeps it within unsigned int.
+                index = index > 0 ? index - 1 : vertexCount + index;
+                if (index < 0 || index >= vertexCount) {
+                    std::cout << "ERROR::MESH_IMPORT::OBJ_BAD_FACE line " << line << std::endl;
+                    return false;
+                }
+                polygon.push_back((unsigned int) index);
+                // Texture coordinate and normal indices are not used
+                while (p < end && !is_space(*p) && *p != '\n') {
+                    p++;
+                }
+                skip_spaces(p, end);
+            }
+            for (size_t corner = 2; corner < polygon.size(); corner++) {
+                out.indices.push_back(polygon[0]);
+                out.indices.push_back(polygon[corner - 1]);
+                out.indices.push_back(polygon[corner]);
+            }
+        }
+
+        // Anything else (normals, groups, materials, comments) is skipped with the rest of the line
+        const char *newline = (const char *) std::memchr(p, '\n', (size_t) (end - p));
+        p = newline != nullptr ? newline + 1 : end;
+        line++;
+    }
+    return true;
+}
+
+// JSON, just enough for glTF
+
+struct JsonValue {
+    enum Type {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    Type type = JSON_NULL;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue *find(const char *key) const {
+        for (const auto &member : members) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double numberOr(const char *key, double fallback) const {
+        const JsonValue *value = find(key);
+        return value != nullptr && value->type == JSON_NUMBER ? value->number : fallback;
+    }
+
+    // A count, offset or length: false unless it is a whole number from 0 to 2^53, the range doubles hold exactly
+    bool sizeOr(const char *key, size_t fallback, size_t &out) const {
+        const JsonValue *value = find(key);
+        if (value == nullptr || value->type != JSON_NUMBER) {
+            out = fallback;
+            return true;
+        }
+        double number = value->number;
+        if (!(number >= 0.0 && number <= 9007199254740992.0) || number != std::floor(number)) {
+            return false;
+        }
+        out = (size_t) number;
+        return (double) out == number;
+    }
+
+    const JsonValue *item(const char *arrayKey, double index) const {
+        const JsonValue *array = find(arrayKey);
+        if (array == nullptr || array->type != JSON_ARRAY || index < 0 || index >= (double) array->items.size()) {
+            return nullptr;
+        }
+        return &array->items[(size_t) index];
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char *text, size_t size) : p_(text), end_(text + size) {}
+
+    bool parse(JsonValue &out) {
+        if (!parseValue(out, 0)) {
+            return false;
+        }
+        skipSpaces();
+        return p_ == end_;
+    }
+
+private:
+    // glTF files nest only a few levels; anything deeper is not one
+    static const int MAX_DEPTH = 64;
+
+    void skipSpaces() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            p_++;
+        }
+    }
+
+    bool literal(const char *word) {
+        size_t length = std::strlen(word);
+        if ((size_t) (end_ - p_) < length || std::memcmp(p_, word, length) != 0) {
+            return false;
+        }
+        p_ += length;
+        return true;
+    }
+
+    static void appendUtf8(std::string &out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out += (char) codepoint;
+        } else if (codepoint < 0x800) {
+            out += (char) (0xC0 | (codepoint >> 6));
+            out += (char) (0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            out += (char) (0xE0 | (codepoint >> 12));
+            out += (char) (0x80 | ((codepoint >> 6) & 0x3F));
+            out += (char) (0x80 | (codepoint & 0x3F));
+        } else {
+            out += (char) (0xF0 | (codepoint >> 18));
+            out += (char) (0x80 | ((codepoint >> 12) & 0x3F));
+            out += (char) (0x80 | ((codepoint >> 6) & 0x3F));
+            out += (char) (0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    bool parseHex4(uint32_t &out) {
+        if (end_ - p_ < 4) {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < 4; i++, p_++) {
+            char c = *p_;
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = (uint32_t) (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = (uint32_t) (c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = (uint32_t) (c - 'A' + 10);
+            } else {
+                return false;
+            }
+            out = out * 16 + digit;
+        }
+        return true;
+    }
+
+    bool parseString(std::string &out) {
+        p_++; // opening quote
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ != '\\') {
+                out += *p_++;
+                continue;
+            }
+            if (++p_ == end_) {
+                return false;
+            }
+            char escape = *p_++;
+            switch (escape) {
+                case '"':
+                case '\\':
+                case '/':
+                    out += escape;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    uint32_t codepoint;
+                    if (!parseHex4(codepoint)) {
+                        return false;
+                    }
+                    // Characters outside the BMP come as a surrogate pair
+                    if (codepoint >= 0xD800 && codepoint < 0xDC00 && literal("\\u")) {
+                        uint32_t low;
+                        if (!parseHex4(low) || low < 0xDC00 || low >= 0xE000) {
+                            return false;
+                        }
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, codepoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        if (p_ == end_) {
+            return false;
+        }
+        p_++; // closing quote
+        return true;
+    }
+
+    bool parseNumber(double &out) {
+        char buffer[64];
+        size_t length = 0;
+        while (p_ < end_ && length + 1 < sizeof(buffer) &&
+               ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' || *p_ == '+' || *p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+            buffer[length++] = *p_++;
+        }
+        buffer[length] = '\0';
+        char *parsedEnd;
+        out = std::strtod(buffer, &parsedEnd);
+        return length > 0 && parsedEnd == buffer + length;
+    }
+
+    bool parseValue(JsonValue &out, int depth) {
+        skipSpaces();
+        if (p_ == end_ || depth > MAX_DEPTH) {
+            return false;
+        }
+        switch (*p_) {
+            case '{': {
+                out.type = JsonValue::JSON_OBJECT;
+                p_++;
+                skipSpaces();
+                if (p_ < end_ && *p_ == '}') {
+                    p_++;
+                    return true;
+                }
+                while (true) {
+                    skipSpaces();
+                    if (p_ == end_ || *p_ != '"') {
+                        return false;
+                    }
+                    out.members.emplace_back();
+                    if (!parseString(out.members.back().first)) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p_ == end_ || *p_++ != ':') {
+                        return false;
+                    }
+                    if (!parseValue(out.members.back().second, depth + 1)) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p_ == end_) {
+                        return false;
+                    }
+                    if (*p_ == '}') {
+                        p_++;
+                        return true;
+                    }
+                    if (*p_++ != ',') {
+                        return false;
+                    }
+                }
+            }
+            case '[': {
+                out.type = JsonValue::JSON_ARRAY;
+                p_++;
+                skipSpaces();
+                if (p_ < end_ && *p_ == ']') {
+                    p_++;
+                    return true;
+                }
+                while (true) {
+                    out.items.emplace_back();
+                    if (!parseValue(out.items.back(), depth + 1)) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p_ == end_) {
+                        return false;
+                    }
+                    if (*p_ == ']') {
+                        p_++;
+                        return true;
+                    }
+                    if (*p_++ != ',') {
+                        return false;
+                    }
+                }
+            }
+            case '"':
+                out.type = JsonValue::JSON_STRING;
+                return parseString(out.string);
+            case 't':
+                out.type = JsonValue::JSON_BOOL;
+                out.number = 1.0;
+                return literal("true");
+            case 'f':
+                out.type = JsonValue::JSON_BOOL;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                out.type = JsonValue::JSON_NUMBER;
+                return parseNumber(out.number);
+        }
+    }
+
+    const char *p_;
+    const char *end_;
+};
+
+// glTF
+
+static const int GLTF_BYTE = 5120;
+static const int GLTF_UNSIGNED_BYTE = 5121;
+static const int GLTF_SHORT = 5122;
+static const int GLTF_UNSIGNED_SHORT = 5123;
+static const int GLTF_UNSIGNED_INT = 5125;
+static const int GLTF_FLOAT = 5126;
+static const int GLTF_TRIANGLES = 4;
+
+static const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+static const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+static bool read_file(const std::string &path, std::string &out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamoff size = file.tellg();
+    if (size < 0) {
+        return false;
+    }
+    out.resize((size_t) size);
+    file.seekg(0);
+    file.read(&out[0], size);
+    return (bool) file;
+}
+
+static bool decode_base64(const char *text, size_t size, std::string &out) {
+    out.clear();
+    out.reserve(size / 4 * 3);
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (size_t i = 0; i < size; i++) {
+        char c = text[i];
+        uint32_t digit;
+        if (c >= 'A' && c <= 'Z') {
+            digit = (uint32_t) (c - 'A');
+        } else if (c >= 'a' && c <= 'z') {
+            digit = (uint32_t) (c - 'a' + 26);
+        } else if (c >= '0' && c <= '9') {
+            digit = (uint32_t) (c - '0' + 52);
+        } else if (c == '+' || c == '-') {
+            digit = 62;
+        } else if (c == '/' || c == '_') {
+            digit = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        bits = (bits << 6) | digit;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            out += (char) ((bits >> bitCount) & 0xFF);
+        }
+    }
+    return true;
+}
+
+// Column-major 4x4, as glTF stores them
+struct Matrix4 {
+    float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+};
+
+static Matrix4 multiply(const Matrix4 &a, const Matrix4 &b) {
+    Matrix4 result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            }
+            result.m[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+static float determinant3(const Matrix4 &a) {
+    return a.m[0] * (a.m[5] * a.m[10] - a.m[9] * a.m[6]) -
+           a.m[4] * (a.m[1] * a.m[10] - a.m[9] * a.m[2]) +
+           a.m[8] * (a.m[1] * a.m[6] - a.m[5] * a.m[2]);
+}
+
+static Matrix4 node_transform(const JsonValue &node) {
+    Matrix4 result;
+    const JsonValue *matrix = node.find("matrix");
+    if (matrix != nullptr && matrix->type == JsonValue::JSON_ARRAY && matrix->items.size() == 16) {
+        for (int i = 0; i < 16; i++) {
+            result.m[i] = (float) matrix->items[i].number;
+        }
+        return result;
+    }
+
+    float t[3] = {0, 0, 0}, r[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+    auto readArray = [&](const char *key, float *values, size_t count) {
+        const JsonValue *array = node.find(key);
+        if (array != nullptr && array->type == JsonValue::JSON_ARRAY && array->items.size() == count) {
+            for (size_t i = 0; i < count; i++) {
+                values[i] = (float) array->items[i].number;
+            }
+        }
+    };
+    readArray("translation", t, 3);
+    readArray("rotation", r, 4);
+    readArray("scale", s, 3);
+
+    // T * R * S, with R from the unit quaternion (x, y, z, w)
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    float rotation[9] = {
+            1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+            2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+            2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y)
+    };
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            result.m[column * 4 + row] = rotation[column * 3 + row] * s[column];
+        }
+    }
+    result.m[12] = t[0];
+    result.m[13] = t[1];
+    result.m[14] = t[2];
+    return result;
+}
+
+// Strided view of accessor data inside a buffer, checked against the buffer bounds
+struct AccessorData {
+    const unsigned char *data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentType = 0;
+    int components = 0;
+};
+
+static size_t component_size(int componentType) {
+    switch (componentType) {
+        case GLTF_BYTE:
+        case GLTF_UNSIGNED_BYTE:
+            return 1;
+        case GLTF_SHORT:
+        case GLTF_UNSIGNED_SHORT:
+            return 2;
+        case GLTF_UNSIGNED_INT:
+        case GLTF_FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static int type_components(const std::string &type) {
+    if (type == "SCALAR") {
+        return 1;
+    }
+    if (type == "VEC2") {
+        return 2;
+    }
+    if (type == "VEC3") {
+        return 3;
+    }
+    if (type == "VEC4") {
+        return 4;
+    }
+    return 0;
+}
+
+static bool resolve_accessor(const JsonValue &root, const std::vector<std::string> &buffers, double index,
+                             AccessorData &out) {
+    const JsonValue *accessor = root.item("accessors", index);
+    if (accessor == nullptr || accessor->find("sparse") != nullptr) {
+        return false;
+    }
+    const JsonValue *type = accessor->find("type");
+    out.componentType = (int) accessor->numberOr("componentType", 0);
+    out.components = type != nullptr ? type_components(type->string) : 0;
+    size_t elementSize = component_size(out.componentType) * (size_t) out.components;
+    if (elementSize == 0 || !accessor->sizeOr("count", 0, out.count)) {
+        return false;
+    }
+
+    const JsonValue *view = root.item("bufferViews", accessor->numberOr("bufferView", -1));
+    if (view == nullptr) {
+        return false;
+    }
+    double bufferIndex = view->numberOr("buffer", -1);
+    if (bufferIndex < 0 || bufferIndex >= (double) buffers.size()) {
+        return false;
+    }
+    const std::string &buffer = buffers[(size_t) bufferIndex];
+    size_t viewOffset, viewLength, accessorOffset;
+    if (!view->sizeOr("byteOffset", 0, viewOffset) || !view->sizeOr("byteLength", 0, viewLength) ||
+        !accessor->sizeOr("byteOffset", 0, accessorOffset) || !view->sizeOr("byteStride", 0, out.stride)) {
+        return false;
+    }
+    // The spec's limits on byteStride: no smaller than an element, at most 252 and a multiple of 4
+    if (out.stride == 0) {
+        out.stride = elementSize;
+    } else if (out.stride < elementSize || out.stride > 252 || out.stride % 4 != 0) {
+        return false;
+    }
+    if (viewOffset > buffer.size() || viewLength > buffer.size() - viewOffset) {
+        return false;
+    }
+    // Divided rather than multiplied out, so a large count cannot wrap around
+    if (out.count > 0 && (accessorOffset > viewLength || elementSize > viewLength - accessorOffset ||
+                          out.count - 1 > (viewLength - accessorOffset - elementSize) / out.stride)) {
+        return false;
+    }
+    out.data = (const unsigned char *) buffer.data() + viewOffset + accessorOffset;
+    return true;
+}
+
+static bool load_gltf_buffers(const JsonValue &root, const std::string &baseDirectory, const char *glbBinary,
+                              size_t glbBinarySize, std::vector<std::string> &buffers) {
+    const JsonValue *bufferList = root.find("buffers");
+    if (bufferList == nullptr) {
+        return true;
+    }
+    for (size_t i = 0; i < bufferList->items.size(); i++) {
+        const JsonValue &buffer = bufferList->items[i];
+        const JsonValue *uri = buffer.find("uri");
+        size_t byteLength;
+        if (!buffer.sizeOr("byteLength", 0, byteLength)) {
+            std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_BUFFER " << i << std::endl;
+            return false;
+        }
+        buffers.emplace_back();
+        std::string &data = buffers.back();
+
+        if (uri == nullptr) {
+            // The first buffer of a .glb without a uri is the binary chunk
+            if (i != 0 || glbBinary == nullptr) {
+                std::cout << "ERROR::MESH_IMPORT::GLTF_MISSING_BUFFER " << i << std::endl;
+                return false;
+            }
+            data.assign(glbBinary, glbBinarySize);
+        } else if (uri->string.compare(0, 5, "data:") == 0) {
+            size_t comma = uri->string.find(',');
+            if (comma == std::string::npos || uri->string.rfind(";base64", comma) == std::string::npos ||
+                !decode_base64(uri->string.data() + comma + 1, uri->string.size() - comma - 1, data)) {
+                std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_DATA_URI " << i << std::endl;
+                return false;
+            }
+        } else if (!read_file(baseDirectory + uri->string, data)) {
+            std::cout << "ERROR::MESH_IMPORT::GLTF_MISSING_BUFFER " << baseDirectory + uri->string << std::endl;
+            return false;
+        }
+
+        if (data.size() < byteLength) {
+            std::cout << "ERROR::MESH_IMPORT::GLTF_SHORT_BUFFER " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool append_primitive(const JsonValue &root, const std::vector<std::string> &buffers,
+                             const JsonValue &primitive, const Matrix4 &transform, ImportedGeometry &out) {
+    if (primitive.numberOr("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+        // Points and lines have nothing to fill
+        return true;
+    }
+    const JsonValue *attributes = primitive.find("attributes");
+    const JsonValue *position = attributes != nullptr ? attributes->find("POSITION") : nullptr;
+    AccessorData positions;
+    if (position == nullptr || !resolve_accessor(root, buffers, position->number, positions) ||
+        positions.componentType != GLTF_FLOAT || positions.components != 3) {
+        std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_POSITIONS" << std::endl;
+        return false;
+    }
+
+    unsigned int base = (unsigned int) (out.positions.size() / 3);
+    out.positions.reserve(out.positions.size() + positions.count * 3);
+    for (size_t i = 0; i < positions.count; i++) {
+        float p[3];
+        std::memcpy(p, positions.data + i * positions.stride, sizeof(p));
+        for (int row = 0; row < 3; row++) {
+            out.positions.push_back(transform.m[row] * p[0] + transform.m[4 + row] * p[1] +
+                                    transform.m[8 + row] * p[2] + transform.m[12 + row]);
+        }
+    }
+
+    size_t firstIndex = out.indices.size();
+    const JsonValue *indicesAccessor = primitive.find("indices");
+    if (indicesAccessor == nullptr) {
+        for (size_t i = 0; i + 2 < positions.count; i += 3) {
+            out.indices.push_back(base + (unsigned int) i);
+            out.indices.push_back(base + (unsigned int) i + 1);
+            out.indices.push_back(base + (unsigned int) i + 2);
+        }
+    } else {
+        AccessorData indices;
+        if (!resolve_accessor(root, buffers, indicesAccessor->number, indices) || indices.components != 1 ||
+            (indices.componentType != GLTF_UNSIGNED_BYTE && indices.componentType != GLTF_UNSIGNED_SHORT &&
+             indices.componentType != GLTF_UNSIGNED_INT)) {
+            std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_INDICES" << std::endl;
+            return false;
+        }
+        // A trailing partial triangle is dropped
+        size_t usable = indices.count / 3 * 3;
+        out.indices.reserve(out.indices.size() + usable);
+        for (size_t i = 0; i < usable; i++) {
+            const unsigned char *element = indices.data + i * indices.stride;
+            unsigned int index;
+            if (indices.componentType == GLTF_UNSIGNED_BYTE) {
+                index = element[0];
+            } else if (indices.componentType == GLTF_UNSIGNED_SHORT) {
+                uint16_t value;
+                std::memcpy(&value, element, sizeof(value));
+                index = value;
+            } else {
+                std::memcpy(&index, element, sizeof(index));
+            }
+            if (index >= positions.count) {
+                std::cout << "ERROR::MESH_IMPORT::GLTF_INDEX_OUT_OF_RANGE " << index << std::endl;
+                return false;
+            }
+            out.indices.push_back(base + index);
+        }
+    }
+
+    // A mirroring transform turns the winding around
+    if (determinant3(transform) < 0.0f) {
+        for (size_t i = firstIndex; i + 2 < out.indices.size(); i += 3) {
+            std::swap(out.indices[i + 1], out.indices[i + 2]);
+        }
+    }
+    return true;
+}
+
+static bool append_mesh(const JsonValue &root, const std::vector<std::string> &buffers, double meshIndex,
+                        const Matrix4 &transform, ImportedGeometry &out) {
+    const JsonValue *mesh = root.item("meshes", meshIndex);
+    const JsonValue *primitives = mesh != nullptr ? mesh->find("primitives") : nullptr;
+    if (primitives == nullptr) {
+        std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_MESH " << meshIndex << std::endl;
+        return false;
+    }
+    for (const JsonValue &primitive : primitives->items) {
+        if (!append_primitive(root, buffers, primitive, transform, out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool append_node(const JsonValue &root, const std::vector<std::string> &buffers, double nodeIndex,
+                        const Matrix4 &parent, int depth, ImportedGeometry &out) {
+    const JsonValue *node = root.item("nodes", nodeIndex);
+    // Node graphs must be trees; the depth limit also stops cycles in broken files
+    if (node == nullptr || depth > 256) {
+        std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_NODE " << nodeIndex << std::endl;
+        return false;
+    }
+    Matrix4 transform = multiply(parent, node_transform(*node));
+    const JsonValue *mesh = node->find("mesh");
+    if (mesh != nullptr && !append_mesh(root, buffers, mesh->number, transform, out)) {
+        return false;
+    }
+    const JsonValue *children = node->find("children");
+    if (children != nullptr) {
+        for (const JsonValue &child : children->items) {
+            if (!append_node(root, buffers, child.number, transform, depth + 1, out)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool parse_gltf(const char *data, size_t size, const std::string &baseDirectory, ImportedGeometry &out) {
+    out.positions.clear();
+    out.indices.clear();
+
+    const char *json = data;
+    size_t jsonSize = size;
+    const char *binary = nullptr;
+    size_t binarySize = 0;
+
+    uint32_t magic = 0;
+    if (size >= 4) {
+        std::memcpy(&magic, data, sizeof(magic));
+    }
+    if (magic == GLB_MAGIC) {
+        // 12-byte header, then chunks of (length, type, data padded to 4 bytes)
+        json = nullptr;
+        size_t offset = 12;
+        while (offset + 8 <= size) {
+            uint32_t chunk[2];
+            std::memcpy(chunk, data + offset, sizeof(chunk));
+            offset += 8;
+            if (chunk[0] > size - offset) {
+                break;
+            }
+            if (chunk[1] == GLB_CHUNK_JSON && json == nullptr) {
+                json = data + offset;
+                jsonSize = chunk[0];
+            } else if (chunk[1] == GLB_CHUNK_BIN && binary == nullptr) {
+                binary = data + offset;
+                binarySize = chunk[0];
+            }
+            offset += (chunk[0] + 3) & ~3u;
+        }
+        if (json == nullptr) {
+            std::cout << "ERROR::MESH_IMPORT::GLB_MISSING_JSON" << std::endl;
+            return false;
+        }
+    }
+
+    JsonValue root;
+    if (!JsonParser(json, jsonSize).parse(root) || root.type != JsonValue::JSON_OBJECT) {
+        std::cout << "ERROR::MESH_IMPORT::GLTF_BAD_JSON" << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> buffers;
+    if (!load_gltf_buffers(root, baseDirectory, binary, binarySize, buffers)) {
+        return false;
+    }
+
+    Matrix4 identity;
+    const JsonValue *scene = root.item("scenes", root.numberOr("scene", 0));
+    if (scene == nullptr) {
+        const JsonValue *meshes = root.find("meshes");
+        for (size_t i = 0; meshes != nullptr && i < meshes->items.size(); i++) {
+            if (!append_mesh(root, buffers, (double) i, identity, out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const JsonValue *nodes = scene->find("nodes");
+    if (nodes != nullptr) {
+        for (const JsonValue &node : nodes->items) {
+            if (!append_node(root, buffers, node.number, identity, 0, out)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool has_extension(const std::string &path, const char *extension) {
+    size_t length = std::strlen(extension);
+    if (path.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = path[path.size() - length + i];
+        if (c >= 'A' && c <= 'Z') {
+            c = (char) (c - 'A' + 'a');
+        }
+        if (c != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool import_geometry(const std::string &path, ImportedGeometry &out) {
+    std::string data;
+    if (!read_file(path, data)) {
+        std::cout << "ERROR::MESH_IMPORT::CANNOT_READ " << path << std::endl;
+        return false;
+    }
+
+    bool parsed;
+    if (has_extension(path, ".obj")) {
+        parsed = parse_obj(data.data(), data.size(), out);
+    } else if (has_extension(path, ".gltf") || has_extension(path, ".glb")) {
+        size_t slash = path.find_last_of("/\\");
+        parsed = parse_gltf(data.data(), data.size(), slash == std::string::npos ? "" : path.substr(0, slash + 1),
+                            out);
+    } else {
+        std::cout << "ERROR::MESH_IMPORT::UNKNOWN_FORMAT " << path << std::endl;
+        return false;
+    }
+    if (!parsed) {
+        std::cout << "ERROR::MESH_IMPORT::PARSE_FAILED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef PROJECT_MESH_IMPORT_H
+#define PROJECT_MESH_IMPORT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Triangle geometry read from a model file: tightly packed xyz float positions and triangle list indices. Only
+// positions are kept since that is all the renderer draws.
+struct ImportedGeometry {
+    std::vector<float> positions;
+    std::vector<unsigned int> indices;
+};
+
+// Wavefront OBJ. Reads `v` and `f` records; polygons are triangulated as fans and negative (relative) indices are
+// resolved. Everything else is ignored.
+bool parse_obj(const char *text, size_t size, ImportedGeometry &out);
+
+// glTF 2.0, either JSON (.gltf, with embedded base64 or external buffers relative to `baseDirectory`) or binary
+// (.glb). Every triangle primitive of the default scene is flattened into one mesh with its node transforms
+// applied; without a scene all meshes are taken as they are.
+bool parse_gltf(const char *data, size_t size, const std::string &baseDirectory, ImportedGeometry &out);
+
+// Reads `path` and picks the parser by extension (.obj, .gltf, .glb). Returns false (printing why) on failure.
+bool import_geometry(const std::string &path, ImportedGeometry &out);
+
+#endif //PROJECT_MESH_IMPORT_H
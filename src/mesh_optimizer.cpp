@@ -0,0 +1,300 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+VertexCacheStats analyze_vertex_cache(const unsigned int *indices, size_t indexCount, size_t vertexCount,
+                                      unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0) {
+        return stats;
+    }
+
+    // A vertex is in the FIFO if it was pushed less than cacheSize pushes ago
+    std::vector<size_t> pushedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t pushes = 0;
+    size_t uniqueVertices = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int vertex = indices[i];
+        if (!referenced[vertex]) {
+            referenced[vertex] = true;
+            uniqueVertices++;
+        }
+        if (pushedAt[vertex] == 0 || pushes - pushedAt[vertex] >= cacheSize) {
+            pushes++;
+            pushedAt[vertex] = pushes;
+        }
+    }
+
+    stats.acmr = (float) pushes / (float) (indexCount / 3);
+    stats.atvr = (float) pushes / (float) uniqueVertices;
+    return stats;
+}
+
+namespace {
+    struct Adjacency {
+        std::vector<unsigned int> offsets;   // per vertex, into triangles
+        std::vector<unsigned int> triangles; // triangles using each vertex
+        std::vector<unsigned int> liveCount; // triangles using each vertex that have not been emitted yet
+    };
+
+    void build_adjacency(Adjacency &adjacency, const unsigned int *indices, size_t indexCount, size_t vertexCount) {
+        adjacency.liveCount.assign(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++) {
+            adjacency.liveCount[indices[i]]++;
+        }
+
+        adjacency.offsets.assign(vertexCount + 1, 0);
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            adjacency.offsets[vertex + 1] = adjacency.offsets[vertex] + adjacency.liveCount[vertex];
+        }
+
+        adjacency.triangles.resize(indexCount);
+        std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++) {
+            adjacency.triangles[fill[indices[i]]++] = (unsigned int) (i / 3);
+        }
+    }
+}
+
+void optimize_vertex_cache(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                           size_t vertexCount, unsigned int cacheSize, std::vector<size_t> *clusters) {
+    size_t triangleCount = indexCount / 3;
+    if (clusters != nullptr) {
+        clusters->clear();
+    }
+    if (triangleCount == 0) {
+        return;
+    }
+
+    Adjacency adjacency;
+    build_adjacency(adjacency, indices, indexCount, vertexCount);
+
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    deadEnd.reserve(indexCount);
+    std::vector<unsigned int> candidates;
+
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;   // next vertex to try when we run out of dead-end candidates
+    size_t written = 0;
+
+    // Start with the first vertex that has any triangles
+    long fan = 0;
+    while (fan < (long) vertexCount && adjacency.liveCount[fan] == 0) {
+        fan++;
+    }
+    if (clusters != nullptr) {
+        clusters->push_back(0);
+    }
+
+    while (fan >= 0 && fan < (long) vertexCount) {
+        candidates.clear();
+
+        for (unsigned int k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; k++) {
+            unsigned int triangle = adjacency.triangles[k];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = indices[triangle * 3 + corner];
+                destination[written++] = vertex;
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                adjacency.liveCount[vertex]--;
+                if (time - timestamps[vertex] > cacheSize) {
+                    timestamps[vertex] = time++;
+                }
+            }
+        }
+
+        // Prefer a vertex from the triangles we just emitted that is still in the cache and will stay there
+        long best = -1;
+        int bestPriority = -1;
+        for (unsigned int vertex : candidates) {
+            if (adjacency.liveCount[vertex] == 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - timestamps[vertex] + 2 * adjacency.liveCount[vertex] <= cacheSize) {
+                priority = (int) (time - timestamps[vertex]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = vertex;
+            }
+        }
+
+        if (best < 0) {
+            // Dead end: fall back to recently used vertices, then scan forwards through the mesh
+            while (!deadEnd.empty() && best < 0) {
+                unsigned int vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (adjacency.liveCount[vertex] > 0) {
+                    best = vertex;
+                }
+            }
+            while (best < 0 && cursor < vertexCount) {
+                if (adjacency.liveCount[cursor] > 0) {
+                    best = (long) cursor;
+                }
+                cursor++;
+            }
+            if (best >= 0 && clusters != nullptr) {
+                clusters->push_back(written / 3);
+            }
+        }
+        fan = best;
+    }
+}
+
+void optimize_overdraw(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                       const float *positions, size_t vertexCount, const std::vector<size_t> &clusters,
+                       unsigned int cacheSize, float threshold) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Split the hard clusters further at soft boundaries. Once sorted, every cluster starts with a cold cache, so a
+    // cut is only made where the cluster so far, simulated from a cold cache, is within threshold * the overall
+    // ACMR. That bounds how much cache efficiency the reordering can cost.
+    float targetAcmr = analyze_vertex_cache(indices, indexCount, vertexCount, cacheSize).acmr * threshold;
+    std::vector<size_t> boundaries;
+    std::vector<size_t> pushedAt(vertexCount, 0);
+    size_t pushes = 0;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        size_t clusterStart = begin;
+        size_t clusterMisses = 0;
+        size_t clusterFirstPush = pushes;
+        boundaries.push_back(begin);
+
+        for (size_t triangle = begin; triangle < end; triangle++) {
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = indices[triangle * 3 + corner];
+                if (pushedAt[vertex] <= clusterFirstPush || pushes - pushedAt[vertex] >= cacheSize) {
+                    pushes++;
+                    pushedAt[vertex] = pushes;
+                    clusterMisses++;
+                }
+            }
+            size_t clusterTriangles = triangle + 1 - clusterStart;
+            if (triangle + 1 < end && (float) clusterMisses / (float) clusterTriangles <= targetAcmr) {
+                boundaries.push_back(triangle + 1);
+                clusterStart = triangle + 1;
+                clusterMisses = 0;
+                clusterFirstPush = pushes;
+            }
+        }
+    }
+
+    // Mesh centroid, then per-cluster area-weighted centroid and normal
+    float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        for (int axis = 0; axis < 3; axis++) {
+            meshCenter[axis] += positions[vertex * 3 + axis];
+        }
+    }
+    for (float &component : meshCenter) {
+        component /= (float) vertexCount;
+    }
+
+    struct Cluster {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted;
+    sorted.reserve(boundaries.size());
+    for (size_t c = 0; c < boundaries.size(); c++) {
+        Cluster cluster{boundaries[c], c + 1 < boundaries.size() ? boundaries[c + 1] : triangleCount, 0.0f};
+
+        float center[3] = {0.0f, 0.0f, 0.0f};
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        float totalArea = 0.0f;
+        for (size_t triangle = cluster.begin; triangle < cluster.end; triangle++) {
+            const float *a = positions + (size_t) indices[triangle * 3] * 3;
+            const float *b = positions + (size_t) indices[triangle * 3 + 1] * 3;
+            const float *c2 = positions + (size_t) indices[triangle * 3 + 2] * 3;
+            float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float e2[3] = {c2[0] - a[0], c2[1] - a[1], c2[2] - a[2]};
+            // Cross product length is twice the area, which is all we need for weighting
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int axis = 0; axis < 3; axis++) {
+                center[axis] += (a[axis] + b[axis] + c2[axis]) * area / 3.0f;
+                normal[axis] += n[axis];
+            }
+            totalArea += area;
+        }
+        if (totalArea > 0.0f) {
+            float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            for (int axis = 0; axis < 3; axis++) {
+                center[axis] /= totalArea;
+                float direction = normalLength > 0.0f ? normal[axis] / normalLength : 0.0f;
+                cluster.sortKey += (center[axis] - meshCenter[axis]) * direction;
+            }
+        }
+        sorted.push_back(cluster);
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    size_t written = 0;
+    for (const Cluster &cluster : sorted) {
+        size_t count = (cluster.end - cluster.begin) * 3;
+        std::memcpy(destination + written, indices + cluster.begin * 3, count * sizeof(unsigned int));
+        written += count;
+    }
+}
+
+size_t optimize_vertex_fetch(float *destinationPositions, unsigned int *indices, size_t indexCount,
+                             const float *positions, size_t vertexCount) {
+    std::vector<unsigned int> remap(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int vertex = indices[i];
+        if (remap[vertex] == ~0u) {
+            remap[vertex] = next;
+            std::memcpy(destinationPositions + (size_t) next * 3, positions + (size_t) vertex * 3, 3 * sizeof(float));
+            next++;
+        }
+        indices[i] = remap[vertex];
+    }
+    return next;
+}
+
+MeshOptimizeReport optimize_mesh(std::vector<float> &positions, std::vector<unsigned int> &indices,
+                                 unsigned int cacheSize) {
+    MeshOptimizeReport report;
+    size_t vertexCount = positions.size() / 3;
+    size_t indexCount = indices.size() - indices.size() % 3;
+    report.before = analyze_vertex_cache(indices.data(), indexCount, vertexCount, cacheSize);
+
+    std::vector<unsigned int> cacheOrder(indexCount);
+    std::vector<size_t> clusters;
+    optimize_vertex_cache(cacheOrder.data(), indices.data(), indexCount, vertexCount, cacheSize, &clusters);
+    report.clusters = clusters.size();
+
+    indices.resize(indexCount);
+    optimize_overdraw(indices.data(), cacheOrder.data(), indexCount, positions.data(), vertexCount, clusters,
+                      cacheSize);
+
+    std::vector<float> fetchOrder(positions.size());
+    size_t usedVertices = optimize_vertex_fetch(fetchOrder.data(), indices.data(), indexCount, positions.data(),
+                                                vertexCount);
+    fetchOrder.resize(usedVertices * 3);
+    positions.swap(fetchOrder);
+
+    report.after = analyze_vertex_cache(indices.data(), indexCount, usedVertices, cacheSize);
+    return report;
+}
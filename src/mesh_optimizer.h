@@ -0,0 +1,47 @@
+#ifndef PROJECT_MESH_OPTIMIZER_H
+#define PROJECT_MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+// Index/vertex reordering applied to meshes before they are uploaded. All functions work on indexed triangle lists
+// with tightly packed xyz float positions.
+
+// Post-transform vertex cache efficiency, measured with a FIFO cache simulation
+struct VertexCacheStats {
+    float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle (0.5 is ideal for big grids)
+    float atvr = 0.0f; // average transformed vertex ratio: transformed vertices per unique vertex (1.0 is ideal)
+};
+
+struct MeshOptimizeReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t clusters = 0;
+};
+
+VertexCacheStats analyze_vertex_cache(const unsigned int *indices, size_t indexCount, size_t vertexCount,
+                                      unsigned int cacheSize = 16);
+
+// Tipsify (Sander, Nehab & Barczak 2007): reorders triangles for a FIFO cache of the given size in linear time.
+// If `clusters` is given it receives the triangle offsets at which the algorithm had to jump to an unrelated part
+// of the mesh; those are the natural boundaries for optimize_overdraw().
+void optimize_vertex_cache(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                           size_t vertexCount, unsigned int cacheSize = 16, std::vector<size_t> *clusters = nullptr);
+
+// Reorders whole clusters so that the ones facing outwards from the mesh center come first, which lets early depth
+// testing reject more of the rest. Clusters are further split wherever that costs at most `threshold` times the
+// current ACMR, trading a little cache efficiency for finer-grained sorting.
+void optimize_overdraw(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                       const float *positions, size_t vertexCount, const std::vector<size_t> &clusters,
+                       unsigned int cacheSize = 16, float threshold = 1.05f);
+
+// Renumbers vertices in the order they are first referenced, so vertex fetch walks memory linearly. Vertices that
+// are never referenced are dropped. Indices are remapped in place; returns the new vertex count.
+size_t optimize_vertex_fetch(float *destinationPositions, unsigned int *indices, size_t indexCount,
+                             const float *positions, size_t vertexCount);
+
+// Runs all three stages on the mesh in place and reports the cache statistics before and after
+MeshOptimizeReport optimize_mesh(std::vector<float> &positions, std::vector<unsigned int> &indices,
+                                 unsigned int cacheSize = 16);
+
+#endif //PROJECT_MESH_OPTIMIZER_H
@@ -0,0 +1,385 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "mesh_optimizer.h"
+
+// Border planes are weighted this much more than surface planes, so open edges keep their outline
+static const double BORDER_WEIGHT = 10.0;
+// A level is only kept when it has at most this fraction of the previous level's indices
+static const float LOD_MIN_REDUCTION = 0.9f;
+
+namespace {
+    // Symmetric 4x4 quadric: p^T A p + 2 b.p + c, and the area it was accumulated over
+    struct Quadric {
+        double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double weight = 0;
+
+        void addPlane(const double n[3], double d, double w) {
+            a00 += w * n[0] * n[0];
+            a11 += w * n[1] * n[1];
+            a22 += w * n[2] * n[2];
+            a01 += w * n[0] * n[1];
+            a02 += w * n[0] * n[2];
+            a12 += w * n[1] * n[2];
+            b0 += w * n[0] * d;
+            b1 += w * n[1] * d;
+            b2 += w * n[2] * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &other) {
+            a00 += other.a00;
+            a11 += other.a11;
+            a22 += other.a22;
+            a01 += other.a01;
+            a02 += other.a02;
+            a12 += other.a12;
+            b0 += other.b0;
+            b1 += other.b1;
+            b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // Weighted sum of squared distances to the planes
+        double evaluate(const float p[3]) const {
+            double x = p[0], y = p[1], z = p[2];
+            return a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                   2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        }
+    };
+
+    enum VertexKind : unsigned char {
+        VERTEX_INTERIOR = 0,
+        VERTEX_BORDER = 1, // on exactly one open border loop; may only slide along it
+        VERTEX_LOCKED = 2  // border corners, non-manifold vertices
+    };
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        double error; // squared distance
+    };
+}
+
+static void cross(const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double length(const double v[3]) {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static void difference(const float *a, const float *b, double out[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        out[axis] = (double) a[axis] - (double) b[axis];
+    }
+}
+
+// Maps every referenced vertex to the lowest referenced vertex with the same position. Unreferenced vertices map to
+// themselves, so welding never pulls in a vertex the mesh did not use.
+static std::vector<unsigned int> weld_positions(const unsigned int *indices, size_t indexCount, const float *positions,
+                                                size_t vertexCount) {
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<unsigned char> referenced(vertexCount, 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+        remap[i] = (unsigned int) i;
+    }
+    for (size_t i = 0; i < indexCount; i++) {
+        referenced[indices[i]] = 1;
+    }
+    std::vector<unsigned int> order;
+    for (size_t i = 0; i < vertexCount; i++) {
+        if (referenced[i]) {
+            order.push_back((unsigned int) i);
+        }
+    }
+    auto samePosition = [&](unsigned int a, unsigned int b) {
+        return positions[a * 3] == positions[b * 3] && positions[a * 3 + 1] == positions[b * 3 + 1] &&
+               positions[a * 3 + 2] == positions[b * 3 + 2];
+    };
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (positions[a * 3 + axis] != positions[b * 3 + axis]) {
+                return positions[a * 3 + axis] < positions[b * 3 + axis];
+            }
+        }
+        return a < b;
+    });
+    for (size_t i = 1; i < order.size(); i++) {
+        if (samePosition(order[i - 1], order[i])) {
+            remap[order[i]] = remap[order[i - 1]];
+        }
+    }
+    return remap;
+}
+
+size_t simplify_mesh(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                     const float *positions, size_t vertexCount, size_t targetIndexCount, float targetError,
+                     float *resultError) {
+    if (resultError != nullptr) {
+        *resultError = 0.0f;
+    }
+    std::vector<unsigned int> remap = weld_positions(indices, indexCount, positions, vertexCount);
+
+    // Work on welded triangles, dropping any that are already degenerate
+    std::vector<unsigned int> triangles;
+    triangles.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (a != b && b != c && c != a) {
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+        }
+    }
+
+    // Directed edges; one without its opposite lies on an open border
+    std::vector<uint64_t> edges;
+    edges.reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+        for (int corner = 0; corner < 3; corner++) {
+            uint64_t from = triangles[i + corner], to = triangles[i + (corner + 1) % 3];
+            edges.push_back(from << 32 | to);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    auto hasEdge = [&](unsigned int from, unsigned int to) {
+        return std::binary_search(edges.begin(), edges.end(), (uint64_t) from << 32 | to);
+    };
+
+    std::vector<unsigned char> kind(vertexCount, VERTEX_INTERIOR);
+    std::vector<unsigned int> borderNext(vertexCount, ~0u), borderPrevious(vertexCount, ~0u);
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < edges.size(); i++) {
+        auto from = (unsigned int) (edges[i] >> 32), to = (unsigned int) edges[i];
+        if (i > 0 && edges[i] == edges[i - 1]) {
+            // The same directed edge twice: non-manifold or inconsistently wound
+            kind[from] = kind[to] = VERTEX_LOCKED;
+            continue;
+        }
+        if (hasEdge(to, from)) {
+            continue;
+        }
+        if (borderNext[from] != ~0u || borderPrevious[to] != ~0u) {
+            kind[from] = kind[to] = VERTEX_LOCKED;
+        }
+        borderNext[from] = to;
+        borderPrevious[to] = from;
+    }
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        if (kind[vertex] == VERTEX_INTERIOR && (borderNext[vertex] != ~0u || borderPrevious[vertex] != ~0u)) {
+            bool loop = borderNext[vertex] != ~0u && borderPrevious[vertex] != ~0u;
+            kind[vertex] = loop ? VERTEX_BORDER : VERTEX_LOCKED;
+        }
+    }
+
+    // Area-weighted face planes, plus planes through every border edge perpendicular to its face
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+        const float *p[3] = {positions + triangles[i] * 3, positions + triangles[i + 1] * 3,
+                             positions + triangles[i + 2] * 3};
+        double e1[3], e2[3], normal[3];
+        difference(p[1], p[0], e1);
+        difference(p[2], p[0], e2);
+        cross(e1, e2, normal);
+        double area = length(normal);
+        if (area <= 0.0) {
+            continue;
+        }
+        for (double &component : normal) {
+            component /= area;
+        }
+        double d = -(normal[0] * p[0][0] + normal[1] * p[0][1] + normal[2] * p[0][2]);
+        for (int corner = 0; corner < 3; corner++) {
+            quadrics[triangles[i + corner]].addPlane(normal, d, area * 0.5);
+        }
+
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int from = triangles[i + corner], to = triangles[i + (corner + 1) % 3];
+            if (borderNext[from] != to || hasEdge(to, from)) {
+                continue;
+            }
+            double edge[3], borderNormal[3];
+            difference(positions + to * 3, positions + from * 3, edge);
+            cross(edge, normal, borderNormal);
+            double edgeLength = length(borderNormal);
+            if (edgeLength <= 0.0) {
+                continue;
+            }
+            for (double &component : borderNormal) {
+                component /= edgeLength;
+            }
+            const float *origin = positions + from * 3;
+            double borderD = -(borderNormal[0] * origin[0] + borderNormal[1] * origin[1] +
+                               borderNormal[2] * origin[2]);
+            double weight = edgeLength * edgeLength * BORDER_WEIGHT;
+            quadrics[from].addPlane(borderNormal, borderD, weight);
+            quadrics[to].addPlane(borderNormal, borderD, weight);
+        }
+    }
+
+    double errorLimit = (double) targetError * (double) targetError;
+    double worstError = 0.0;
+    std::vector<unsigned int> collapseTo(vertexCount);
+    std::vector<unsigned char> touched(vertexCount);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> collapses;
+
+    while (triangles.size() > targetIndexCount) {
+        // Triangles around every vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int vertex : triangles) {
+            adjacencyOffsets[vertex + 1]++;
+        }
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+        }
+        adjacency.resize(triangles.size());
+        {
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                adjacency[fill[triangles[i]]++] = (unsigned int) (i / 3);
+            }
+        }
+
+        // Every allowed direction of every edge, cheapest first
+        collapses.clear();
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int a = triangles[i + corner], b = triangles[i + (corner + 1) % 3];
+                for (int direction = 0; direction < 2; direction++) {
+                    unsigned int from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+                    if (kind[from] == VERTEX_LOCKED ||
+                        (kind[from] == VERTEX_BORDER && to != borderNext[from] && to != borderPrevious[from])) {
+                        continue;
+                    }
+                    Quadric merged = quadrics[from];
+                    merged.add(quadrics[to]);
+                    double error = merged.weight > 0.0 ? merged.evaluate(positions + to * 3) / merged.weight : 0.0;
+                    collapses.push_back({from, to, std::max(error, 0.0)});
+                }
+            }
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+            return a.error < b.error || (a.error == b.error && (a.from < b.from || (a.from == b.from && a.to < b.to)));
+        });
+
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            collapseTo[vertex] = (unsigned int) vertex;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t remaining = triangles.size();
+        size_t performed = 0;
+        for (const Collapse &collapse : collapses) {
+            if (remaining <= targetIndexCount || collapse.error > errorLimit) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // Reject collapses that would flip a surviving triangle around `from`
+            const float *target = positions + collapse.to * 3;
+            bool flips = false;
+            size_t removed = 0;
+            for (unsigned int k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; k++) {
+                const unsigned int *triangle = &triangles[adjacency[k] * 3];
+                int corner = triangle[0] == collapse.from ? 0 : triangle[1] == collapse.from ? 1 : 2;
+                unsigned int next = triangle[(corner + 1) % 3], previous = triangle[(corner + 2) % 3];
+                if (next == collapse.to || previous == collapse.to) {
+                    removed += 3;
+                    continue;
+                }
+                double before[3], after[3], e1[3], e2[3];
+                difference(positions + next * 3, positions + collapse.from * 3, e1);
+                difference(positions + previous * 3, positions + collapse.from * 3, e2);
+                cross(e1, e2, before);
+                difference(positions + next * 3, target, e1);
+                difference(positions + previous * 3, target, e2);
+                cross(e1, e2, after);
+                if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            collapseTo[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            worstError = std::max(worstError, collapse.error);
+            remaining -= removed;
+            performed++;
+            // Everything around `from` now has stale triangles, so leave the whole ring alone this pass
+            for (unsigned int k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; k++) {
+                const unsigned int *triangle = &triangles[adjacency[k] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+        }
+        if (performed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            unsigned int a = collapseTo[triangles[i]];
+            unsigned int b = collapseTo[triangles[i + 1]];
+            unsigned int c = collapseTo[triangles[i + 2]];
+            if (a != b && b != c && c != a) {
+                triangles[write++] = a;
+                triangles[write++] = b;
+                triangles[write++] = c;
+            }
+        }
+        triangles.resize(write);
+    }
+
+    std::copy(triangles.begin(), triangles.end(), destination);
+    if (resultError != nullptr) {
+        *resultError = (float) std::sqrt(worstError);
+    }
+    return triangles.size();
+}
+
+void generate_lods(const float *positions, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                   int maxLods, float ratio, bool optimize, std::vector<unsigned int> &lodIndices,
+                   std::vector<MeshLod> &lods) {
+    lodIndices.assign(indices, indices + indexCount);
+    lods.clear();
+    lods.push_back({0, (uint32_t) indexCount, 0.0f});
+
+    std::vector<unsigned int> previous(indices, indices + indexCount);
+    std::vector<unsigned int> simplified(indexCount);
+    float error = 0.0f;
+    while ((int) lods.size() < std::min(maxLods, MAX_MESH_LODS)) {
+        size_t target = (size_t) ((float) previous.size() * ratio) / 3 * 3;
+        float levelError = 0.0f;
+        size_t count = simplify_mesh(simplified.data(), previous.data(), previous.size(), positions, vertexCount,
+                                     target, FLT_MAX, &levelError);
+        if (count == 0 || (float) count > (float) previous.size() * LOD_MIN_REDUCTION) {
+            break;
+        }
+        // Each level is simplified from the last one, so the errors add up
+        error += levelError;
+        previous.assign(simplified.begin(), simplified.begin() + (long) count);
+        if (optimize) {
+            optimize_vertex_cache(simplified.data(), previous.data(), count, vertexCount);
+            previous.assign(simplified.begin(), simplified.begin() + (long) count);
+        }
+        lods.push_back({(uint32_t) lodIndices.size(), (uint32_t) count, error});
+        lodIndices.insert(lodIndices.end(), previous.begin(), previous.end());
+    }
+}
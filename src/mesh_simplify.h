@@ -0,0 +1,37 @@
+#ifndef PROJECT_MESH_SIMPLIFY_H
+#define PROJECT_MESH_SIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One level of detail: a range of a mesh's index data, drawn over the same vertices as the full mesh
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Estimated distance (in object units) between this level's surface and the full mesh
+    float error;
+};
+
+// Levels a mesh can have, the full mesh included
+static const int MAX_MESH_LODS = 8;
+
+// Quadric error metric simplification (Garland & Heckbert 1997) by collapsing edges onto one of their endpoints,
+// so the result only references existing vertices and can be drawn from the original vertex buffer. Vertices at the
+// same position are welded first; open borders only collapse along themselves.
+//
+// Stops at `targetIndexCount` indices or once the next collapse would exceed `targetError` (object units), whichever
+// comes first. Writes at most indexCount indices to destination and returns how many. `resultError` receives the
+// error of the result.
+size_t simplify_mesh(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+                     const float *positions, size_t vertexCount, size_t targetIndexCount, float targetError,
+                     float *resultError = nullptr);
+
+// Builds up to `maxLods` levels, each simplified from the previous one to about `ratio` of its triangles. Level 0 is
+// the input. The levels' indices are appended one after another to `lodIndices`. Stops early when a mesh no longer
+// shrinks. When `optimize` is set every level is reordered for the vertex cache.
+void generate_lods(const float *positions, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                   int maxLods, float ratio, bool optimize, std::vector<unsigned int> &lodIndices,
+                   std::vector<MeshLod> &lods);
+
+#endif //PROJECT_MESH_SIMPLIFY_H
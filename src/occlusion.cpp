@@ -0,0 +1,299 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "cpu_profiler.h"
+#include "job_system.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OCCLUSION_X86 1
+#include <emmintrin.h>
+#endif
+
+// Boxes tested per job
+static const size_t OCCLUSION_TEST_GRAIN = 1024;
+// Window depth a box must lie behind the occluders to count as hidden, so surfaces lying on an occluder (or the
+// occluder's own bounds) survive rounding in the depth interpolation
+static const float OCCLUSION_DEPTH_BIAS = 1e-5f;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) :
+        width_((std::max(width, 4) + 3) / 4 * 4), height_(std::max(height, 1)) {
+    // Every level halves the one before, rounding up, down to a single texel
+    int levelWidth = width_, levelHeight = height_;
+    while (true) {
+        levelWidths_.push_back(levelWidth);
+        levelHeights_.push_back(levelHeight);
+        levels_.emplace_back((size_t) levelWidth * levelHeight, 1.0f);
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    std::memset(viewProjection_, 0, sizeof(viewProjection_));
+    for (int i = 0; i < 4; i++) {
+        viewProjection_[i * 5] = 1.0f;
+    }
+}
+
+void OcclusionBuffer::begin(const float viewProjection[16]) {
+    std::memcpy(viewProjection_, viewProjection, sizeof(viewProjection_));
+    std::fill(levels_[0].begin(), levels_[0].end(), 1.0f);
+    stats_ = Stats();
+}
+
+void OcclusionBuffer::addOccluder(const float *positions, size_t vertexCount, const unsigned int *indices,
+                                  size_t indexCount) {
+    PROFILE_ZONE("occluder raster");
+    auto startTime = std::chrono::steady_clock::now();
+    const float *m = viewProjection_;
+    clip_.resize(vertexCount * 4);
+    for (size_t i = 0; i < vertexCount; i++) {
+        const float *p = positions + i * 3;
+        for (int row = 0; row < 4; row++) {
+            clip_[i * 4 + row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+        }
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount) {
+            continue;
+        }
+        // Clip against the near plane (z >= -w); the other planes are handled by the screen bounds
+        float polygon[4][4];
+        int corners = 0;
+        for (int edge = 0; edge < 3; edge++) {
+            const float *a = &clip_[indices[i + edge] * 4];
+            const float *b = &clip_[indices[i + (edge + 1) % 3] * 4];
+            float da = a[2] + a[3], db = b[2] + b[3];
+            if (da >= 0.0f) {
+                std::memcpy(polygon[corners++], a, sizeof(float) * 4);
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                for (int component = 0; component < 4; component++) {
+                    polygon[corners][component] = a[component] + (b[component] - a[component]) * t;
+                }
+                corners++;
+            }
+        }
+        if (corners < 3) {
+            continue;
+        }
+
+        float screen[4][3];
+        bool degenerate = false;
+        for (int corner = 0; corner < corners; corner++) {
+            float w = polygon[corner][3];
+            if (w <= 1e-6f) {
+                degenerate = true;
+                break;
+            }
+            screen[corner][0] = (polygon[corner][0] / w * 0.5f + 0.5f) * (float) width_;
+            screen[corner][1] = (polygon[corner][1] / w * 0.5f + 0.5f) * (float) height_;
+            screen[corner][2] = polygon[corner][2] / w * 0.5f + 0.5f;
+        }
+        if (degenerate) {
+            continue;
+        }
+        for (int corner = 2; corner < corners; corner++) {
+            rasterizeTriangle(screen[0], screen[corner - 1], screen[corner]);
+        }
+    }
+    stats_.occluderTriangles += indexCount / 3;
+    stats_.rasterMs += elapsed_ms(startTime);
+}
+
+void OcclusionBuffer::rasterizeTriangle(const float v0[3], const float v1[3], const float v2[3]) {
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+    if (area == 0.0f || !std::isfinite(area)) {
+        return;
+    }
+    // Both windings occlude; make the edge functions positive inside
+    if (area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    float minX = std::min(v0[0], std::min(v1[0], v2[0]));
+    float maxX = std::max(v0[0], std::max(v1[0], v2[0]));
+    float minY = std::min(v0[1], std::min(v1[1], v2[1]));
+    float maxY = std::max(v0[1], std::max(v1[1], v2[1]));
+    if (maxX < 0.0f || maxY < 0.0f || minX >= (float) width_ || minY >= (float) height_) {
+        return;
+    }
+    // Rows start on a group of 4 pixels; the width is a multiple of 4, so a group never runs past the row
+    int x0 = (int) std::max(minX, 0.0f) & ~3;
+    int x1 = (int) std::min(maxX, (float) (width_ - 1));
+    int y0 = (int) std::max(minY, 0.0f);
+    int y1 = (int) std::min(maxY, (float) (height_ - 1));
+
+    // E(x, y) = a x + b y + c for the edges opposite v0, v1 and v2
+    const float *vertices[3] = {v0, v1, v2};
+    float a[3], b[3], c[3];
+    for (int edge = 0; edge < 3; edge++) {
+        const float *p = vertices[(edge + 1) % 3];
+        const float *q = vertices[(edge + 2) % 3];
+        a[edge] = p[1] - q[1];
+        b[edge] = q[0] - p[0];
+        c[edge] = p[0] * q[1] - p[1] * q[0];
+    }
+    // Depth is affine in screen space
+    float dzdx = ((v1[2] - v0[2]) * (v2[1] - v0[1]) - (v2[2] - v0[2]) * (v1[1] - v0[1])) / area;
+    float dzdy = ((v2[2] - v0[2]) * (v1[0] - v0[0]) - (v1[2] - v0[2]) * (v2[0] - v0[0])) / area;
+    float z0 = v0[2] - dzdx * v0[0] - dzdy * v0[1];
+
+    float *depth = levels_[0].data();
+#ifdef OCCLUSION_X86
+    const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+    __m128 zx = _mm_set1_ps(dzdx);
+    for (int y = y0; y <= y1; y++) {
+        float centerY = (float) y + 0.5f;
+        __m128 r0 = _mm_set1_ps(b[0] * centerY + c[0]);
+        __m128 r1 = _mm_set1_ps(b[1] * centerY + c[1]);
+        __m128 r2 = _mm_set1_ps(b[2] * centerY + c[2]);
+        __m128 rz = _mm_set1_ps(dzdy * centerY + z0);
+        float *row = depth + (size_t) y * width_;
+        for (int x = x0; x <= x1; x += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps((float) x), lane);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, centerX), r0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, centerX), r1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, centerX), r2);
+            __m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), zero);
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(zx, centerX), rz);
+            __m128 stored = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(stored, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+        }
+    }
+#else
+    for (int y = y0; y <= y1; y++) {
+        float centerY = (float) y + 0.5f;
+        // Same evaluation order as the SIMD path, so both write the same depths
+        float r0 = b[0] * centerY + c[0], r1 = b[1] * centerY + c[1], r2 = b[2] * centerY + c[2];
+        float rz = dzdy * centerY + z0;
+        float *row = depth + (size_t) y * width_;
+        for (int x = x0; x <= x1; x++) {
+            float centerX = (float) x + 0.5f;
+            if (a[0] * centerX + r0 >= 0.0f && a[1] * centerX + r1 >= 0.0f && a[2] * centerX + r2 >= 0.0f) {
+                row[x] = std::min(row[x], dzdx * centerX + rz);
+            }
+        }
+    }
+#endif
+}
+
+void OcclusionBuffer::finish() {
+    PROFILE_ZONE("occlusion pyramid");
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t level = 1; level < levels_.size(); level++) {
+        const float *source = levels_[level - 1].data();
+        int sourceWidth = levelWidths_[level - 1], sourceHeight = levelHeights_[level - 1];
+        float *target = levels_[level].data();
+        for (int y = 0; y < levelHeights_[level]; y++) {
+            int sy0 = y * 2, sy1 = std::min(y * 2 + 1, sourceHeight - 1);
+            for (int x = 0; x < levelWidths_[level]; x++) {
+                int sx0 = x * 2, sx1 = std::min(x * 2 + 1, sourceWidth - 1);
+                target[y * levelWidths_[level] + x] =
+                        std::max(std::max(source[sy0 * sourceWidth + sx0], source[sy0 * sourceWidth + sx1]),
+                                 std::max(source[sy1 * sourceWidth + sx0], source[sy1 * sourceWidth + sx1]));
+            }
+        }
+    }
+    stats_.rasterMs += elapsed_ms(startTime);
+}
+
+bool OcclusionBuffer::boxVisible(const float minimum[3], const float maximum[3]) const {
+    const float *m = viewProjection_;
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++) {
+        float p[3] = {corner & 1 ? maximum[0] : minimum[0], corner & 2 ? maximum[1] : minimum[1],
+                      corner & 4 ? maximum[2] : minimum[2]};
+        float clip[4];
+        for (int row = 0; row < 4; row++) {
+            clip[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+        }
+        // Boxes reaching through the near plane cannot be hidden
+        if (clip[3] <= 1e-6f || clip[2] < -clip[3]) {
+            return true;
+        }
+        float x = (clip[0] / clip[3] * 0.5f + 0.5f) * (float) width_;
+        float y = (clip[1] / clip[3] * 0.5f + 0.5f) * (float) height_;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip[2] / clip[3] * 0.5f + 0.5f);
+    }
+    // Off-screen boxes are left to the frustum test
+    if (maxX < 0.0f || maxY < 0.0f || minX >= (float) width_ || minY >= (float) height_) {
+        return true;
+    }
+    int x0 = (int) std::max(minX, 0.0f), x1 = (int) std::min(maxX, (float) (width_ - 1));
+    int y0 = (int) std::max(minY, 0.0f), y1 = (int) std::min(maxY, (float) (height_ - 1));
+
+    // Coarsest level at which the rectangle spans at most 2x2 texels
+    int level = 0;
+    while (level + 1 < (int) levels_.size() &&
+           ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+    const float *depth = levels_[level].data();
+    int levelWidth = levelWidths_[level];
+    for (int y = y0 >> level; y <= y1 >> level; y++) {
+        for (int x = x0 >> level; x <= x1 >> level; x++) {
+            if (nearest <= depth[y * levelWidth + x] + OCCLUSION_DEPTH_BIAS) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void OcclusionBuffer::cull(const BoundsSoA &bounds, JobSystem *jobs, std::vector<uint32_t> &visible) {
+    PROFILE_ZONE("occlusion cull");
+    auto startTime = std::chrono::steady_clock::now();
+    mask_.resize(visible.size());
+    auto test = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t box = visible[i];
+            float center[3] = {bounds.centerX()[box], bounds.centerY()[box], bounds.centerZ()[box]};
+            float extent[3] = {bounds.extentX()[box], bounds.extentY()[box], bounds.extentZ()[box]};
+            float minimum[3], maximum[3];
+            for (int axis = 0; axis < 3; axis++) {
+                minimum[axis] = center[axis] - extent[axis];
+                maximum[axis] = center[axis] + extent[axis];
+            }
+            mask_[i] = boxVisible(minimum, maximum) ? 1 : 0;
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(visible.size(), OCCLUSION_TEST_GRAIN, test);
+    } else {
+        test(0, visible.size());
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); i++) {
+        if (mask_[i] != 0) {
+            visible[kept++] = visible[i];
+        }
+    }
+    stats_.tested += visible.size();
+    stats_.occluded += visible.size() - kept;
+    visible.resize(kept);
+    stats_.testMs += elapsed_ms(startTime);
+}
@@ -0,0 +1,64 @@
+#ifndef PROJECT_OCCLUSION_H
+#define PROJECT_OCCLUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "culling.h"
+
+class JobSystem;
+
+// CPU occlusion culling against a low-resolution depth buffer. Each frame a few occluder meshes are rasterized into
+// the buffer, a max-depth pyramid is built from it, and object bounds are tested against the pyramid level where
+// their screen rectangle covers at most 2x2 texels. An object is occluded when its nearest point lies behind the
+// farthest occluder depth under its rectangle.
+//
+// Depth is window depth in [0, 1] (0 at the near plane), as for glDepthRange(0, 1). Triangles are sampled at pixel
+// centers, so an occluder edge may hide an object that peeks out by less than a buffer pixel.
+class OcclusionBuffer {
+public:
+    struct Stats {
+        size_t occluderTriangles = 0;
+        size_t tested = 0;
+        size_t occluded = 0;
+        double rasterMs = 0.0;
+        double testMs = 0.0;
+    };
+
+    // The width is rounded up to a multiple of 4 for the SIMD rasterizer
+    explicit OcclusionBuffer(int width = 256, int height = 128);
+
+    // Clears the buffer for a new view
+    void begin(const float viewProjection[16]);
+    // Rasterizes a triangle list given in the same space as the bounds that are tested later
+    void addOccluder(const float *positions, size_t vertexCount, const unsigned int *indices, size_t indexCount);
+    // Builds the depth pyramid; call after the last occluder and before testing
+    void finish();
+
+    bool boxVisible(const float minimum[3], const float maximum[3]) const;
+    // Removes occluded boxes from `visible`, a list of indices into `bounds`, keeping the order of the rest
+    void cull(const BoundsSoA &bounds, JobSystem *jobs, std::vector<uint32_t> &visible);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int levelCount() const { return (int) levels_.size(); }
+    // Level 0 is the rasterized depth; every further level holds the max of 2x2 texels of the one before
+    const float *level(int index) const { return levels_[index].data(); }
+    const Stats &stats() const { return stats_; }
+
+private:
+    // Corners in buffer pixels with window depth
+    void rasterizeTriangle(const float v0[3], const float v1[3], const float v2[3]);
+
+    int width_;
+    int height_;
+    float viewProjection_[16];
+    std::vector<std::vector<float>> levels_;
+    std::vector<int> levelWidths_, levelHeights_;
+    std::vector<float> clip_;
+    std::vector<uint8_t> mask_;
+    Stats stats_;
+};
+
+#endif //PROJECT_OCCLUSION_H
@@ -0,0 +1,247 @@
+#include "packed_mesh.h"
+
+#include <algorithm>
+#include <iostream>
+
+static GLenum index_type_for(unsigned int vertexRange, bool allowBytes) {
+    if (allowBytes && vertexRange <= 256) {
+        return GL_UNSIGNED_BYTE;
+    }
+    if (vertexRange <= MAX_CLUSTER_VERTICES) {
+        return GL_UNSIGNED_SHORT;
+    }
+    return GL_UNSIGNED_INT;
+}
+
+size_t index_type_size(GLenum type) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+// Writes indices - base as `type` into out
+static void narrow_indices(const unsigned int *indices, int count, unsigned int base, GLenum type, void *out) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE: {
+            auto *bytes = (unsigned char *) out;
+            for (int i = 0; i < count; i++) {
+                bytes[i] = (unsigned char) (indices[i] - base);
+            }
+            break;
+        }
+        case GL_UNSIGNED_SHORT: {
+            auto *shorts = (unsigned short *) out;
+            for (int i = 0; i < count; i++) {
+                shorts[i] = (unsigned short) (indices[i] - base);
+            }
+            break;
+        }
+        default: {
+            auto *ints = (unsigned int *) out;
+            for (int i = 0; i < count; i++) {
+                ints[i] = indices[i] - base;
+            }
+            break;
+        }
+    }
+}
+
+PackedMeshView view_of(const PackedMesh &mesh) {
+    PackedMeshView view;
+    view.format = mesh.format;
+    view.vertexCount = mesh.vertexCount;
+    view.vertexData = mesh.vertexData.data();
+    view.indexType = mesh.indexType;
+    view.indexCount = mesh.indexCount;
+    view.indexData = mesh.indexData.data();
+    view.lods = mesh.lods.empty() ? nullptr : mesh.lods.data();
+    view.lodCount = (int) mesh.lods.size();
+    for (int axis = 0; axis < 3; axis++) {
+        view.positionScale[axis] = mesh.positionScale[axis];
+        view.positionOffset[axis] = mesh.positionOffset[axis];
+        view.boundsMin[axis] = mesh.boundsMin[axis];
+        view.boundsMax[axis] = mesh.boundsMax[axis];
+    }
+    return view;
+}
+
+int full_detail_index_count(const PackedMeshView &mesh) {
+    return mesh.lodCount > 0 ? (int) mesh.lods[0].indexCount : mesh.indexCount;
+}
+
+// The optimizer and the cluster split index straight into per-vertex arrays, so bad indices are refused before either
+static bool indices_in_range(const unsigned int *indices, int indexCount, int vertexCount) {
+    unsigned int maxIndex = 0;
+    for (int i = 0; i < indexCount; i++) {
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    if (indexCount > 0 && maxIndex >= (unsigned int) vertexCount) {
+        std::cout << "ERROR::PACKED_MESH::INDEX_OUT_OF_RANGE " << maxIndex << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool pack_single(const float *positions, int vertexCount, const unsigned int *indices, int indexCount,
+                        const PackOptions &options, PackedMesh &out) {
+    if (vertexCount <= 0 || indexCount <= 0) {
+        std::cout << "ERROR::PACKED_MESH::EMPTY_MESH" << std::endl;
+        return false;
+    }
+
+    // Only the referenced vertex range is kept, and the indices are rebased onto it
+    unsigned int minIndex = indices[0], maxIndex = indices[0];
+    for (int i = 1; i < indexCount; i++) {
+        minIndex = std::min(minIndex, indices[i]);
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    if (maxIndex >= (unsigned int) vertexCount) {
+        std::cout << "ERROR::PACKED_MESH::INDEX_OUT_OF_RANGE " << maxIndex << std::endl;
+        return false;
+    }
+    unsigned int usedVertices = maxIndex - minIndex + 1;
+    const float *usedPositions = positions + (size_t) minIndex * 3;
+
+    // Simplified levels only reference vertices the full mesh already uses, so they fit the same range
+    std::vector<unsigned int> lodIndices;
+    out.lods.clear();
+    if (options.lodLevels > 0) {
+        generate_lods(positions, (size_t) vertexCount, indices, (size_t) indexCount, options.lodLevels + 1,
+                      options.lodRatio, options.optimize, lodIndices, out.lods);
+        indices = lodIndices.data();
+        indexCount = (int) lodIndices.size();
+    }
+
+    out.indexType = index_type_for(usedVertices, options.allowByteIndices);
+    out.indexCount = indexCount;
+    out.indexData.resize((size_t) indexCount * index_type_size(out.indexType));
+    narrow_indices(indices, indexCount, minIndex, out.indexType, out.indexData.data());
+
+    QuantizedPositions quantized;
+    choose_vertex_format(usedPositions, usedVertices, options.quantizationError, quantized);
+    out.format = quantized.format;
+    out.vertexCount = (int) usedVertices;
+    out.vertexData.swap(quantized.data);
+
+    for (int axis = 0; axis < 3; axis++) {
+        out.positionScale[axis] = quantized.scale[axis];
+        out.positionOffset[axis] = quantized.offset[axis];
+        out.boundsMin[axis] = usedPositions[axis];
+        out.boundsMax[axis] = usedPositions[axis];
+    }
+    for (unsigned int vertex = 1; vertex < usedVertices; vertex++) {
+        for (int axis = 0; axis < 3; axis++) {
+            out.boundsMin[axis] = std::min(out.boundsMin[axis], usedPositions[vertex * 3 + axis]);
+            out.boundsMax[axis] = std::max(out.boundsMax[axis], usedPositions[vertex * 3 + axis]);
+        }
+    }
+    return true;
+}
+
+bool pack_mesh(const float *positions, int vertexCount, const unsigned int *indices, int indexCount,
+               const PackOptions &options, PackedMesh &out, MeshOptimizeReport *report) {
+    if (!indices_in_range(indices, indexCount, vertexCount)) {
+        return false;
+    }
+    if (options.optimize && vertexCount > 0 && indexCount > 0) {
+        std::vector<float> optimizedPositions(positions, positions + (size_t) vertexCount * 3);
+        std::vector<unsigned int> optimizedIndices(indices, indices + indexCount);
+        MeshOptimizeReport optimizeReport = optimize_mesh(optimizedPositions, optimizedIndices);
+        if (report != nullptr) {
+            *report = optimizeReport;
+        }
+        return pack_single(optimizedPositions.data(), (int) optimizedPositions.size() / 3, optimizedIndices.data(),
+                           (int) optimizedIndices.size(), options, out);
+    }
+    return pack_single(positions, vertexCount, indices, indexCount, options, out);
+}
+
+std::vector<PackedMesh> pack_mesh_clusters(const float *positions, int vertexCount, const unsigned int *indices,
+                                           int indexCount, const PackOptions &options, MeshOptimizeReport *report) {
+    std::vector<PackedMesh> clusters;
+    if (!indices_in_range(indices, indexCount, vertexCount)) {
+        return clusters;
+    }
+
+    // Optimize the whole mesh before splitting it, so clusters follow the cache-friendly triangle order. The
+    // clusters themselves come out in first-use vertex order, which is what vertex fetch wants.
+    std::vector<float> optimizedPositions;
+    std::vector<unsigned int> optimizedIndices;
+    if (options.optimize && vertexCount > 0 && indexCount > 0) {
+        optimizedPositions.assign(positions, positions + (size_t) vertexCount * 3);
+        optimizedIndices.assign(indices, indices + indexCount);
+        MeshOptimizeReport optimizeReport = optimize_mesh(optimizedPositions, optimizedIndices);
+        if (report != nullptr) {
+            *report = optimizeReport;
+        }
+        positions = optimizedPositions.data();
+        vertexCount = (int) optimizedPositions.size() / 3;
+        indices = optimizedIndices.data();
+        indexCount = (int) optimizedIndices.size();
+    }
+
+    if (vertexCount <= (int) MAX_CLUSTER_VERTICES) {
+        PackedMesh mesh;
+        if (pack_single(positions, vertexCount, indices, indexCount, options, mesh)) {
+            clusters.push_back(std::move(mesh));
+        }
+        return clusters;
+    }
+
+    // Greedily take triangles in order until the next one would push the cluster past the 16-bit limit
+    std::vector<int> localIndex(vertexCount, -1);
+    std::vector<unsigned int> clusterVertices;
+    std::vector<unsigned int> clusterIndices;
+    std::vector<float> clusterPositions;
+
+    auto flush = [&]() {
+        if (clusterIndices.empty()) {
+            return;
+        }
+        clusterPositions.resize(clusterVertices.size() * 3);
+        for (size_t i = 0; i < clusterVertices.size(); i++) {
+            for (int component = 0; component < 3; component++) {
+                clusterPositions[i * 3 + component] = positions[(size_t) clusterVertices[i] * 3 + component];
+            }
+            localIndex[clusterVertices[i]] = -1;
+        }
+        PackedMesh mesh;
+        if (pack_single(clusterPositions.data(), (int) clusterVertices.size(), clusterIndices.data(),
+                        (int) clusterIndices.size(), options, mesh)) {
+            clusters.push_back(std::move(mesh));
+        }
+        clusterVertices.clear();
+        clusterIndices.clear();
+    };
+
+    for (int triangle = 0; triangle + 2 < indexCount; triangle += 3) {
+        int newVertices = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int vertex = indices[triangle + corner];
+            // A vertex repeated within the triangle only counts once
+            bool repeated = (corner > 0 && vertex == indices[triangle]) ||
+                            (corner > 1 && vertex == indices[triangle + 1]);
+            if (localIndex[vertex] < 0 && !repeated) {
+                newVertices++;
+            }
+        }
+        if (clusterVertices.size() + newVertices > MAX_CLUSTER_VERTICES) {
+            flush();
+        }
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int vertex = indices[triangle + corner];
+            if (localIndex[vertex] < 0) {
+                localIndex[vertex] = (int) clusterVertices.size();
+                clusterVertices.push_back(vertex);
+            }
+            clusterIndices.push_back((unsigned int) localIndex[vertex]);
+        }
+    }
+    flush();
+    return clusters;
+}
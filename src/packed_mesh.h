@@ -0,0 +1,84 @@
+#ifndef PROJECT_PACKED_MESH_H
+#define PROJECT_PACKED_MESH_H
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+#include "mesh_optimizer.h"
+#include "mesh_simplify.h"
+#include "vertex_format.h"
+
+// A mesh in exactly the layout it takes on the GPU: quantized vertices, narrowed and rebased indices and the
+// parameters to decode positions. Packing is plain CPU work, so it can run offline or on worker threads; uploading
+// is then a straight copy.
+//
+// Levels of detail are stored one after another in the index data and share the vertices. indexCount counts the
+// indices of every level; without `lods` the whole index data is a single level.
+struct PackedMesh {
+    VertexFormat format = VERTEX_FLOAT3;
+    int vertexCount = 0;
+    std::vector<unsigned char> vertexData;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    int indexCount = 0;
+    std::vector<unsigned char> indexData;
+    std::vector<MeshLod> lods;
+    float positionScale[3] = {1.0f, 1.0f, 1.0f};
+    float positionOffset[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// Non-owning version of PackedMesh, e.g. pointing into a memory-mapped file
+struct PackedMeshView {
+    VertexFormat format = VERTEX_FLOAT3;
+    int vertexCount = 0;
+    const void *vertexData = nullptr;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    int indexCount = 0;
+    const void *indexData = nullptr;
+    const MeshLod *lods = nullptr;
+    int lodCount = 0;
+    float positionScale[3] = {1.0f, 1.0f, 1.0f};
+    float positionOffset[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+};
+
+struct PackOptions {
+    // See choose_vertex_format(); zero keeps float positions
+    float quantizationError = 0.0f;
+    // Use GL_UNSIGNED_BYTE for meshes spanning at most 256 vertices
+    bool allowByteIndices = false;
+    // Run optimize_mesh() first
+    bool optimize = false;
+    // Simplified levels to build besides the full mesh, each with about lodRatio of the previous level's triangles.
+    // At most MAX_MESH_LODS - 1.
+    int lodLevels = 0;
+    float lodRatio = 0.5f;
+};
+
+// Largest vertex range a 16-bit index can address
+static const unsigned int MAX_CLUSTER_VERTICES = 65536;
+
+size_t index_type_size(GLenum type);
+
+PackedMeshView view_of(const PackedMesh &mesh);
+
+// Indices of the most detailed level
+int full_detail_index_count(const PackedMeshView &mesh);
+
+// Packs one mesh. Only the vertex range the indices reference is kept and the indices are rebased onto it; meshes
+// spanning more than 65536 vertices keep 32-bit indices. Returns false (printing why) for empty or broken input.
+// When the options ask for optimization, its statistics go to `report` if given.
+bool pack_mesh(const float *positions, int vertexCount, const unsigned int *indices, int indexCount,
+               const PackOptions &options, PackedMesh &out, MeshOptimizeReport *report = nullptr);
+
+// Packs a mesh as clusters of at most MAX_CLUSTER_VERTICES vertices, so every part draws with 16-bit (or narrower)
+// indices. Vertices shared across a cluster boundary are duplicated and triangle order is kept. Optimization runs on
+// the whole mesh before it is split.
+std::vector<PackedMesh> pack_mesh_clusters(const float *positions, int vertexCount, const unsigned int *indices,
+                                           int indexCount, const PackOptions &options,
+                                           MeshOptimizeReport *report = nullptr);
+
+#endif //PROJECT_PACKED_MESH_H
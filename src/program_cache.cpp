@@ -0,0 +1,290 @@
+#include "program_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <vector>
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "shader.h"
+
+static_assert(sizeof(ProgramCacheHeader) == 24, "ProgramCacheHeader layout changed");
+
+// FNV-1a, 64-bit
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hashes the string and its terminator, so "ab" + "c" and "a" + "bc" differ
+static uint64_t fnv1a(uint64_t hash, const std::string &text) {
+    return fnv1a(hash, text.c_str(), text.size() + 1);
+}
+
+static std::string gl_string(GLenum name) {
+    const GLubyte *text = glGetString(name);
+    return text != NULL ? std::string((const char *) text) : std::string();
+}
+
+// Puts `defines` after the #version line, which has to stay first
+static std::string with_defines(const char *source, const char *defines) {
+    std::string text(source);
+    if (defines == NULL || defines[0] == '\0') {
+        return text;
+    }
+    size_t insert = 0;
+    size_t version = text.find("#version");
+    if (version != std::string::npos) {
+        size_t end = text.find('\n', version);
+        insert = end == std::string::npos ? text.size() : end + 1;
+    }
+    std::string block(defines);
+    if (block.back() != '\n') {
+        block += '\n';
+    }
+    if (insert == text.size() && insert > 0 && text.back() != '\n') {
+        block.insert(block.begin(), '\n');
+    }
+    text.insert(insert, block);
+    return text;
+}
+
+// Unique among running processes sharing the directory and among stores within this one
+static std::string temporary_path(const std::string &file) {
+    static std::atomic<unsigned int> counter{0};
+#ifdef _WIN32
+    long long process = (long long) _getpid();
+#else
+    long long process = (long long) getpid();
+#endif
+    return file + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+}
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ProgramCache::init(const std::string &directory) {
+    enabled_ = false;
+    if (!GLAD_GL_ARB_get_program_binary) {
+        std::cout << "WARNING::PROGRAM_CACHE::NO_PROGRAM_BINARY compiling every program" << std::endl;
+        return false;
+    }
+    // Some drivers expose the extension but no format to save in
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        std::cout << "WARNING::PROGRAM_CACHE::NO_BINARY_FORMATS compiling every program" << std::endl;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cout << "ERROR::PROGRAM_CACHE::CANNOT_CREATE " << directory << " " << error.message() << std::endl;
+        return false;
+    }
+
+    directory_ = directory;
+    driverHash_ = FNV_OFFSET;
+    driverHash_ = fnv1a(driverHash_, &PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+    driverHash_ = fnv1a(driverHash_, gl_string(GL_VENDOR));
+    driverHash_ = fnv1a(driverHash_, gl_string(GL_RENDERER));
+    driverHash_ = fnv1a(driverHash_, gl_string(GL_VERSION));
+    enabled_ = true;
+    return true;
+}
+
+uint64_t ProgramCache::key(const std::string &vertexSource, const std::string &fragmentSource) const {
+    uint64_t hash = fnv1a(driverHash_, vertexSource);
+    return fnv1a(hash, fragmentSource);
+}
+
+std::string ProgramCache::path(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+    return (std::filesystem::path(directory_) / name).string();
+}
+
+unsigned int ProgramCache::build(const char *vertexSource, const char *fragmentSource, const char *defines) {
+    PendingProgram pending = begin(vertexSource, fragmentSource, defines);
+    return finish(pending);
+}
+
+PendingProgram ProgramCache::begin(const char *vertexSource, const char *fragmentSource, const char *defines) {
+    std::string vertex = with_defines(vertexSource, defines);
+    std::string fragment = with_defines(fragmentSource, defines);
+
+    PendingProgram pending;
+    if (enabled_) {
+        pending.key = key(vertex, fragment);
+        auto start = std::chrono::steady_clock::now();
+        pending.program = load(pending.key);
+        if (pending.program != 0) {
+            pending.loaded = true;
+            stats_.loaded++;
+            stats_.loadMs += milliseconds_since(start);
+            return pending;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const char *vertexText = vertex.c_str();
+    const char *fragmentText = fragment.c_str();
+    pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pending.vertexShader, 1, &vertexText, NULL);
+    glCompileShader(pending.vertexShader);
+    pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending.fragmentShader, 1, &fragmentText, NULL);
+    glCompileShader(pending.fragmentShader);
+
+    // Linking does not need the compile status first; a failed compile just fails the link too
+    pending.program = glCreateProgram();
+    if (enabled_) {
+        glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(pending.program, pending.vertexShader);
+    glAttachShader(pending.program, pending.fragmentShader);
+    glLinkProgram(pending.program);
+    stats_.compileMs += milliseconds_since(start);
+    return pending;
+}
+
+bool ProgramCache::ready(const PendingProgram &pending) const {
+    if (pending.loaded || pending.program == 0 || !GLAD_GL_KHR_parallel_shader_compile) {
+        return true;
+    }
+    int complete = 0;
+    glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != 0;
+}
+
+unsigned int ProgramCache::finish(PendingProgram &pending) {
+    unsigned int program = pending.program;
+    pending.program = 0;
+    if (pending.loaded || program == 0) {
+        return program;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    // Report the stage that failed rather than only the link error it causes
+    bool success = check_shader(pending.vertexShader, GL_VERTEX_SHADER) &&
+                   check_shader(pending.fragmentShader, GL_FRAGMENT_SHADER) && check_program(program);
+    // Attached shaders are only flagged; they go with the program
+    glDeleteShader(pending.vertexShader);
+    glDeleteShader(pending.fragmentShader);
+    pending.vertexShader = pending.fragmentShader = 0;
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    stats_.compiled++;
+    stats_.compileMs += milliseconds_since(start);
+
+    if (enabled_) {
+        store(pending.key, program);
+    }
+    return program;
+}
+
+unsigned int ProgramCache::load(uint64_t key) {
+    std::string file = path(key);
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream) {
+        return 0;
+    }
+    std::error_code sizeError;
+    uintmax_t fileSize = std::filesystem::file_size(file, sizeError);
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    // The length has to match the file before it sizes anything
+    bool valid = !sizeError && fileSize > sizeof(header) && stream.read((char *) &header, sizeof(header)) &&
+                 std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == PROGRAM_CACHE_VERSION && header.key == key && header.length > 0 &&
+                 header.length == fileSize - sizeof(header);
+    if (valid) {
+        binary.resize(header.length);
+        valid = (bool) stream.read(binary.data(), (std::streamsize) binary.size());
+    }
+    stream.close();
+
+    unsigned int program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei) binary.size());
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (program == 0) {
+        // Truncated, from another build of the cache, or refused by the driver: drop it, the caller recompiles
+        std::cout << "WARNING::PROGRAM_CACHE::REJECTED " << file << std::endl;
+        stats_.rejected++;
+        std::error_code error;
+        std::filesystem::remove(file, error);
+    }
+    return program;
+}
+
+void ProgramCache::store(uint64_t key, unsigned int program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary((size_t) length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.binaryFormat = format;
+    header.length = (uint32_t) written;
+
+    // Write to the side and rename into place, so a crash or a second instance never leaves a torn entry behind
+    std::string file = path(key);
+    std::string temporary = temporary_path(file);
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        stream.write((const char *) &header, sizeof(header));
+        stream.write(binary.data(), written);
+        if (!stream) {
+            std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << temporary << std::endl;
+            stream.close();
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+        std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << file << " " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+    }
+}
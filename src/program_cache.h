@@ -0,0 +1,83 @@
+#ifndef PROJECT_PROGRAM_CACHE_H
+#define PROJECT_PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+// Builds programs from GLSL source and keeps their linked binaries (ARB_get_program_binary) in a directory, so later
+// runs load them with glProgramBinary instead of compiling. A binary is keyed by a hash of both sources, the defines
+// and the GL vendor, renderer and version strings, so editing a shader or updating the driver misses the cache.
+// Drivers may still reject a binary they wrote themselves; such entries are dropped and rebuilt from source.
+//
+// Without init(), or if the driver offers no binary formats, build() just compiles and links.
+//
+// One file per program:
+//
+//     ProgramCacheHeader
+//     binary, `length` bytes
+static const char PROGRAM_CACHE_MAGIC[4] = {'L', 'O', 'G', 'P'};
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+
+// A program between begin() and finish(): either already loaded from the cache or still compiling
+struct PendingProgram {
+    uint64_t key = 0;
+    unsigned int program = 0;
+    unsigned int vertexShader = 0;
+    unsigned int fragmentShader = 0;
+    bool loaded = false;
+};
+
+class ProgramCache {
+public:
+    struct Stats {
+        unsigned int loaded = 0;
+        unsigned int compiled = 0;
+        // Entries the driver refused, rebuilt from source
+        unsigned int rejected = 0;
+        double loadMs = 0.0;
+        // Time the caller spent in begin() and finish() for compiled programs, not how long the driver took
+        double compileMs = 0.0;
+    };
+
+    // Uses `directory` for the binaries, creating it if needed. Returns false (and keeps compiling every program) if
+    // the context cannot hand out program binaries or the directory cannot be created.
+    bool init(const std::string &directory);
+
+    // `defines` (lines like "#define NAME VALUE\n") go into both stages right after the #version line. Returns 0 if
+    // the program fails to compile or link; the info log is printed.
+    unsigned int build(const char *vertexSource, const char *fragmentSource, const char *defines = "");
+
+    // build() in two halves. begin() loads the program from the cache or issues its compiles and link without
+    // reading any status, so the driver can work on several programs (and the caller on something else) at once;
+    // finish() checks the result, returning the program or 0 like build(). Both on the thread owning the context.
+    PendingProgram begin(const char *vertexSource, const char *fragmentSource, const char *defines = "");
+    // Whether finish() would return without waiting. Always true without KHR_parallel_shader_compile, which is the
+    // only way to ask; finish() then waits for the driver.
+    bool ready(const PendingProgram &pending) const;
+    unsigned int finish(PendingProgram &pending);
+
+    bool enabled() const { return enabled_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    uint64_t key(const std::string &vertexSource, const std::string &fragmentSource) const;
+    std::string path(uint64_t key) const;
+    unsigned int load(uint64_t key);
+    void store(uint64_t key, unsigned int program);
+
+    bool enabled_ = false;
+    std::string directory_;
+    // Hash of the driver strings, the part of every key that does not depend on the program
+    uint64_t driverHash_ = 0;
+    Stats stats_;
+};
+
+#endif //PROJECT_PROGRAM_CACHE_H
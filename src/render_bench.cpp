@@ -0,0 +1,544 @@
+// Draw path micro-benchmarks on a headless context: draw count, program and VAO switches, buffer uploads by method,
+// instanced against individual draws and shader compile time. Scenes come from a fixed seed, so runs on the same
+// host draw exactly the same thing. Results are written as JSON.
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+
+#include "draw_queue.h"
+#include "geometry_arena.h"
+#include "gl_state.h"
+#include "headless.h"
+#include "instancing.h"
+#include "shader.h"
+#include "shader_builder.h"
+#include "stream_buffer.h"
+
+#define RENDER_BENCH_SEED 12345u
+// Small target: the benchmarks measure the cost of submitting work, not of filling pixels
+#define TARGET_SIZE 256
+#define WARMUP_FRAMES 5
+#define STREAM_BUFFER_SIZE (32 * 1024 * 1024)
+
+static const char *vertexShaderSource = "#version 330 core\n"
+                                        "layout (location = 0) in vec3 aPos;\n"
+                                        "uniform vec3 uPositionScale;\n"
+                                        "uniform vec3 uPositionOffset;\n"
+                                        "uniform mat4 uViewProjection;\n"
+                                        "void main()\n"
+                                        "{\n"
+                                        "   vec3 position = aPos * uPositionScale + uPositionOffset;\n"
+                                        "   gl_Position = uViewProjection * vec4(position, 1.0);\n"
+                                        "}\n";
+
+static const char *fragmentShaderSource = "#version 330 core\n"
+                                          "uniform vec4 uColor;\n"
+                                          "out vec4 FragColor;\n"
+                                          "void main()\n"
+                                          "{\n"
+                                          "    FragColor = uColor;\n"
+                                          "}\n";
+
+static const float IDENTITY[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+struct Result {
+    std::string name;
+    // Which way of doing the same work, for cases that compare several
+    std::string variant;
+    // Inputs of the case, then derived numbers
+    std::vector<std::pair<std::string, double>> params;
+    std::vector<std::pair<std::string, double>> metrics;
+    // Medians per frame: time to issue the frame's GL calls, and until the GPU has finished it
+    double cpuMs = 0.0;
+    double frameMs = 0.0;
+};
+
+static double now_ms() {
+    return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+// Runs `frame` for the warm-up and then `frames` measured frames, each drained with glFinish
+template<typename Frame>
+static void measure(int frames, Result &result, Frame &&frame) {
+    glFinish();
+    for (int i = 0; i < WARMUP_FRAMES; i++) {
+        frame();
+        glFinish();
+    }
+    std::vector<double> cpu, total;
+    for (int i = 0; i < frames; i++) {
+        double start = now_ms();
+        frame();
+        double issued = now_ms();
+        glFinish();
+        double finished = now_ms();
+        cpu.push_back(issued - start);
+        total.push_back(finished - start);
+    }
+    result.cpuMs = median(cpu);
+    result.frameMs = median(total);
+}
+
+// A flat color program with the arena's position decoding, set up to draw undecoded float positions as they are
+static unsigned int make_program(const char *vertexSource, float red, float green, float blue) {
+    unsigned int program = build_program(vertexSource, fragmentShaderSource);
+    if (program == 0) {
+        return 0;
+    }
+    const float one[3] = {1.0f, 1.0f, 1.0f};
+    gl_state().useProgram(program);
+    glUniform3fv(glGetUniformLocation(program, "uPositionScale"), 1, one);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uViewProjection"), 1, GL_FALSE, IDENTITY);
+    glUniform4f(glGetUniformLocation(program, "uColor"), red, green, blue, 1.0f);
+    return program;
+}
+
+// `count` small quads at random places in clip space, one arena mesh each
+static std::vector<MeshHandle> add_quads(GeometryArena &arena, int count, std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-0.95f, 0.95f);
+    const float size = 0.02f;
+    const unsigned int indices[6] = {0, 1, 3, 1, 2, 3};
+    std::vector<MeshHandle> meshes;
+    for (int i = 0; i < count; i++) {
+        float x = position(random), y = position(random);
+        float vertices[12] = {x + size, y + size, 0.0f, x + size, y, 0.0f, x, y, 0.0f, x, y + size, 0.0f};
+        meshes.push_back(arena.addMesh(vertices, 4, indices, 6));
+    }
+    return meshes;
+}
+
+static void draw(const DrawCommand &command) {
+    glDrawElementsBaseVertex(GL_TRIANGLES, command.count, command.indexType, (void *) command.indexOffset,
+                             command.baseVertex);
+}
+
+// Draws through the DrawQueue: submit, sort and execute, as the render thread does
+static void bench_draw_count(int frames, const GeometryArena &arena, const std::vector<MeshHandle> &quads,
+                             unsigned int program, std::vector<Result> &results) {
+    const int counts[] = {100, 1000, 10000};
+    for (int count : counts) {
+        count = std::min(count, (int) quads.size());
+        DrawQueue queue;
+        Result result;
+        result.name = "draw_count";
+        result.params.push_back({"draws", (double) count});
+        measure(frames, result, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            queue.clear();
+            for (int i = 0; i < count; i++) {
+                DrawCommand command = make_draw_command(arena, quads[i], program);
+                queue.submit(DrawQueue::makeKey(PASS_OPAQUE, command.program, command.vao, 0.0f), command);
+            }
+            queue.sort();
+            queue.execute(IDENTITY);
+        });
+        result.metrics.push_back({"cpu_ns_per_draw", result.cpuMs * 1e6 / count});
+        result.metrics.push_back({"frame_ns_per_draw", result.frameMs * 1e6 / count});
+        results.push_back(result);
+    }
+}
+
+// Switches program every draw, cycling through `programCount` programs; one program is the baseline
+static void bench_program_switches(int frames, const GeometryArena &arena, const std::vector<MeshHandle> &quads,
+                                   const std::vector<unsigned int> &programs, std::vector<Result> &results) {
+    const int draws = std::min(4096, (int) quads.size());
+    const int programCounts[] = {1, 2, 16};
+    for (int programCount : programCounts) {
+        programCount = std::min(programCount, (int) programs.size());
+        std::vector<DrawCommand> commands;
+        for (int i = 0; i < draws; i++) {
+            commands.push_back(make_draw_command(arena, quads[i], programs[i % programCount]));
+        }
+        GLStateCache &state = gl_state();
+        state.bindVertexArray(commands[0].vao);
+        Result result;
+        result.name = "program_switches";
+        result.params.push_back({"draws", (double) draws});
+        result.params.push_back({"programs", (double) programCount});
+        measure(frames, result, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            for (const DrawCommand &command : commands) {
+                state.useProgram(command.program);
+                draw(command);
+            }
+        });
+        result.metrics.push_back({"switches", programCount > 1 ? (double) draws : 1.0});
+        result.metrics.push_back({"cpu_ns_per_draw", result.cpuMs * 1e6 / draws});
+        results.push_back(result);
+    }
+}
+
+// Switches VAO every draw by taking the quads from arena pages in turn; a single page is the baseline
+static void bench_vao_switches(int frames, unsigned int program, std::vector<Result> &results) {
+    const int draws = 4096;
+    const int quadsPerPage[] = {draws, 16};
+    for (int perPage : quadsPerPage) {
+        // Byte or 16-bit indices, six per quad
+        GeometryArena arena((size_t) perPage * 4, (size_t) perPage * 6 * 2);
+        std::mt19937 random(RENDER_BENCH_SEED);
+        std::vector<MeshHandle> quads = add_quads(arena, draws, random);
+        int pages = (draws + perPage - 1) / perPage;
+        std::vector<DrawCommand> commands;
+        for (int i = 0; i < draws; i++) {
+            // Consecutive draws from different pages
+            int index = (i % pages) * perPage + i / pages;
+            commands.push_back(make_draw_command(arena, quads[std::min(index, draws - 1)], program));
+        }
+        GLStateCache &state = gl_state();
+        state.useProgram(program);
+        unsigned int vaoChanges = 0;
+        Result result;
+        result.name = "vao_switches";
+        result.params.push_back({"draws", (double) draws});
+        result.params.push_back({"vaos", (double) pages});
+        measure(frames, result, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            unsigned int lastVao = 0;
+            vaoChanges = 0;
+            for (const DrawCommand &command : commands) {
+                if (command.vao != lastVao) {
+                    state.bindVertexArray(command.vao);
+                    lastVao = command.vao;
+                    vaoChanges++;
+                }
+                draw(command);
+            }
+        });
+        result.metrics.push_back({"switches", (double) vaoChanges});
+        result.metrics.push_back({"cpu_ns_per_draw", result.cpuMs * 1e6 / draws});
+        results.push_back(result);
+        state.bindVertexArray(0);
+        arena.destroy();
+    }
+}
+
+enum UploadMethod {
+    UPLOAD_BUFFER_SUB_DATA,
+    UPLOAD_ORPHAN,
+    UPLOAD_MAP_INVALIDATE,
+    UPLOAD_STREAM_BUFFER
+};
+
+static const char *UPLOAD_METHOD_NAMES[] = {"buffer_sub_data", "orphan", "map_invalidate", "stream_buffer"};
+
+// Writes `size` bytes per frame and draws a triangle sourced from them, so the driver cannot drop the upload
+static void bench_uploads(int frames, std::vector<Result> &results) {
+    const size_t sizes[] = {64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+    unsigned int program = make_program(vertexShaderSource, 1.0f, 1.0f, 1.0f);
+    // All zeros: the triangle is degenerate and costs no fill
+    std::vector<unsigned char> data(sizes[2], 0);
+    GLStateCache &state = gl_state();
+
+    unsigned int vao = 0, buffer = 0;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &buffer);
+    StreamBuffer stream;
+    stream.init(STREAM_BUFFER_SIZE);
+
+    for (size_t size : sizes) {
+        for (int method = UPLOAD_BUFFER_SUB_DATA; method <= UPLOAD_STREAM_BUFFER; method++) {
+            state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) size, NULL, GL_STREAM_DRAW);
+            Result result;
+            result.name = "upload";
+            result.variant = UPLOAD_METHOD_NAMES[method];
+            result.params.push_back({"bytes", (double) size});
+            unsigned int failedWrites = 0;
+            measure(frames, result, [&]() {
+                size_t offset = 0;
+                unsigned int source = buffer;
+                if (method == UPLOAD_STREAM_BUFFER) {
+                    long long streamOffset = stream.write(data.data(), size, 16);
+                    if (streamOffset < 0) {
+                        // Nothing was uploaded to draw from; failed_writes flags the case instead
+                        failedWrites++;
+                        return;
+                    }
+                    offset = (size_t) streamOffset;
+                    source = stream.buffer();
+                } else {
+                    state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+                    if (method == UPLOAD_ORPHAN) {
+                        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) size, NULL, GL_STREAM_DRAW);
+                    }
+                    if (method == UPLOAD_MAP_INVALIDATE) {
+                        void *target = glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr) size,
+                                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                        if (target != nullptr) {
+                            std::memcpy(target, data.data(), size);
+                            glUnmapBuffer(GL_ARRAY_BUFFER);
+                        }
+                    } else {
+                        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) size, data.data());
+                    }
+                }
+                state.useProgram(program);
+                state.bindVertexArray(vao);
+                state.bindBuffer(GL_ARRAY_BUFFER, source);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) offset);
+                glEnableVertexAttribArray(0);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                if (method == UPLOAD_STREAM_BUFFER) {
+                    stream.endFrame();
+                }
+            });
+            result.metrics.push_back({"frame_mb_per_s", result.frameMs > 0.0 ? size / 1e3 / result.frameMs : 0.0});
+            if (method == UPLOAD_STREAM_BUFFER) {
+                // Any failure makes the timings above meaningless
+                result.metrics.push_back({"failed_writes", (double) failedWrites});
+            }
+            results.push_back(result);
+        }
+    }
+
+    state.bindVertexArray(0);
+    stream.destroy();
+    state.deleteVertexArray(vao);
+    state.deleteBuffer(buffer);
+    state.deleteProgram(program);
+}
+
+// The same rectangles as one instanced draw of streamed instance data, and as one draw each with the rectangle in
+// the position uniforms
+static void bench_instancing(int frames, const GeometryArena &arena, const MeshHandle &unitQuad,
+                             unsigned int program, std::vector<Result> &results) {
+    InstancedQuads instanced;
+    if (!instanced.init()) {
+        return;
+    }
+    StreamBuffer stream;
+    stream.init(STREAM_BUFFER_SIZE);
+    const int counts[] = {1000, 10000};
+    for (int count : counts) {
+        std::vector<QuadInstance> quads = make_quad_grid(count);
+        DrawQueue queue;
+
+        Result instancedResult;
+        instancedResult.name = "instancing";
+        instancedResult.variant = "instanced";
+        instancedResult.params.push_back({"quads", (double) count});
+        unsigned int failedUploads = 0;
+        measure(frames, instancedResult, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            if (!instanced.setInstances(stream, quads)) {
+                failedUploads++;
+                return;
+            }
+            queue.clear();
+            queue.submit(DrawQueue::makeKey(PASS_OPAQUE, instanced.program(), instanced.vao(), 0.0f),
+                         instanced.drawCommand());
+            queue.sort();
+            queue.execute(IDENTITY);
+            stream.endFrame();
+        });
+        instancedResult.metrics.push_back({"failed_uploads", (double) failedUploads});
+        results.push_back(instancedResult);
+
+        Result individualResult;
+        individualResult.name = "instancing";
+        individualResult.variant = "individual";
+        individualResult.params.push_back({"quads", (double) count});
+        measure(frames, individualResult, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            queue.clear();
+            for (const QuadInstance &quad : quads) {
+                DrawCommand command = make_draw_command(arena, unitQuad, program);
+                command.positionScale[0] = quad.scale[0];
+                command.positionScale[1] = quad.scale[1];
+                command.positionOffset[0] = quad.offset[0];
+                command.positionOffset[1] = quad.offset[1];
+                queue.submit(DrawQueue::makeKey(PASS_OPAQUE, command.program, command.vao, 0.0f), command);
+            }
+            queue.sort();
+            queue.execute(IDENTITY);
+        });
+        double speedup = instancedResult.frameMs > 0.0 ? individualResult.frameMs / instancedResult.frameMs : 0.0;
+        individualResult.metrics.push_back({"instanced_speedup", speedup});
+        results.push_back(individualResult);
+    }
+    stream.destroy();
+    instanced.destroy();
+}
+
+// Distinct sources each time, so the driver's shader cache cannot answer from an earlier run
+static std::string unique_vertex_source() {
+    static unsigned int variant = 0;
+    std::ostringstream source;
+    source << vertexShaderSource << "// variant " << RENDER_BENCH_SEED << " " << now_ms() << " " << variant++ << "\n";
+    return source.str();
+}
+
+// Builds `programs` programs one at a time, waiting on each, and then all at once through a ShaderBuilder that submits
+// every compile before collecting any
+static void bench_shader_compile(int programs, std::vector<Result> &results) {
+    GLStateCache &state = gl_state();
+    std::vector<double> times;
+    double start = now_ms();
+    for (int i = 0; i < programs; i++) {
+        std::string vertexSource = unique_vertex_source();
+        double programStart = now_ms();
+        unsigned int program = build_program(vertexSource.c_str(), fragmentShaderSource);
+        times.push_back(now_ms() - programStart);
+        state.deleteProgram(program);
+    }
+    double serialMs = now_ms() - start;
+    Result serial;
+    serial.name = "shader_compile";
+    serial.variant = "serial";
+    serial.params.push_back({"programs", (double) programs});
+    serial.cpuMs = serial.frameMs = median(times);
+    serial.metrics.push_back({"ms_per_program", median(times)});
+    serial.metrics.push_back({"total_ms", serialMs});
+    results.push_back(serial);
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < programs; i++) {
+        sources.push_back(unique_vertex_source());
+    }
+    ProgramCache cache;
+    ShaderBuilder builder;
+    builder.init(cache);
+    std::vector<ShaderBuilder::Ticket> tickets;
+    start = now_ms();
+    for (const std::string &source : sources) {
+        tickets.push_back(builder.submit(source.c_str(), fragmentShaderSource));
+    }
+    double submitMs = now_ms() - start;
+    for (ShaderBuilder::Ticket ticket : tickets) {
+        state.deleteProgram(builder.finish(ticket));
+    }
+    double batchedMs = now_ms() - start;
+    Result batched;
+    batched.name = "shader_compile";
+    batched.variant = "batched";
+    batched.params.push_back({"programs", (double) programs});
+    batched.cpuMs = batched.frameMs = batchedMs / programs;
+    batched.metrics.push_back({"ms_per_program", batchedMs / programs});
+    batched.metrics.push_back({"total_ms", batchedMs});
+    batched.metrics.push_back({"submit_ms", submitMs});
+    batched.metrics.push_back({"parallel_compile", GLAD_GL_KHR_parallel_shader_compile ? 1.0 : 0.0});
+    results.push_back(batched);
+}
+
+static void write_json_pairs(std::ostream &out, const std::vector<std::pair<std::string, double>> &pairs) {
+    out << "{";
+    for (size_t i = 0; i < pairs.size(); i++) {
+        out << (i > 0 ? ", " : "") << "\"" << pairs[i].first << "\": " << pairs[i].second;
+    }
+    out << "}";
+}
+
+static void write_json(std::ostream &out, int frames, const std::vector<Result> &results) {
+    const char *renderer = (const char *) glGetString(GL_RENDERER);
+    const char *version = (const char *) glGetString(GL_VERSION);
+    // Enough digits for byte counts to come out exact
+    out.precision(12);
+    out << "{\n  \"benchmark\": \"render_bench\",\n  \"seed\": " << RENDER_BENCH_SEED << ",\n  \"frames\": " << frames
+        << ",\n  \"gl_renderer\": \"" << (renderer != nullptr ? renderer : "") << "\",\n  \"gl_version\": \""
+        << (version != nullptr ? version : "") << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", ";
+        if (!result.variant.empty()) {
+            out << "\"variant\": \"" << result.variant << "\", ";
+        }
+        out << "\"params\": ";
+        write_json_pairs(out, result.params);
+        out << ", \"cpu_ms\": " << result.cpuMs << ", \"frame_ms\": " << result.frameMs << ", \"metrics\": ";
+        write_json_pairs(out, result.metrics);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    int frames = 50;
+    const char *outputPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--frames N] [--output FILE]" << std::endl;
+            return -1;
+        }
+    }
+
+    HeadlessContext context;
+    if (!context.create(TARGET_SIZE, TARGET_SIZE)) {
+        std::cout << "Failed to create headless context" << std::endl;
+        return -1;
+    }
+    if (!gladLoadGLLoader((GLADloadproc) HeadlessContext::getProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    if (!context.createFramebuffer()) {
+        return -1;
+    }
+    glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    std::vector<unsigned int> programs;
+    std::mt19937 random(RENDER_BENCH_SEED);
+    std::uniform_real_distribution<float> channel(0.2f, 1.0f);
+    for (int i = 0; i < 16; i++) {
+        unsigned int program = make_program(vertexShaderSource, channel(random), channel(random), channel(random));
+        if (program == 0) {
+            return -1;
+        }
+        programs.push_back(program);
+    }
+
+    GeometryArena arena;
+    std::vector<MeshHandle> quads = add_quads(arena, 10000, random);
+    const float unitVertices[12] = {0.5f, 0.5f, 0.0f, 0.5f, -0.5f, 0.0f, -0.5f, -0.5f, 0.0f, -0.5f, 0.5f, 0.0f};
+    const unsigned int unitIndices[6] = {0, 1, 3, 1, 2, 3};
+    MeshHandle unitQuad = arena.addMesh(unitVertices, 4, unitIndices, 6);
+
+    std::vector<Result> results;
+    bench_draw_count(frames, arena, quads, programs[0], results);
+    bench_program_switches(frames, arena, quads, programs, results);
+    bench_vao_switches(frames, programs[0], results);
+    bench_uploads(frames, results);
+    bench_instancing(frames, arena, unitQuad, programs[0], results);
+    bench_shader_compile(std::max(frames / 5, 5), results);
+
+    if (outputPath != nullptr) {
+        std::ofstream file(outputPath, std::ios::trunc);
+        if (!file) {
+            std::cout << "ERROR::RENDER_BENCH::CANNOT_CREATE " << outputPath << std::endl;
+            return -1;
+        }
+        write_json(file, frames, results);
+    } else {
+        write_json(std::cout, frames, results);
+    }
+
+    GLStateCache &state = gl_state();
+    for (unsigned int program : programs) {
+        state.deleteProgram(program);
+    }
+    arena.destroy();
+    return 0;
+}
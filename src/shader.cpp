@@ -0,0 +1,63 @@
+#include "shader.h"
+
+#include <iostream>
+
+unsigned int compile_shader(GLenum type, const char *source) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    if (!check_shader(shader, type)) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+unsigned int link_program(unsigned int vertexShader, unsigned int fragmentShader) {
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    if (!check_program(program)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool check_shader(unsigned int shader, GLenum type) {
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT")
+                  << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool check_program(unsigned int program) {
+    int success;
+    char infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        return false;
+    }
+    return true;
+}
+
+unsigned int build_program(const char *vertexSource, const char *fragmentSource) {
+    unsigned int vertexShader = compile_shader(GL_VERTEX_SHADER, vertexSource);
+    unsigned int fragmentShader = compile_shader(GL_FRAGMENT_SHADER, fragmentSource);
+    unsigned int program = 0;
+    if (vertexShader != 0 && fragmentShader != 0) {
+        program = link_program(vertexShader, fragmentShader);
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
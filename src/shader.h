@@ -0,0 +1,21 @@
+#ifndef PROJECT_SHADER_H
+#define PROJECT_SHADER_H
+
+#include <glad/glad.h>
+
+// Compiles a single shader stage, printing the info log on failure. Returns 0 if compilation failed.
+unsigned int compile_shader(GLenum type, const char *source);
+
+// Links a vertex + fragment shader pair into a program, printing the info log on failure. Returns 0 if linking
+// failed. The shaders are left attached; the caller still owns them.
+unsigned int link_program(unsigned int vertexShader, unsigned int fragmentShader);
+
+// Read the compile or link status, printing the info log on failure. Both wait for the driver to finish the shader or
+// program, so callers that want compiles to overlap issue all of them first and check afterwards.
+bool check_shader(unsigned int shader, GLenum type);
+bool check_program(unsigned int program);
+
+// Convenience wrapper that compiles both stages, links them and deletes the shader objects.
+unsigned int build_program(const char *vertexSource, const char *fragmentSource);
+
+#endif //PROJECT_SHADER_H
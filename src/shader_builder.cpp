@@ -0,0 +1,184 @@
+#include "shader_builder.h"
+
+#include <chrono>
+#include <iostream>
+#include <glad/glad.h>
+
+#include "cpu_profiler.h"
+
+static const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The number of compiler threads is per context; this leaves the choice to the driver
+static void allow_parallel_compile() {
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    }
+}
+
+ShaderBuilder::~ShaderBuilder() {
+    stop();
+}
+
+void ShaderBuilder::init(ProgramCache &cache) {
+    cache_ = &cache;
+    allow_parallel_compile();
+}
+
+bool ShaderBuilder::startThread(void *context, MakeCurrent makeCurrent, ReleaseCurrent releaseCurrent) {
+    if (cache_ == nullptr || worker_.joinable()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Requests submitted before were issued on this thread's context and the worker never sees them, so they are
+    // finished here; finish() then finds them done
+    for (Request &request : requests_) {
+        if (!request.done) {
+            request.program = cache_->finish(request.pending);
+            request.done = true;
+        }
+    }
+    nextRequest_ = requests_.size();
+    stopping_ = false;
+    started_ = startFailed_ = false;
+    worker_ = std::thread(&ShaderBuilder::workerMain, this, context, makeCurrent, releaseCurrent);
+    built_.wait(lock, [this] { return started_; });
+    if (startFailed_) {
+        lock.unlock();
+        worker_.join();
+        std::cout << "ERROR::SHADER_BUILDER::CANNOT_MAKE_CONTEXT_CURRENT building on the calling thread" << std::endl;
+        return false;
+    }
+    usedWorker_ = true;
+    return true;
+}
+
+void ShaderBuilder::stop() {
+    if (!worker_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+}
+
+ShaderBuilder::Ticket ShaderBuilder::submit(const char *vertexSource, const char *fragmentSource,
+                                            const char *defines) {
+    auto start = std::chrono::steady_clock::now();
+    Ticket ticket;
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ticket = (Ticket) requests_.size();
+            requests_.emplace_back();
+            Request &request = requests_.back();
+            request.vertexSource = vertexSource;
+            request.fragmentSource = fragmentSource;
+            request.defines = defines;
+        }
+        wake_.notify_one();
+    } else {
+        ticket = (Ticket) requests_.size();
+        requests_.emplace_back();
+        requests_.back().pending = cache_->begin(vertexSource, fragmentSource, defines);
+    }
+    stats_.programs++;
+    stats_.submitMs += milliseconds_since(start);
+    return ticket;
+}
+
+bool ShaderBuilder::ready(Ticket ticket) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Request &request = requests_[ticket];
+    return request.done || (!worker_.joinable() && cache_->ready(request.pending));
+}
+
+unsigned int ShaderBuilder::finish(Ticket ticket) {
+    PROFILE_ZONE("shader finish");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    Request &request = requests_[ticket];
+    if (!request.done) {
+        if (worker_.joinable()) {
+            built_.wait(lock, [&request] { return request.done; });
+        } else {
+            request.program = cache_->finish(request.pending);
+            request.done = true;
+        }
+    }
+    unsigned int program = request.program;
+    request.program = 0;
+    stats_.waitMs += milliseconds_since(start);
+    return program;
+}
+
+const char *ShaderBuilder::modeName() const {
+    if (usedWorker_) {
+        return "worker thread";
+    }
+    return GLAD_GL_KHR_parallel_shader_compile ? "parallel compile" : "serial";
+}
+
+void ShaderBuilder::workerMain(void *context, MakeCurrent makeCurrent, ReleaseCurrent releaseCurrent) {
+    PROFILE_THREAD_NAME("shader builder");
+    bool current = makeCurrent(context);
+    if (current) {
+        allow_parallel_compile();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    started_ = true;
+    startFailed_ = !current;
+    built_.notify_all();
+    if (!current) {
+        return;
+    }
+
+    std::vector<Request *> batch;
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || nextRequest_ < requests_.size(); });
+        if (nextRequest_ == requests_.size()) {
+            break;
+        }
+        batch.clear();
+        for (; nextRequest_ < requests_.size(); nextRequest_++) {
+            batch.push_back(&requests_[nextRequest_]);
+        }
+        lock.unlock();
+        buildBatch(batch);
+        lock.lock();
+        for (Request *request : batch) {
+            request->done = true;
+        }
+        built_.notify_all();
+    }
+    lock.unlock();
+    releaseCurrent(context);
+}
+
+void ShaderBuilder::buildBatch(const std::vector<Request *> &batch) {
+    PROFILE_ZONE("shader build");
+    // Issue every compile before waiting on any
+    for (Request *request : batch) {
+        request->pending = cache_->begin(request->vertexSource.c_str(), request->fragmentSource.c_str(),
+                                         request->defines.c_str());
+    }
+    for (Request *request : batch) {
+        request->program = cache_->finish(request->pending);
+    }
+    // Another context is only guaranteed to see the programs once the commands that made them have completed
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLenum result;
+    do {
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    if (result == GL_WAIT_FAILED) {
+        std::cout << "ERROR::SHADER_BUILDER::FENCE_WAIT_FAILED" << std::endl;
+    }
+    glDeleteSync(fence);
+}
@@ -0,0 +1,93 @@
+#ifndef PROJECT_SHADER_BUILDER_H
+#define PROJECT_SHADER_BUILDER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "program_cache.h"
+
+// Builds programs without stalling on each one. submit() hands the sources over and returns at once; finish() collects
+// a program where it is first needed, and is the only call that waits. Programs go through a ProgramCache, so a cached
+// binary is loaded instead of compiled.
+//
+// By default everything runs on the calling thread's context: submit() issues the compiles and the link, and nothing
+// reads a status until finish(). With KHR_parallel_shader_compile the driver compiles on its own threads meanwhile.
+// With startThread(), a worker thread builds the programs on a second context sharing objects with the caller's, so
+// even a driver that compiles inside glCompileShader or the first status query never holds up the caller.
+class ShaderBuilder {
+public:
+    using Ticket = uint32_t;
+    // Make a shared context current on, or release it from, the calling thread
+    using MakeCurrent = bool (*)(void *context);
+    using ReleaseCurrent = void (*)(void *context);
+
+    struct Stats {
+        unsigned int programs = 0;
+        // Time the caller spent in submit() and waiting in finish()
+        double submitMs = 0.0;
+        double waitMs = 0.0;
+    };
+
+    ShaderBuilder() = default;
+    ~ShaderBuilder();
+    ShaderBuilder(const ShaderBuilder &) = delete;
+    ShaderBuilder &operator=(const ShaderBuilder &) = delete;
+
+    // On the thread whose context is current. Lets the driver use as many compiler threads as it likes.
+    void init(ProgramCache &cache);
+    // Builds everything submitted from now on on a worker thread with `context` current; false if it cannot make it
+    // current. Programs submitted before are finished first, on the calling thread. The cache belongs to the worker
+    // until stop().
+    bool startThread(void *context, MakeCurrent makeCurrent, ReleaseCurrent releaseCurrent);
+    // Builds whatever is still queued and joins the worker
+    void stop();
+
+    Ticket submit(const char *vertexSource, const char *fragmentSource, const char *defines = "");
+    // Whether finish() would return without waiting
+    bool ready(Ticket ticket) const;
+    // Waits for the program if it is not built yet and hands it over, once per ticket. 0 if it failed to build; the
+    // info log has been printed.
+    unsigned int finish(Ticket ticket);
+
+    bool threaded() const { return worker_.joinable(); }
+    // How programs were built: "worker thread" (if it ever ran), "parallel compile" or "serial"
+    const char *modeName() const;
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Request {
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::string defines;
+        PendingProgram pending;
+        unsigned int program = 0;
+        bool done = false;
+    };
+
+    void workerMain(void *context, MakeCurrent makeCurrent, ReleaseCurrent releaseCurrent);
+    void buildBatch(const std::vector<Request *> &batch);
+
+    ProgramCache *cache_ = nullptr;
+    Stats stats_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable built_;
+    // Only ever appended to, so references into it stay valid while the worker builds
+    std::deque<Request> requests_;
+    // First request the worker has not picked up
+    size_t nextRequest_ = 0;
+    bool stopping_ = false;
+    // Set by the worker once it has tried to make its context current
+    bool started_ = false;
+    bool startFailed_ = false;
+    bool usedWorker_ = false;
+    std::thread worker_;
+};
+
+#endif //PROJECT_SHADER_BUILDER_H
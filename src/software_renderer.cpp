@@ -0,0 +1,497 @@
+#include "software_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "cpu_profiler.h"
+#include "job_system.h"
+#include "packed_mesh.h"
+#include "vertex_format.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SOFTWARE_X86 1
+#include <immintrin.h>
+#endif
+
+// Only AVX2 proper: with FMA enabled the compiler could fuse the edge multiply-adds and the paths would differ
+#if defined(SOFTWARE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SOFTWARE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SOFTWARE_TARGET_AVX2
+#endif
+
+// Program names; 0 stays "no program" as in GL
+static const unsigned int INSTANCE_PROGRAM = 1;
+
+// Source triangles set up per job
+static const size_t SETUP_CHUNK = 2048;
+
+// Vertices snap to this fraction of a pixel, like the subpixel precision of GL rasterizers
+static const float SUBPIXEL_STEPS = 256.0f;
+
+// The instance program's unit quad, as in InstancedQuads
+static const float QUAD_CORNERS[4][2] = {{0.5f, 0.5f}, {0.5f, -0.5f}, {-0.5f, -0.5f}, {-0.5f, 0.5f}};
+static const unsigned int QUAD_INDICES[6] = {0, 1, 3, 1, 2, 3};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// RGBA8 with red in the low byte. Converted like GL drivers do: the float product rounded to nearest even, so 0.3
+// becomes 76 and 0.5 becomes 128.
+static uint32_t pack_color(const float color[4]) {
+    uint32_t packed = 0;
+    for (int channel = 0; channel < 4; channel++) {
+        float value = std::max(0.0f, std::min(1.0f, color[channel]));
+        packed |= (uint32_t) std::lrint(value * 255.0f) << (channel * 8);
+    }
+    return packed;
+}
+
+static uint32_t read_index(const unsigned char *indices, GLenum type, size_t i) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+            return indices[i];
+        case GL_UNSIGNED_SHORT: {
+            uint16_t index;
+            std::memcpy(&index, indices + i * 2, sizeof(index));
+            return index;
+        }
+        default: {
+            uint32_t index;
+            std::memcpy(&index, indices + i * 4, sizeof(index));
+            return index;
+        }
+    }
+}
+
+// Clips a polygon of clip-space vertices against distance(v) >= 0, with distance = z + w (near) or w - z (far).
+// New vertices are interpolated from the inside end of the edge, so triangles sharing an edge get the same point.
+static int clip_polygon(const float in[][4], int count, float sign, float out[][4]) {
+    int outCount = 0;
+    for (int i = 0; i < count; i++) {
+        const float *a = in[i];
+        const float *b = in[(i + 1) % count];
+        float da = a[3] + sign * a[2], db = b[3] + sign * b[2];
+        if (da >= 0.0f) {
+            std::memcpy(out[outCount++], a, sizeof(float) * 4);
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            const float *inside = da >= 0.0f ? a : b;
+            const float *outside = da >= 0.0f ? b : a;
+            float dIn = da >= 0.0f ? da : db, dOut = da >= 0.0f ? db : da;
+            float t = dIn / (dIn - dOut);
+            for (int component = 0; component < 4; component++) {
+                out[outCount][component] = inside[component] + (outside[component] - inside[component]) * t;
+            }
+            outCount++;
+        }
+    }
+    return outCount;
+}
+
+SoftwareRenderer::SoftwareRenderer() : path_(best_cull_path()) {
+    // Name 1 is the instance program, whose color comes from the instances
+    programColors_.push_back(0);
+    std::memset(viewProjection_, 0, sizeof(viewProjection_));
+}
+
+unsigned int SoftwareRenderer::createProgram(const float color[4]) {
+    programColors_.push_back(pack_color(color));
+    return (unsigned int) programColors_.size();
+}
+
+unsigned int SoftwareRenderer::instanceProgram() const {
+    return INSTANCE_PROGRAM;
+}
+
+void SoftwareRenderer::setInstances(const std::vector<QuadInstance> &instances) {
+    instances_ = instances;
+}
+
+DrawCommand SoftwareRenderer::instanceDrawCommand() const {
+    DrawCommand command;
+    command.program = INSTANCE_PROGRAM;
+    command.count = 6;
+    command.instanceCount = (GLsizei) instances_.size();
+    return command;
+}
+
+void SoftwareRenderer::resize(int width, int height) {
+    width_ = std::max(width, 0);
+    height_ = std::max(height, 0);
+    tilesX_ = (width_ + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY_ = (height_ + TILE_SIZE - 1) / TILE_SIZE;
+    stride_ = tilesX_ * TILE_SIZE;
+    pixels_.assign((size_t) stride_ * tilesY_ * TILE_SIZE, 0);
+}
+
+void SoftwareRenderer::clear(const float color[4]) {
+    clearColor_ = pack_color(color);
+    clearPending_ = true;
+}
+
+void SoftwareRenderer::execute(const DrawQueue &queue, const GeometryArena &arena, const float viewProjection[16],
+                               JobSystem *jobs) {
+    PROFILE_ZONE("software execute");
+    auto startTime = std::chrono::steady_clock::now();
+    std::memcpy(viewProjection_, viewProjection, sizeof(viewProjection_));
+    stats_ = Stats();
+
+    // Resolve every draw to its page and color and number the triangles across all of them
+    sources_.clear();
+    size_t triangleCount = 0;
+    for (size_t i = 0; i < queue.size(); i++) {
+        const DrawCommand &command = queue.sorted(i);
+        Source source = {command, nullptr, 0, triangleCount};
+        size_t triangles;
+        if (command.program == INSTANCE_PROGRAM) {
+            triangles = 2 * std::min(instances_.size(), (size_t) std::max(command.instanceCount, 0));
+        } else {
+            for (const GeometryArena::Page &page : arena.pages()) {
+                if (page.vao == command.vao) {
+                    source.page = &page;
+                }
+            }
+            if (source.page == nullptr || command.program == 0 || command.program > programColors_.size()) {
+                if (!reportedUnknownDraw_) {
+                    std::cout << "ERROR::SOFTWARE_RENDERER::UNKNOWN_DRAW program " << command.program << " vao "
+                              << command.vao << std::endl;
+                    reportedUnknownDraw_ = true;
+                }
+                continue;
+            }
+            source.color = programColors_[command.program - 1];
+            triangles = (size_t) std::max(command.count, 0) / 3 * (size_t) std::max(command.instanceCount, 1);
+        }
+        sources_.push_back(source);
+        triangleCount += triangles;
+    }
+    stats_.draws = sources_.size();
+
+    chunkCount_ = (triangleCount + SETUP_CHUNK - 1) / SETUP_CHUNK;
+    if (chunks_.size() < chunkCount_) {
+        chunks_.resize(chunkCount_);
+    }
+    auto setup = [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            setupChunk(chunk, chunk * SETUP_CHUNK, std::min((chunk + 1) * SETUP_CHUNK, triangleCount));
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallelFor(chunkCount_, 1, setup);
+    } else {
+        setup(0, chunkCount_);
+    }
+    for (size_t chunk = 0; chunk < chunkCount_; chunk++) {
+        stats_.triangles += chunks_[chunk].triangles.size();
+        for (const std::vector<uint32_t> &bin : chunks_[chunk].bins) {
+            stats_.binned += bin.size();
+        }
+    }
+    stats_.setupMs = elapsed_ms(startTime);
+
+    auto rasterStart = std::chrono::steady_clock::now();
+    auto fill = [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++) {
+            fillTile((int) tile);
+        }
+    };
+    size_t tileCount = (size_t) tilesX_ * tilesY_;
+    if (jobs != nullptr) {
+        jobs->parallelFor(tileCount, 1, fill);
+    } else {
+        fill(0, tileCount);
+    }
+    clearPending_ = false;
+    stats_.rasterMs = elapsed_ms(rasterStart);
+}
+
+void SoftwareRenderer::setupChunk(size_t chunkIndex, size_t firstTriangle, size_t lastTriangle) {
+    Chunk &chunk = chunks_[chunkIndex];
+    chunk.triangles.clear();
+    chunk.bins.resize((size_t) tilesX_ * tilesY_);
+    for (std::vector<uint32_t> &bin : chunk.bins) {
+        bin.clear();
+    }
+
+    // Last source starting at or before the first triangle; empty sources are skipped by the loop below
+    size_t sourceIndex = (size_t) (std::upper_bound(sources_.begin(), sources_.end(), firstTriangle,
+                                                    [](size_t triangle, const Source &source) {
+                                                        return triangle < source.firstTriangle;
+                                                    }) - sources_.begin()) - 1;
+    for (size_t triangle = firstTriangle; triangle < lastTriangle; triangle++) {
+        while (sourceIndex + 1 < sources_.size() && sources_[sourceIndex + 1].firstTriangle <= triangle) {
+            sourceIndex++;
+        }
+        const Source &source = sources_[sourceIndex];
+        setupTriangle(source, triangle - source.firstTriangle, chunk);
+    }
+}
+
+void SoftwareRenderer::setupTriangle(const Source &source, size_t triangle, Chunk &chunk) const {
+    const DrawCommand &command = source.command;
+    float polygon[5][4], clipped[5][4];
+    uint32_t color = source.color;
+
+    for (int corner = 0; corner < 3; corner++) {
+        float position[3];
+        if (source.page == nullptr) {
+            const QuadInstance &instance = instances_[triangle / 2];
+            const float *quad = QUAD_CORNERS[QUAD_INDICES[triangle % 2 * 3 + corner]];
+            position[0] = quad[0] * instance.scale[0] + instance.offset[0];
+            position[1] = quad[1] * instance.scale[1] + instance.offset[1];
+            position[2] = 0.0f;
+            color = pack_color(instance.color);
+        } else {
+            // Instanced draws of arena meshes repeat the same triangles
+            size_t perInstance = (size_t) command.count / 3;
+            const GeometryArena::Page &page = *source.page;
+            size_t indexSize = index_type_size(command.indexType);
+            size_t i = command.indexOffset / indexSize + triangle % perInstance * 3 + corner;
+            if ((i + 1) * indexSize > page.indexData.size()) {
+                return;
+            }
+            size_t vertex = (size_t) command.baseVertex + read_index(page.indexData.data(), command.indexType, i);
+            size_t stride = vertex_format_stride(page.format);
+            if ((vertex + 1) * stride > page.vertexData.size()) {
+                return;
+            }
+            decode_position(page.vertexData.data() + vertex * stride, page.format, position);
+            for (int axis = 0; axis < 3; axis++) {
+                position[axis] = position[axis] * command.positionScale[axis] + command.positionOffset[axis];
+            }
+        }
+        const float *m = viewProjection_;
+        for (int row = 0; row < 4; row++) {
+            polygon[corner][row] = m[row] * position[0] + m[4 + row] * position[1] + m[8 + row] * position[2] +
+                                   m[12 + row];
+        }
+    }
+
+    int corners = clip_polygon(polygon, 3, 1.0f, clipped);
+    corners = clip_polygon(clipped, corners, -1.0f, polygon);
+    if (corners < 3) {
+        return;
+    }
+
+    // Viewport transform, snapped to the subpixel grid
+    float screen[5][2];
+    for (int corner = 0; corner < corners; corner++) {
+        float w = polygon[corner][3];
+        if (!(w > 0.0f)) {
+            return;
+        }
+        float x = (polygon[corner][0] / w + 1.0f) * 0.5f * (float) width_;
+        float y = (polygon[corner][1] / w + 1.0f) * 0.5f * (float) height_;
+        screen[corner][0] = std::round(x * SUBPIXEL_STEPS) / SUBPIXEL_STEPS;
+        screen[corner][1] = std::round(y * SUBPIXEL_STEPS) / SUBPIXEL_STEPS;
+    }
+    for (int corner = 2; corner < corners; corner++) {
+        addTriangle(screen[0], screen[corner - 1], screen[corner], color, chunk);
+    }
+}
+
+void SoftwareRenderer::addTriangle(const float v0[2], const float v1[2], const float v2[2], uint32_t color,
+                                   Chunk &chunk) const {
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+    if (area == 0.0f || !std::isfinite(area)) {
+        return;
+    }
+    // Face culling is off, so both windings draw; make the edge functions positive inside
+    if (area < 0.0f) {
+        std::swap(v1, v2);
+    }
+
+    float minX = std::min(v0[0], std::min(v1[0], v2[0]));
+    float maxX = std::max(v0[0], std::max(v1[0], v2[0]));
+    float minY = std::min(v0[1], std::min(v1[1], v2[1]));
+    float maxY = std::max(v0[1], std::max(v1[1], v2[1]));
+    if (maxX < 0.0f || maxY < 0.0f || minX >= (float) width_ || minY >= (float) height_) {
+        return;
+    }
+
+    Triangle triangle;
+    triangle.minX = (int) std::max(minX, 0.0f);
+    triangle.maxX = (int) std::min(maxX, (float) (width_ - 1));
+    triangle.minY = (int) std::max(minY, 0.0f);
+    triangle.maxY = (int) std::min(maxY, (float) (height_ - 1));
+    triangle.color = color;
+    triangle.topLeft = 0;
+    const float *vertices[3] = {v0, v1, v2};
+    for (int edge = 0; edge < 3; edge++) {
+        // Written so the triangle on the other side of a shared edge gets exactly the negated coefficients
+        const float *p = vertices[(edge + 1) % 3];
+        const float *q = vertices[(edge + 2) % 3];
+        triangle.a[edge] = p[1] - q[1];
+        triangle.b[edge] = q[0] - p[0];
+        triangle.c[edge] = p[0] * q[1] - p[1] * q[0];
+        // With y up and the inside on the left: left edges run downwards, top edges run right to left
+        if (triangle.a[edge] > 0.0f || (triangle.a[edge] == 0.0f && triangle.b[edge] < 0.0f)) {
+            triangle.topLeft |= 1u << edge;
+        }
+    }
+
+    uint32_t index = (uint32_t) chunk.triangles.size();
+    chunk.triangles.push_back(triangle);
+    for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; tileY++) {
+        for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; tileX++) {
+            chunk.bins[(size_t) tileY * tilesX_ + tileX].push_back(index);
+        }
+    }
+}
+
+// Pixel centers lie at half-integer coordinates. Every path evaluates a * x + (b * y + c) with the same operations,
+// so they agree bit for bit.
+static void fill_rows_scalar(const float *a, const float *b, const float *c, uint32_t topLeft, uint32_t color,
+                             int x0, int x1, int y0, int y1, uint32_t *pixels, int stride) {
+    for (int y = y0; y <= y1; y++) {
+        float centerY = (float) y + 0.5f;
+        float r[3];
+        for (int edge = 0; edge < 3; edge++) {
+            r[edge] = b[edge] * centerY + c[edge];
+        }
+        uint32_t *row = pixels + (size_t) y * stride;
+        for (int x = x0; x <= x1; x++) {
+            float centerX = (float) x + 0.5f;
+            bool inside = true;
+            for (int edge = 0; edge < 3; edge++) {
+                float e = a[edge] * centerX + r[edge];
+                inside = inside && (e > 0.0f || (e == 0.0f && (topLeft & (1u << edge)) != 0));
+            }
+            if (inside) {
+                row[x] = color;
+            }
+        }
+    }
+}
+
+#ifdef SOFTWARE_X86
+// x0 is a multiple of 4 and the rows are padded to whole tiles, so groups never leave the row
+static void fill_rows_sse(const float *a, const float *b, const float *c, uint32_t topLeft, uint32_t color,
+                          int x0, int x1, int y0, int y1, uint32_t *pixels, int stride) {
+    const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i fill = _mm_set1_epi32((int) color);
+    __m128 edgeA[3], ties[3];
+    for (int edge = 0; edge < 3; edge++) {
+        edgeA[edge] = _mm_set1_ps(a[edge]);
+        ties[edge] = _mm_castsi128_ps(_mm_set1_epi32((topLeft & (1u << edge)) != 0 ? -1 : 0));
+    }
+    for (int y = y0; y <= y1; y++) {
+        float centerY = (float) y + 0.5f;
+        __m128 r[3];
+        for (int edge = 0; edge < 3; edge++) {
+            r[edge] = _mm_set1_ps(b[edge] * centerY + c[edge]);
+        }
+        uint32_t *row = pixels + (size_t) y * stride;
+        for (int x = x0; x <= x1; x += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps((float) x), lane);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int edge = 0; edge < 3; edge++) {
+                __m128 e = _mm_add_ps(_mm_mul_ps(edgeA[edge], centerX), r[edge]);
+                __m128 owned = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(_mm_cmpeq_ps(e, zero), ties[edge]));
+                inside = _mm_and_ps(inside, owned);
+            }
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            __m128i mask = _mm_castps_si128(inside);
+            __m128i stored = _mm_loadu_si128((const __m128i *) (row + x));
+            _mm_storeu_si128((__m128i *) (row + x),
+                             _mm_or_si128(_mm_and_si128(mask, fill), _mm_andnot_si128(mask, stored)));
+        }
+    }
+}
+
+// x0 is a multiple of 8; see fill_rows_sse
+SOFTWARE_TARGET_AVX2
+static void fill_rows_avx2(const float *a, const float *b, const float *c, uint32_t topLeft, uint32_t color,
+                           int x0, int x1, int y0, int y1, uint32_t *pixels, int stride) {
+    const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i fill = _mm256_set1_epi32((int) color);
+    __m256 edgeA[3], ties[3];
+    for (int edge = 0; edge < 3; edge++) {
+        edgeA[edge] = _mm256_set1_ps(a[edge]);
+        ties[edge] = _mm256_castsi256_ps(_mm256_set1_epi32((topLeft & (1u << edge)) != 0 ? -1 : 0));
+    }
+    for (int y = y0; y <= y1; y++) {
+        float centerY = (float) y + 0.5f;
+        __m256 r[3];
+        for (int edge = 0; edge < 3; edge++) {
+            r[edge] = _mm256_set1_ps(b[edge] * centerY + c[edge]);
+        }
+        uint32_t *row = pixels + (size_t) y * stride;
+        for (int x = x0; x <= x1; x += 8) {
+            __m256 centerX = _mm256_add_ps(_mm256_set1_ps((float) x), lane);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int edge = 0; edge < 3; edge++) {
+                __m256 e = _mm256_add_ps(_mm256_mul_ps(edgeA[edge], centerX), r[edge]);
+                __m256 owned = _mm256_or_ps(_mm256_cmp_ps(e, zero, _CMP_GT_OQ),
+                                            _mm256_and_ps(_mm256_cmp_ps(e, zero, _CMP_EQ_OQ), ties[edge]));
+                inside = _mm256_and_ps(inside, owned);
+            }
+            if (_mm256_movemask_ps(inside) == 0) {
+                continue;
+            }
+            _mm256_maskstore_epi32((int *) (row + x), _mm256_castps_si256(inside), fill);
+        }
+    }
+}
+#endif
+
+void SoftwareRenderer::fillTile(int tile) {
+    int tileX0 = tile % tilesX_ * TILE_SIZE;
+    int tileY0 = tile / tilesX_ * TILE_SIZE;
+    int tileX1 = tileX0 + TILE_SIZE - 1;
+    int tileY1 = std::min(tileY0 + TILE_SIZE, height_) - 1;
+    if (clearPending_) {
+        for (int y = tileY0; y <= tileY1; y++) {
+            std::fill_n(pixels_.data() + (size_t) y * stride_ + tileX0, TILE_SIZE, clearColor_);
+        }
+    }
+
+    for (size_t chunkIndex = 0; chunkIndex < chunkCount_; chunkIndex++) {
+        const Chunk &chunk = chunks_[chunkIndex];
+        for (uint32_t index : chunk.bins[tile]) {
+            const Triangle &triangle = chunk.triangles[index];
+            int x0 = std::max(triangle.minX, tileX0), x1 = std::min(triangle.maxX, tileX1);
+            int y0 = std::max(triangle.minY, tileY0), y1 = std::min(triangle.maxY, tileY1);
+            switch (path_) {
+#ifdef SOFTWARE_X86
+                case CULL_AVX2:
+                    fill_rows_avx2(triangle.a, triangle.b, triangle.c, triangle.topLeft, triangle.color, x0 & ~7, x1,
+                                   y0, y1, pixels_.data(), stride_);
+                    break;
+                case CULL_SSE:
+                    fill_rows_sse(triangle.a, triangle.b, triangle.c, triangle.topLeft, triangle.color, x0 & ~3, x1,
+                                  y0, y1, pixels_.data(), stride_);
+                    break;
+#endif
+                default:
+                    fill_rows_scalar(triangle.a, triangle.b, triangle.c, triangle.topLeft, triangle.color, x0, x1,
+                                     y0, y1, pixels_.data(), stride_);
+                    break;
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::readPixels(int x, int y, int width, int height, unsigned char *out) const {
+    for (int row = 0; row < height; row++) {
+        for (int column = 0; column < width; column++) {
+            int px = x + column, py = y + row;
+            uint32_t pixel = 0;
+            if (px >= 0 && py >= 0 && px < width_ && py < height_) {
+                pixel = pixels_[(size_t) py * stride_ + px];
+            }
+            for (int channel = 0; channel < 4; channel++) {
+                out[((size_t) row * width + column) * 4 + channel] = (unsigned char) (pixel >> (channel * 8));
+            }
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef PROJECT_SOFTWARE_RENDERER_H
+#define PROJECT_SOFTWARE_RENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "culling.h"
+#include "draw_queue.h"
+#include "geometry_arena.h"
+#include "instancing.h"
+
+class JobSystem;
+
+// CPU implementation of the GL subset the renderer uses, for hosts without a GPU and as a reference image that does
+// not depend on the driver. It executes a sorted DrawQueue the way DrawQueue::execute() does: indexed triangle lists
+// from a GeometryArena in CPU storage mode, positions decoded and transformed by the view-projection, one flat color
+// per program, no depth test or blending, so later draws cover earlier ones.
+//
+// Programs are flat colors created here. The built-in instance program draws the unit quad once per QuadInstance
+// with the instance's offset, scale and color, like InstancedQuads.
+//
+// Triangles are clipped and set up in parallel chunks and binned into TILE_SIZE square tiles; tiles are then filled
+// in parallel, each walking the chunks' bins in draw order. Coverage follows GL's rules: pixel centers, vertices
+// snapped to 1/256 pixel and a top-left fill rule, so an edge shared by two triangles is drawn exactly once. The
+// scalar, SSE and AVX2 paths evaluate the same expressions and produce identical images.
+class SoftwareRenderer {
+public:
+    static const int TILE_SIZE = 64;
+
+    struct Stats {
+        size_t draws = 0;
+        // Triangles left after clipping and dropping degenerate ones
+        size_t triangles = 0;
+        // Triangle and tile pairs
+        size_t binned = 0;
+        double setupMs = 0.0;
+        double rasterMs = 0.0;
+    };
+
+    SoftwareRenderer();
+
+    // Returns a program name for DrawCommand::program that fills with `color`
+    unsigned int createProgram(const float color[4]);
+    unsigned int instanceProgram() const;
+
+    // Instances drawn by the instance program, copied
+    void setInstances(const std::vector<QuadInstance> &instances);
+    // Same draw as InstancedQuads::drawCommand(), for submission through a DrawQueue
+    DrawCommand instanceDrawCommand() const;
+
+    void resize(int width, int height);
+    // Takes effect in the next execute(), which fills every tile with the color before drawing into it
+    void clear(const float color[4]);
+    // Runs the queue's draws in sorted order. Uses the job system's threads when given; the calling thread must be
+    // attached to it.
+    void execute(const DrawQueue &queue, const GeometryArena &arena, const float viewProjection[16], JobSystem *jobs);
+
+    // RGBA8 rows from the bottom up, like glReadPixels. Pixels outside the target read as zero.
+    void readPixels(int x, int y, int width, int height, unsigned char *out) const;
+
+    // SIMD path for the edge tests, see best_cull_path()
+    void setPath(CullPath path) { path_ = path; }
+    CullPath path() const { return path_; }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    // Edge functions E(x, y) = a x + b y + c, positive inside; pixel bounds are inclusive and clipped to the target
+    struct Triangle {
+        float a[3], b[3], c[3];
+        int minX, minY, maxX, maxY;
+        uint32_t color;
+        // Bit per edge: pixels exactly on the edge belong to this triangle
+        uint32_t topLeft;
+    };
+
+    // Draw commands resolved to their source data
+    struct Source {
+        DrawCommand command;
+        const GeometryArena::Page *page;
+        uint32_t color;
+        size_t firstTriangle;
+    };
+
+    // Triangles set up by one job, with per-tile lists of them in draw order
+    struct Chunk {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+
+    void setupChunk(size_t chunkIndex, size_t firstTriangle, size_t lastTriangle);
+    void setupTriangle(const Source &source, size_t triangle, Chunk &chunk) const;
+    void addTriangle(const float v0[2], const float v1[2], const float v2[2], uint32_t color, Chunk &chunk) const;
+    void fillTile(int tile);
+
+    int width_ = 0;
+    int height_ = 0;
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+    // Row stride in pixels; the target is padded to whole tiles
+    int stride_ = 0;
+    std::vector<uint32_t> pixels_;
+    bool clearPending_ = false;
+    uint32_t clearColor_ = 0;
+    CullPath path_;
+
+    std::vector<uint32_t> programColors_;
+    std::vector<QuadInstance> instances_;
+    float viewProjection_[16];
+    std::vector<Source> sources_;
+    std::vector<Chunk> chunks_;
+    size_t chunkCount_ = 0;
+    bool reportedUnknownDraw_ = false;
+    Stats stats_;
+};
+
+#endif //PROJECT_SOFTWARE_RENDERER_H
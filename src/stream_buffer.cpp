@@ -0,0 +1,159 @@
+#include "stream_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "gl_state.h"
+
+// One second; waits are retried after that, so a hung GPU shows up as repeated warnings rather than a silent stall
+static const GLuint64 FENCE_TIMEOUT_NS = 1000000000ull;
+
+StreamBuffer::~StreamBuffer() {
+    destroy();
+}
+
+bool StreamBuffer::init(size_t capacity) {
+    capacity_ = capacity;
+    glGenBuffers(1, &buffer_);
+    // The copy-write target is not used for drawing, so mapping through it leaves the VAO and array buffer alone
+    gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) capacity, NULL, GL_STREAM_DRAW);
+    return glGetError() == GL_NO_ERROR;
+}
+
+void StreamBuffer::destroy() {
+    if (buffer_ == 0) {
+        return;
+    }
+    for (Fence &fence : fences_) {
+        glDeleteSync(fence.sync);
+    }
+    fences_.clear();
+    gl_state().deleteBuffer(buffer_);
+    buffer_ = 0;
+    writeCursor_ = retiredCursor_ = fencedCursor_ = 0;
+    frameStart_ = lastFrameStart_ = 0;
+}
+
+void StreamBuffer::retire(bool wait) {
+    while (!fences_.empty()) {
+        Fence &fence = fences_.front();
+        GLenum result = glClientWaitSync(fence.sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                         wait ? FENCE_TIMEOUT_NS : 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            if (!wait) {
+                return;
+            }
+            std::cout << "WARNING::STREAM_BUFFER::FENCE_TIMEOUT" << std::endl;
+            continue;
+        }
+        if (result == GL_WAIT_FAILED) {
+            std::cout << "ERROR::STREAM_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+        }
+        retiredCursor_ = fence.end;
+        glDeleteSync(fence.sync);
+        fences_.pop_front();
+        if (wait) {
+            // Only wait for as much as we need; the caller checks again
+            return;
+        }
+    }
+}
+
+void *StreamBuffer::map(size_t size, size_t alignment, size_t &offset) {
+    if (size == 0 || size > capacity_) {
+        std::cout << "ERROR::STREAM_BUFFER::ALLOCATION_TOO_LARGE " << size << std::endl;
+        stats_.failures++;
+        return nullptr;
+    }
+
+    uint64_t start = writeCursor_;
+    if (alignment > 1) {
+        start = (start + alignment - 1) / alignment * alignment;
+    }
+    // Allocations never straddle the end of the ring; skip to the start instead
+    size_t position = (size_t) (start % capacity_);
+    if (position + size > capacity_) {
+        start += capacity_ - position;
+        position = 0;
+    }
+
+    retire(false);
+    if (start + size - retiredCursor_ > capacity_) {
+        auto waitStart = std::chrono::steady_clock::now();
+        while (start + size - retiredCursor_ > capacity_ && !fences_.empty()) {
+            retire(true);
+        }
+        stats_.waits++;
+        stats_.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        if (start + size - retiredCursor_ > capacity_) {
+            // Everything is retired but this frame alone has written more than the ring holds
+            std::cout << "ERROR::STREAM_BUFFER::OUT_OF_SPACE" << std::endl;
+            stats_.failures++;
+            return nullptr;
+        }
+    }
+
+    gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    void *pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr) position, (GLsizeiptr) size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (pointer == nullptr) {
+        std::cout << "ERROR::STREAM_BUFFER::MAP_FAILED" << std::endl;
+        stats_.failures++;
+        return nullptr;
+    }
+
+    if (writeCursor_ == fencedCursor_) {
+        frameStart_ = start;
+    }
+    writeCursor_ = start + size;
+    stats_.bytesWritten += size;
+    offset = position;
+    return pointer;
+}
+
+void StreamBuffer::unmap() {
+    gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+}
+
+long long StreamBuffer::write(const void *data, size_t size, size_t alignment) {
+    size_t offset = 0;
+    void *pointer = map(size, alignment, offset);
+    if (pointer == nullptr) {
+        return -1;
+    }
+    std::memcpy(pointer, data, size);
+    unmap();
+    return (long long) offset;
+}
+
+void StreamBuffer::endFrame() {
+    if (writeCursor_ == fencedCursor_) {
+        // Nothing new, but the frame may still draw what the last writing frame left in the ring, so that region has
+        // to stay allocated until this frame is done with it too
+        if (fencedCursor_ == 0) {
+            return;
+        }
+        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (!fences_.empty()) {
+            // The newest fence covers that region; move it up to this frame
+            glDeleteSync(fences_.back().sync);
+            fences_.back().sync = sync;
+        } else {
+            // Already retired: take the region back until this frame's fence signals. Nothing was allocated since,
+            // so it still holds the data.
+            retiredCursor_ = std::min(retiredCursor_, lastFrameStart_);
+            fences_.push_back({sync, fencedCursor_});
+        }
+        return;
+    }
+    Fence fence;
+    fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fence.end = writeCursor_;
+    fences_.push_back(fence);
+    lastFrameStart_ = frameStart_;
+    fencedCursor_ = writeCursor_;
+}
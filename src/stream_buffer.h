@@ -0,0 +1,66 @@
+#ifndef PROJECT_STREAM_BUFFER_H
+#define PROJECT_STREAM_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <glad/glad.h>
+
+// Ring buffer for per-frame vertex/index data. Writes go through glMapBufferRange with GL_MAP_UNSYNCHRONIZED_BIT, so
+// the driver never stalls or orphans behind our back; instead every frame's writes are covered by a fence and a
+// region is only handed out again once the GPU has signalled the fence of the frame that last used it.
+//
+// The buffer can be bound to any target, e.g. as a vertex attribute source or as a VAO's element buffer.
+class StreamBuffer {
+public:
+    struct Stats {
+        uint64_t bytesWritten = 0;
+        unsigned int waits = 0;     // allocations that had to wait on a fence
+        double waitMs = 0.0;        // time spent in those waits
+        unsigned int failures = 0;  // allocations that could not be made at all
+    };
+
+    ~StreamBuffer();
+
+    bool init(size_t capacity);
+    void destroy();
+
+    // Reserves `size` bytes and maps them for writing. `offset` receives the position of the allocation inside the
+    // buffer, to be used as the attribute/index offset at draw time. Returns nullptr if the request cannot fit.
+    void *map(size_t size, size_t alignment, size_t &offset);
+    void unmap();
+
+    // Copies `size` bytes in with a map/unmap pair and returns the offset, or -1 on failure
+    long long write(const void *data, size_t size, size_t alignment);
+
+    // Fences everything written since the previous call. Call once per frame after the draws that read the data, also
+    // on frames that wrote nothing: those are taken to redraw what the last writing frame wrote, which then stays
+    // allocated until they are done as well.
+    void endFrame();
+
+    unsigned int buffer() const { return buffer_; }
+    size_t capacity() const { return capacity_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Fence {
+        GLsync sync;
+        uint64_t end; // write cursor at the time the fence was inserted
+    };
+
+    void retire(bool wait);
+
+    unsigned int buffer_ = 0;
+    size_t capacity_ = 0;
+    // Monotonic byte counters; the ring position is the counter modulo capacity
+    uint64_t writeCursor_ = 0;
+    uint64_t retiredCursor_ = 0;
+    uint64_t fencedCursor_ = 0;
+    // Start of the first allocation of the current frame, and of the last frame that wrote anything
+    uint64_t frameStart_ = 0;
+    uint64_t lastFrameStart_ = 0;
+    std::deque<Fence> fences_;
+    Stats stats_;
+};
+
+#endif //PROJECT_STREAM_BUFFER_H
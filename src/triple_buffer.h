@@ -0,0 +1,43 @@
+#ifndef PROJECT_TRIPLE_BUFFER_H
+#define PROJECT_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer triple buffer. The producer fills back() and publishes it; the consumer
+// picks up the most recently published slot with acquire() and reads it through front(). Neither side ever waits on
+// the other: the producer always has a slot to write into, and a slow consumer simply skips stale values.
+//
+// Slots are reused, so a producer that overwrites its back slot in place keeps whatever capacity it had.
+template<typename T>
+class TripleBuffer {
+public:
+    // Producer side
+    T &back() { return slots_[back_]; }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer side. Returns false (and leaves front() alone) if nothing new was published since the last call.
+    bool acquire() {
+        if ((middle_.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T &front() const { return slots_[front_]; }
+
+private:
+    static const unsigned int INDEX = 0x3;
+    static const unsigned int FRESH = 0x4;
+
+    T slots_[3];
+    // Only touched by the producer / consumer respectively
+    unsigned int back_ = 0;
+    unsigned int front_ = 1;
+    alignas(64) std::atomic<unsigned int> middle_{2};
+};
+
+#endif //PROJECT_TRIPLE_BUFFER_H
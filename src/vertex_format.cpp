@@ -0,0 +1,222 @@
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <glad/glad.h>
+
+// Largest magnitude of the signed integer formats. Symmetric so that 0 maps to the center of the bounds.
+static const float SHORT_RANGE = 32767.0f;
+static const float INT10_RANGE = 511.0f;
+
+size_t vertex_format_stride(VertexFormat format) {
+    switch (format) {
+        case VERTEX_HALF3:
+        case VERTEX_SHORT3:
+            return 8;
+        case VERTEX_INT_2_10_10_10:
+            return 4;
+        default:
+            return 12;
+    }
+}
+
+const char *vertex_format_name(VertexFormat format) {
+    switch (format) {
+        case VERTEX_HALF3:
+            return "half3";
+        case VERTEX_SHORT3:
+            return "short3";
+        case VERTEX_INT_2_10_10_10:
+            return "int_2_10_10_10";
+        default:
+            return "float3";
+    }
+}
+
+void setup_position_attribute(VertexFormat format) {
+    GLsizei stride = (GLsizei) vertex_format_stride(format);
+    switch (format) {
+        case VERTEX_HALF3:
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void *) 0);
+            break;
+        case VERTEX_SHORT3:
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride, (void *) 0);
+            break;
+        case VERTEX_INT_2_10_10_10:
+            // Packed formats always have four components; the shader ignores w
+            glVertexAttribPointer(0, 4, GL_INT_2_10_10_10_REV, GL_FALSE, stride, (void *) 0);
+            break;
+        default:
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *) 0);
+            break;
+    }
+    glEnableVertexAttribArray(0);
+}
+
+// IEEE 754 binary16 with round-to-nearest-even; overflow goes to infinity
+static uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t) ((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return (uint16_t) (sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+    if (exponent >= 31) {
+        return (uint16_t) (sign | 0x7C00u);
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return (uint16_t) sign;
+        }
+        // Subnormal: shift the implicit leading one in, then round
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t) (14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+            half++;
+        }
+        return (uint16_t) (sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+        // Carries into the exponent correctly, up to infinity
+        half++;
+    }
+    return (uint16_t) half;
+}
+
+static float half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t) (half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    float value;
+    if (exponent == 0) {
+        value = std::ldexp((float) mantissa, -24);
+    } else if (exponent == 31) {
+        value = mantissa != 0 ? NAN : INFINITY;
+    } else {
+        value = std::ldexp((float) (mantissa | 0x400u), (int) exponent - 25);
+    }
+    return sign != 0 ? -value : value;
+}
+
+void decode_position(const unsigned char *vertex, VertexFormat format, float out[3]) {
+    switch (format) {
+        case VERTEX_HALF3: {
+            uint16_t packed[3];
+            std::memcpy(packed, vertex, sizeof(packed));
+            for (int axis = 0; axis < 3; axis++) {
+                out[axis] = half_to_float(packed[axis]);
+            }
+            break;
+        }
+        case VERTEX_SHORT3: {
+            int16_t packed[3];
+            std::memcpy(packed, vertex, sizeof(packed));
+            for (int axis = 0; axis < 3; axis++) {
+                out[axis] = (float) packed[axis];
+            }
+            break;
+        }
+        case VERTEX_INT_2_10_10_10: {
+            uint32_t packed;
+            std::memcpy(&packed, vertex, sizeof(packed));
+            for (int axis = 0; axis < 3; axis++) {
+                // Sign-extend the 10-bit field
+                out[axis] = (float) ((int32_t) (packed << (22 - axis * 10)) >> 22);
+            }
+            break;
+        }
+        default:
+            std::memcpy(out, vertex, sizeof(float) * 3);
+            break;
+    }
+}
+
+void quantize_positions(const float *positions, size_t vertexCount, VertexFormat format, QuantizedPositions &out) {
+    out.format = format;
+    out.data.assign(vertexCount * vertex_format_stride(format), 0);
+    out.maxError = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        out.scale[axis] = 1.0f;
+        out.offset[axis] = 0.0f;
+    }
+
+    if (format == VERTEX_FLOAT3) {
+        if (vertexCount > 0) {
+            std::memcpy(out.data.data(), positions, vertexCount * 3 * sizeof(float));
+        }
+        return;
+    }
+
+    if (format == VERTEX_HALF3) {
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            uint16_t packed[4] = {0, 0, 0, 0};
+            for (int axis = 0; axis < 3; axis++) {
+                float value = positions[vertex * 3 + axis];
+                packed[axis] = float_to_half(value);
+                out.maxError = std::max(out.maxError, std::fabs(half_to_float(packed[axis]) - value));
+            }
+            std::memcpy(out.data.data() + vertex * 8, packed, sizeof(packed));
+        }
+        return;
+    }
+
+    // Fixed point over the bounds: offset is the center, scale maps the largest integer to the extent
+    float minimum[3] = {INFINITY, INFINITY, INFINITY};
+    float maximum[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        for (int axis = 0; axis < 3; axis++) {
+            minimum[axis] = std::min(minimum[axis], positions[vertex * 3 + axis]);
+            maximum[axis] = std::max(maximum[axis], positions[vertex * 3 + axis]);
+        }
+    }
+    float range = format == VERTEX_SHORT3 ? SHORT_RANGE : INT10_RANGE;
+    for (int axis = 0; axis < 3 && vertexCount > 0; axis++) {
+        float extent = (maximum[axis] - minimum[axis]) * 0.5f;
+        out.offset[axis] = (maximum[axis] + minimum[axis]) * 0.5f;
+        out.scale[axis] = extent > 0.0f ? extent / range : 1.0f;
+    }
+
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        int32_t quantized[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float value = positions[vertex * 3 + axis];
+            float scaled = std::round((value - out.offset[axis]) / out.scale[axis]);
+            quantized[axis] = (int32_t) std::max(-range, std::min(range, scaled));
+            float decoded = (float) quantized[axis] * out.scale[axis] + out.offset[axis];
+            out.maxError = std::max(out.maxError, std::fabs(decoded - value));
+        }
+
+        if (format == VERTEX_SHORT3) {
+            int16_t packed[4] = {(int16_t) quantized[0], (int16_t) quantized[1], (int16_t) quantized[2], 0};
+            std::memcpy(out.data.data() + vertex * 8, packed, sizeof(packed));
+        } else {
+            uint32_t packed = ((uint32_t) quantized[0] & 0x3FFu) |
+                              (((uint32_t) quantized[1] & 0x3FFu) << 10) |
+                              (((uint32_t) quantized[2] & 0x3FFu) << 20);
+            std::memcpy(out.data.data() + vertex * 4, &packed, sizeof(packed));
+        }
+    }
+}
+
+void choose_vertex_format(const float *positions, size_t vertexCount, float maxError, QuantizedPositions &out) {
+    if (maxError > 0.0f) {
+        for (int format = VERTEX_FORMAT_COUNT - 1; format > VERTEX_FLOAT3; format--) {
+            quantize_positions(positions, vertexCount, (VertexFormat) format, out);
+            if (out.maxError <= maxError) {
+                return;
+            }
+        }
+    }
+    quantize_positions(positions, vertexCount, VERTEX_FLOAT3, out);
+}
@@ -0,0 +1,46 @@
+#ifndef PROJECT_VERTEX_FORMAT_H
+#define PROJECT_VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <vector>
+
+// Storage formats for vertex positions, smallest last. The integer formats are stored unnormalized and mapped back
+// to object space in the vertex shader through uPositionScale/uPositionOffset:
+//
+//     position = aPos * uPositionScale + uPositionOffset
+//
+// Keeping the scale out of the attribute conversion means the result does not depend on which signed-normalized
+// conversion rule the driver implements (it changed between GL 3.3 and 4.2).
+enum VertexFormat {
+    VERTEX_FLOAT3 = 0,      // 12 bytes, exact
+    VERTEX_HALF3 = 1,       // 8 bytes (3 halves + padding), relative precision
+    VERTEX_SHORT3 = 2,      // 8 bytes (3 shorts + padding), 16-bit fixed point over the mesh bounds
+    VERTEX_INT_2_10_10_10 = 3, // 4 bytes, GL_INT_2_10_10_10_REV, 10-bit fixed point over the mesh bounds
+    VERTEX_FORMAT_COUNT
+};
+
+struct QuantizedPositions {
+    VertexFormat format = VERTEX_FLOAT3;
+    std::vector<unsigned char> data;
+    float scale[3] = {1.0f, 1.0f, 1.0f};
+    float offset[3] = {0.0f, 0.0f, 0.0f};
+    float maxError = 0.0f; // largest per-axis difference to the source positions after decoding
+};
+
+size_t vertex_format_stride(VertexFormat format);
+const char *vertex_format_name(VertexFormat format);
+
+// Sets up attribute 0 for the format on the bound VAO, reading from the bound GL_ARRAY_BUFFER
+void setup_position_attribute(VertexFormat format);
+
+// Reads one stored vertex back as the attribute the shader sees (before uPositionScale/uPositionOffset)
+void decode_position(const unsigned char *vertex, VertexFormat format, float out[3]);
+
+// Encodes tightly packed xyz float positions in the given format
+void quantize_positions(const float *positions, size_t vertexCount, VertexFormat format, QuantizedPositions &out);
+
+// Picks the smallest format whose decoded positions stay within `maxError` of the source on every axis. A bound of
+// zero (or less) always picks VERTEX_FLOAT3.
+void choose_vertex_format(const float *positions, size_t vertexCount, float maxError, QuantizedPositions &out);
+
+#endif //PROJECT_VERTEX_FORMAT_H